@@ -6,6 +6,8 @@
  * future. We can use a TimerAction to set an alarm much further. Try it out!
  */
 
+// Runs from TimerExtensions::poll() in loop(), so it doesn't hold up other
+// timer interrupts while it prints
 void alarm(TimerAction *, void *) {
   Serial.println("Hello world!");
 }
@@ -19,10 +21,12 @@ void setup() {
 
   ticksExtraRange_t alarmTicks = TimerAction1A.millisecondsToTicks(8000);
 
+  TimerAction1A.setDeferredCallbacks(true);
   TimerAction1A.schedule(alarmTicks, alarm);
 
   Serial.println("Alarm scheduled");
 }
   
 void loop() {
+  TimerExtensions::poll();
 }
\ No newline at end of file
@@ -15,8 +15,17 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "timerAction.h"
+#include "timerActionBatch.h"
+#include "timerCalibration.h"
 #include "extTimer.h"
+#include "extTimerT.h"
+#include "extTimerSnapshot.h"
 #include "pulseGen.h"
+#include "servoDriver.h"
+#include "tickService.h"
+#include "timerScheduler.h"
+#include "timerSequence.h"
 #include "timerTypes.h"
+#include "timerEvents.h"
 #include "timerInterrupts.h"
 #include "timerUtil.h"
\ No newline at end of file
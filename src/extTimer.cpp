@@ -20,124 +20,281 @@
 #include "avr/interrupt.h"
 #include "util/atomic.h"
 
+#include "timerAction.h"
 #include "timerTypes.h"
 
-#ifndef IMPLEMENT_TIMER0_OVERFLOW
-#define IMPLEMENT_TIMER0_OVERFLOW 0
-#endif
-
-#define USE_ARDUINO_TIMER0_OVERFLOW (!IMPLEMENT_TIMER0_OVERFLOW)
-
-#if USE_ARDUINO_TIMER0_OVERFLOW
-
-extern volatile unsigned long timer0_overflow_count;
-
-#endif
-
 ExtTimer::ExtTimer(volatile uint8_t *tcntl, volatile uint8_t *tcnth, volatile uint8_t *timsk,
     uint8_t toie, volatile uint8_t *tifr, uint8_t tov, uint8_t timer) :
   _tcntl(tcntl), _tcnth(tcnth), _timsk(timsk),
-    _toie(toie), _tifr(tifr), _tov(tov), _timer(timer)
+    _toie(toie), _tifr(tifr), _tov(tov), _timer(timer),
+    _ticksPerOverflow(tcnth ? (1UL << 16) : (1UL << 8)), _wrapFlag(tov)
 {
   *_timsk |= _BV(_toie);
 }
   
 void ExtTimer::configure(TimerClock clock)
 {
-  setTimerClock(_timer, clock);
-  setTimerMode(_timer, TimerMode::Normal);
+  configure(clock, TimerMode::Normal);
 }
 
-ticksExtraRange_t ExtTimer::get() const
+bool ExtTimer::configure(TimerClock clock, TimerMode mode, TimerResolution resolution)
 {
-  ticksExtraRange_t ovfTicks;
-  ticksExtraRange_t sys;
-  uint8_t ovf;
-  
-  // Prevent overflow ticks from incrementing and prevent TOV flag from clearing
+  bool dualSlope = false;
+  uint8_t wrapFlag = _tov;
+
+  // OCFnA and ICFn are the same bits in every TIFRn
+  uint8_t topFlag = TimerResolution::ICR == resolution ? ICF1 : OCF1A;
+
+  switch (mode)
+  {
+    case TimerMode::Normal:
+    case TimerMode::FastPWM:
+      // TOV is set at TOP
+      break;
+    case TimerMode::CTC:
+      // TOV isn't set at TOP, so the TOP compare flag marks the wrap instead.
+      // Nothing handles that interrupt, so wraps must be counted lazily
+      if (!_lazyOverflow)
+      {
+        return false;
+      }
+
+      wrapFlag = topFlag;
+      break;
+    case TimerMode::PWM_PC:
+    case TimerMode::PWM_PFC:
+      // TOV is set at BOTTOM. The TOP compare flag tells which way the
+      // counter is going, so fixed TOPs without a flag aren't supported
+      if ((TimerResolution::OCRA != resolution && TimerResolution::ICR != resolution)
+        || _lazyOverflow)
+      {
+        return false;
+      }
+
+      dualSlope = true;
+      break;
+    default:
+      return false;
+  }
+
+  ticks16_t top = getTimerTop(_timer, resolution);
+  ticksExtraRange_t ticksPerOverflow = dualSlope
+    ? 2 * static_cast<ticksExtraRange_t>(top)
+    : static_cast<ticksExtraRange_t>(top) + 1;
+
+#if USE_ARDUINO_TIMER0_OVERFLOW
+  if (TIMER0 == _timer && (dualSlope || ticksPerOverflow != (1UL << 8)))
+  {
+    // Arduino counts TIMER0 overflows as 256 ticks
+    return false;
+  }
+#endif
+
+  if (!setTimerMode(_timer, mode, resolution))
+  {
+    return false;
+  }
+
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
-    ovfTicks = getOverflowTicksInternal();
+    bool periodChanged = ticksPerOverflow != _ticksPerOverflow
+      || dualSlope != _dualSlope || wrapFlag != _wrapFlag;
 
-    sys = getSysRange();
+    _top = top;
+    _ticksPerOverflow = ticksPerOverflow;
+    _dualSlope = dualSlope;
+    _wrapFlag = wrapFlag;
+    _topFlag = topFlag;
+    // A full 8 or 16-bit period keeps the overflow ticks in step with TCNT,
+    // and TIMER0's with timer0_overflow_count, whatever the mode
+    _customPeriod = dualSlope
+      || ticksPerOverflow != (_tcnth ? (1UL << 16) : (1UL << 8));
+    _slowOverflow = _overflowCallback || _customPeriod;
 
-    ovf = *_tifr & (1 << _tov);
+    // The old ticks don't mean anything with a different period
+    if (periodChanged)
+    {
+      setFromIsr(0);
+
+      _ticksAtClockChange = 0;
+      _clockCyclesAtClockChange = 0;
+    }
   }
 
-  ticksExtraRange_t ticks = sys + ovfTicks;
+  return setTimerClock(_timer, clock);
+}
+
+bool ExtTimer::reconfigure(TimerClock clock)
+{
+  TimerClock oldClock = getTimerClock(_timer);
 
-  // Handle overflow only if the time overflowed recently
-  // and the overflow flag is set
-  if (ovf)
+  if (_dualSlope)
   {
-    if (_tcnth)
+    // set() can't put a dual-slope counter on the way down
+    return false;
+  }
+
+  if (TimerClock::None == oldClock || TimerClock::None == clock)
+  {
+    // Nothing to rescale from or to
+    return setTimerClock(_timer, clock);
+  }
+
+  if (!isTimerClockSupported(_timer, clock))
+  {
+    // Check before anything is rescaled, so a failure changes nothing
+    return false;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (TimerAction *action = _actions; action; action = action->_nextAction)
     {
-      // 16-bit timer
-      if (sys < (1UL << 15))
+      if (action->hasFixedTicks())
       {
-        ticks += (1UL << 16);
+        // Something holds ticks of its own that can't be moved
+        return false;
       }
     }
-    else
+
+    // Stop the timer so that nothing changes while rescaling
+    setTimerClock(_timer, TimerClock::None);
+
+    ticksExtraRange64_t oldTicks = get64();
+
+    int oldCyclesPerTick = clockCyclesPerTick(oldClock);
+    int newCyclesPerTick = clockCyclesPerTick(clock);
+
+    ticksExtraRange64_t clockCycles = _clockCyclesAtClockChange
+      + (oldTicks - _ticksAtClockChange) * oldCyclesPerTick;
+    ticksExtraRange64_t newTicks = clockCycles / newCyclesPerTick;
+
+    setFromIsr(newTicks);
+
+    _ticksAtClockChange = newTicks;
+    _clockCyclesAtClockChange = clockCycles;
+
+    for (TimerAction *action = _actions; action; action = action->_nextAction)
     {
-      // 8-bit timer
-      if (sys < (1UL << 7))
-      {
-        ticks += (1UL << 8);
-      }
+      action->rescale(oldTicks, newTicks, oldCyclesPerTick, newCyclesPerTick);
     }
+
+    // Start the timer again
+    setTimerClock(_timer, clock);
   }
 
-  return ticks;
+  return true;
 }
 
-void ExtTimer::set(ticksExtraRange_t ticks)
+ticksExtraRange_t ExtTimer::get() const
 {
+  ticksExtraRange_t ovfTicks;
+  ticks16_t sys;
 
-  if (_tcnth)
+  readTicks(ovfTicks, sys);
+
+  return ovfTicks + sys;
+}
+
+void ExtTimer::set(ticksExtraRange_t ticks)
+{
+  // Ensure that TCNT is set, overflow is set, and TOV is cleared all together
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
-    // 16-bit timer
+    setFromIsr(ticks);
 
-    uint8_t highByte = (ticks & 0x0000FF00) >> 8;
+    _ticksAtClockChange = 0;
+    _clockCyclesAtClockChange = 0;
+  }
+}
 
-    // Ensure that TCNT is set, overflow is set, and TOV is cleared all together
-    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-    {
-      _overflowTicks = ticks & 0xFFFF0000;
+void ExtTimer::setFromIsr(ticksExtraRange64_t ticks)
+{
+  if (_customPeriod)
+  {
+    setCustomPeriodFromIsr(ticks);
+    return;
+  }
 
-      // Follow correct 16-bit register access rules by setting the high register first
-      *_tcnth = highByte;
-      *_tcntl = (uint8_t)ticks;
+  _overflowTicksHigh = ticks >> 32;
 
-      // Clear overflow flag
-      *_tifr = (1 << _tov);
-    }
+  if (_tcnth)
+  {
+    // 16-bit timer
+    _overflowTicks = ticks & 0xFFFF0000;
   }
   else
   {
     // 8-bit timer
 
-    // Ensure that TCNT is set, overflow is set, and TOV is cleared all together
-    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-    {
   // Use the Arduino overflow variable if defined
 #if USE_ARDUINO_TIMER0_OVERFLOW
-      if (TIMER0 == _timer)
-      {
-        timer0_overflow_count = ticks >> 8;
-      }
-      else
-      {
-      _overflowTicks = ticks & 0xFFFFFF00;
-      }
-#elif
+    if (TIMER0 == _timer)
+    {
+      timer0_overflow_count = static_cast<ticksExtraRange_t>(ticks) >> 8;
+    }
+    else
+    {
       _overflowTicks = ticks & 0xFFFFFF00;
+    }
+#else
+    _overflowTicks = ticks & 0xFFFFFF00;
 #endif
+  }
+
+  writeSysRange(static_cast<ticks16_t>(ticks));
+
+  // Clear overflow flag
+  *_tifr = (1 << _wrapFlag);
+
+  _lastSysTicks = static_cast<ticks16_t>(ticks) & getMaxSysTicks();
+}
 
-      *_tcntl = (uint8_t)ticks;
+void ExtTimer::setCustomPeriodFromIsr(ticksExtraRange64_t ticks)
+{
+  ticksExtraRange_t sysTicks = ticks % _ticksPerOverflow;
+  ticksExtraRange64_t overflowTicks = ticks - sysTicks;
+
+  if (_dualSlope && sysTicks > _top)
+  {
+    // There's no way to set the direction, so stop at TOP on the way up
+    sysTicks = _top;
+  }
 
-      // Clear overflow flag
-      *_tifr = (1 << _tov);
+  _overflowTicksHigh = overflowTicks >> 32;
+  _overflowTicks = overflowTicks;
+
+  writeSysRange(sysTicks);
+
+  // Clear overflow flag, and the TOP flag in dual-slope modes
+  *_tifr = (1 << _wrapFlag) | (_dualSlope ? (1 << _topFlag) : 0);
+
+  _lastSysTicks = sysTicks;
+}
+
+void ExtTimer::writeSysRange(ticks16_t sysTicks)
+{
+  if (_tcnth)
+  {
+    // Follow correct 16-bit register access rules by setting the high register first
+    *_tcnth = sysTicks >> 8;
+    *_tcntl = (uint8_t)sysTicks;
+  }
+  else
+  {
+    *_tcntl = (uint8_t)sysTicks;
+  }
+}
+
+void ExtTimer::addAction(TimerAction *action)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (!action->_addedToExtTimer)
+    {
+      action->_nextAction = _actions;
+      _actions = action;
+      action->_addedToExtTimer = true;
     }
   }
 }
@@ -145,17 +302,57 @@ void ExtTimer::set(ticksExtraRange_t ticks)
 ticksExtraRange_t ExtTimer::extend(ticks16_t ticks) const
 {
   ticksExtraRange_t overflowTicks;
-  uint8_t tifrVal;
   ticks16_t sysTicks;
 
-  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-  {
-    overflowTicks = getOverflowTicksInternal();
-    tifrVal = *_tifr;
-    sysTicks = getSysRange();
-  }
+  readExtendTicks(overflowTicks, sysTicks);
+
+  return extend(ticks, overflowTicks, sysTicks);
+}
+
+ticksExtraRange_t ExtTimer::extendTimeInPast(ticks16_t ticks) const
+{
+  ticksExtraRange_t overflowTicks;
+  ticks16_t sysTicks;
+
+  readExtendTicks(overflowTicks, sysTicks);
+
+  return extendTimeInPast(ticks, overflowTicks, sysTicks);
+}
+
+ticksExtraRange_t ExtTimer::getFromIsr() const
+{
+  ticksExtraRange_t ovfTicks;
+  ticks16_t sys;
+
+  readTicksFromIsr(ovfTicks, sys);
+
+  return ovfTicks + sys;
+}
+
+ticksExtraRange_t ExtTimer::extendFromIsr(ticks16_t ticks) const
+{
+  ticksExtraRange_t overflowTicks;
+  ticks16_t sysTicks;
+
+  readExtendTicksFromIsr(overflowTicks, sysTicks);
+
+  return extend(ticks, overflowTicks, sysTicks);
+}
+
+ticksExtraRange_t ExtTimer::extendTimeInPastFromIsr(ticks16_t ticks) const
+{
+  ticksExtraRange_t overflowTicks;
+  ticks16_t sysTicks;
 
-  ticksExtraRange_t extTicks = compensateForUnprocessedOverflow(ticks + overflowTicks, tifrVal);
+  readExtendTicksFromIsr(overflowTicks, sysTicks);
+
+  return extendTimeInPast(ticks, overflowTicks, sysTicks);
+}
+
+ticksExtraRange_t ExtTimer::extend(ticks16_t ticks, ticksExtraRange_t overflowTicks,
+    ticks16_t sysTicks) const
+{
+  ticksExtraRange_t extTicks = ticks + overflowTicks;
 
   // Add another overflow if the ticks is before tcnt.
   // We're assuming that ticks is in the future, so so tcnt needs to roll over to get there.
@@ -169,55 +366,117 @@ ticksExtraRange_t ExtTimer::extend(ticks16_t ticks) const
   }
 }
 
-ticksExtraRange_t ExtTimer::extendTimeInPast(ticks16_t ticks) const
+ticksExtraRange_t ExtTimer::extendTimeInPast(ticks16_t ticks, ticksExtraRange_t overflowTicks,
+    ticks16_t sysTicks) const
 {
-  ticksExtraRange_t overflowTicks;
-  uint8_t tifrVal;
+  ticksExtraRange_t extTicks = ticks + overflowTicks;
+
+  // Subtract another overflow if the ticks is after tcnt.
+  // We're assuming that ticks is in the past, so so tcnt would have rolled over to get here.
+  if (sysTicks <= ticks)
+  {
+    return decrementOverflow(extTicks);
+  }
+  else
+  {
+    return extTicks;
+  }
+}
+
+ticksExtraRange64_t ExtTimer::get64() const
+{
+  ticksExtraRange64_t ovfTicks;
+  ticks16_t sys;
+
+  readTicks64(ovfTicks, sys);
+
+  return ovfTicks + sys;
+}
+
+ticksExtraRange64_t ExtTimer::extend64(ticks16_t ticks) const
+{
+  ticksExtraRange64_t overflowTicks;
   ticks16_t sysTicks;
 
-  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  readExtendTicks64(overflowTicks, sysTicks);
+
+  ticksExtraRange64_t extTicks = overflowTicks + ticks;
+
+  // Add another overflow if the ticks is before tcnt.
+  // We're assuming that ticks is in the future, so so tcnt needs to roll over to get there.
+  if (ticks < sysTicks)
   {
-    overflowTicks = getOverflowTicksInternal();
-    tifrVal = *_tifr;
-    sysTicks = getSysRange();
+    extTicks += getTicksPerOverflow();
   }
-  
-  ticksExtraRange_t extTicks = compensateForUnprocessedOverflow(ticks + overflowTicks, tifrVal);
+
+  return extTicks;
+}
+
+ticksExtraRange64_t ExtTimer::extendTimeInPast64(ticks16_t ticks) const
+{
+  ticksExtraRange64_t overflowTicks;
+  ticks16_t sysTicks;
+
+  readExtendTicks64(overflowTicks, sysTicks);
+
+  ticksExtraRange64_t extTicks = overflowTicks + ticks;
 
   // Subtract another overflow if the ticks is after tcnt.
   // We're assuming that ticks is in the past, so so tcnt would have rolled over to get here.
   if (sysTicks <= ticks)
   {
-    return decrementOverflow(extTicks);
+    extTicks -= getTicksPerOverflow();
   }
-  else
+
+  return extTicks;
+}
+
+ticksExtraRange64_t ExtTimer::getClockCycles64() const
+{
+  ticksExtraRange64_t ticks;
+  ticksExtraRange64_t ticksAtClockChange;
+  ticksExtraRange64_t clockCyclesAtClockChange;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
-    return extTicks;
+    ticks = get64();
+    ticksAtClockChange = _ticksAtClockChange;
+    clockCyclesAtClockChange = _clockCyclesAtClockChange;
   }
+
+  return clockCyclesAtClockChange
+    + (ticks - ticksAtClockChange) * clockCyclesPerTick(getTimerClock(_timer));
 }
 
 ticks16_t ExtTimer::getSysRange() const
 {
+#if EXT_TIMER_LOCK_FREE_READS
+  return readSysRangeLockFree();
+#else
   if (_tcnth)
   {
     // 16-bit counter
-    ticks16_t low, high;
+    ticks16_t sys;
 
     // Ensure there's no race with someone trying to use the temp register
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-      // Follow correct 16-bit register access rules by loading the low register first
-      low = *_tcntl;
-      high = *_tcnth;
+      sys = readSysRange();
     }
 
-    return low + (high << 8);
+    return sys;
   }
   else
   {
     // 8-bit counter
     return *_tcntl;
   }
+#endif
+}
+
+ticks16_t ExtTimer::getSysRangeFromIsr() const
+{
+  return readSysRange();
 }
 
 uint16_t ExtTimer::getMaxSysTicks() const {
@@ -266,6 +525,8 @@ void ExtTimer::resetOverflowCount()
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
     // Use the Arduino overflow variable if defined
+    _overflowTicksHigh = 0;
+
 #ifdef USE_ARDUINO_TIMER0_OVERFLOW
     if (TIMER0 == _timer)
     {
@@ -278,7 +539,76 @@ void ExtTimer::resetOverflowCount()
 #else
     _overflowTicks = 0;
 #endif
+
+    _ticksAtClockChange = 0;
+    _clockCyclesAtClockChange = 0;
+  }
+}
+
+bool ExtTimer::setLazyOverflowEnabled(bool enabled)
+{
+#if USE_ARDUINO_TIMER0_OVERFLOW
+  if (TIMER0 == _timer)
+  {
+    // Arduino needs the overflow interrupt for millis()
+    return false;
+  }
+#endif
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (enabled == _lazyOverflow)
+    {
+      return true;
+    }
+
+    if (_dualSlope || _tov != _wrapFlag)
+    {
+      // Dual-slope modes need the overflow interrupt to know which way the
+      // counter is going, and CTC mode has no overflow interrupt
+      return false;
+    }
+
+    if (enabled)
+    {
+      // Take over any overflow that the interrupt hasn't processed yet
+      ticksExtraRange_t overflowTicks;
+      ticks16_t sysTicks;
+
+      readTicksFromIsr(overflowTicks, sysTicks);
+
+      if (overflowTicks != _overflowTicks)
+      {
+        addOverflow();
+        *_tifr = (1 << _wrapFlag);
+      }
+
+      _lastSysTicks = sysTicks;
+      _lazyOverflow = true;
+
+      *_timsk &= ~_BV(_toie);
+    }
+    else
+    {
+      // Count any wrap since the last read. A wrap that's still flagged
+      // is picked up by the interrupt
+      ticksExtraRange_t overflowTicks;
+      ticks16_t sysTicks;
+
+      readTicksLazyFromIsr(overflowTicks, sysTicks);
+
+      _lazyOverflow = false;
+
+      *_timsk |= _BV(_toie);
+    }
   }
+
+  return true;
+}
+
+bool ExtTimer::getLazyOverflowEnabled() const
+{
+  return _lazyOverflow;
 }
 
 int ExtTimer::getTimer() const
@@ -297,7 +627,13 @@ volatile uint8_t *ExtTimer::getTIFR() const
 
 void ExtTimer::processOverflow()
 {
-  _overflowTicks = incrementOverflow(_overflowTicks);
+  addOverflow();
+
+  if (_dualSlope)
+  {
+    // Counting up from BOTTOM again
+    *_tifr = (1 << _topFlag);
+  }
 
   if (_overflowCallback)
   {
@@ -305,91 +641,483 @@ void ExtTimer::processOverflow()
   }
 }
 
+void ExtTimer::addOverflow() const
+{
+  ticksExtraRange_t overflowTicks = incrementOverflow(_overflowTicks);
+
+  _overflowTicks = overflowTicks;
+
+  // Carry into the upper 32 bits when the lower 32 bits wrap
+  if (0 == overflowTicks)
+  {
+    _overflowTicksHigh = _overflowTicksHigh + 1;
+  }
+}
+
 void ExtTimer::setOverflowCallback(OverflowCallback cb)
 {
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
     _overflowCallback = cb;
+    _slowOverflow = _overflowCallback || _customPeriod;
   }
 }
 
 bool ExtTimer::hasUnprocessedOverflow(uint8_t tifrVal) const
 {
-  return tifrVal & (1 << _tov);
+  return tifrVal & (1 << _wrapFlag);
 }
 
-ticksExtraRange_t ExtTimer::compensateForUnprocessedOverflow(ticksExtraRange_t ticks, uint8_t tifrVal) const
+ticksExtraRange_t ExtTimer::getOverflowTicksInternal() const
 {
-  // See if there was an unprocessed overflow
-  if (hasUnprocessedOverflow(tifrVal))
+  ticksExtraRange_t tmp;
+
+  // Use the Arduino overflow variable if defined
+#ifdef USE_ARDUINO_TIMER0_OVERFLOW
+  if (TIMER0 == _timer)
   {
-    return incrementOverflow(ticks);
+    tmp = timer0_overflow_count << 8;
   }
   else
   {
-    return ticks;
+    tmp = _overflowTicks;
   }
+#else
+  tmp = _overflowTicks;
+#endif
+
+  return tmp;
 }
 
-ticksExtraRange_t ExtTimer::getOverflowTicksInternal() const
+ticksExtraRange64_t ExtTimer::getOverflowTicksInternal64() const
 {
-  ticksExtraRange_t tmp;
+  ticksExtraRange64_t tmp;
 
   // Use the Arduino overflow variable if defined
 #ifdef USE_ARDUINO_TIMER0_OVERFLOW
   if (TIMER0 == _timer)
   {
-    tmp = timer0_overflow_count << 8;
+    // The Arduino overflow count is only 32 bits, so this wraps after 2^40 ticks
+    tmp = static_cast<ticksExtraRange64_t>(timer0_overflow_count) << 8;
   }
   else
   {
-    tmp = _overflowTicks;
+    tmp = (static_cast<ticksExtraRange64_t>(_overflowTicksHigh) << 32) | _overflowTicks;
   }
 #else
-  tmp = _overflowTicks;
+  tmp = (static_cast<ticksExtraRange64_t>(_overflowTicksHigh) << 32) | _overflowTicks;
 #endif
 
   return tmp;
 }
 
+ticksExtraRange_t ExtTimer::getTicksPerOverflow() const
+{
+  return _ticksPerOverflow;
+}
+
 ticksExtraRange_t ExtTimer::incrementOverflow(ticksExtraRange_t ticks) const
+{
+  return ticks + _ticksPerOverflow;
+}
+
+ticksExtraRange_t ExtTimer::decrementOverflow(ticksExtraRange_t ticks) const
+{
+  return ticks - _ticksPerOverflow;
+}
+
+ticksExtraRange_t ExtTimer::getOverflowTicks() const
+{
+  ticksExtraRange_t overflowTicks;
+  ticks16_t sysTicks;
+
+  readExtendTicks(overflowTicks, sysTicks);
+
+  return overflowTicks;
+}
+
+ticksExtraRange64_t ExtTimer::getOverflowTicks64() const
+{
+  ticksExtraRange64_t overflowTicks;
+  ticks16_t sysTicks;
+
+  readExtendTicks64(overflowTicks, sysTicks);
+
+  return overflowTicks;
+}
+
+ticks16_t ExtTimer::readSysRange() const
 {
   if (_tcnth)
   {
-    // add 65536 to the overflow ticks counter on overflow for 16-bit timers
-    return ticks + (1UL << 16);
+    // 16-bit counter
+    // Follow correct 16-bit register access rules by loading the low register first
+    ticks16_t low = *_tcntl;
+    ticks16_t high = *_tcnth;
+
+    return low + (high << 8);
   }
   else
   {
-    // add 256 to the overflow ticks counter on overflow for 8-bit timers
-    return ticks + (1UL << 8);
+    // 8-bit counter
+    return *_tcntl;
   }
 }
 
-ticksExtraRange_t ExtTimer::decrementOverflow(ticksExtraRange_t ticks) const
+ticks16_t ExtTimer::readSysRangeLockFree() const
 {
   if (_tcnth)
   {
-    // subtract 65536 from the overflow ticks counter on overflow for 16-bit timers
-    return ticks - (1UL << 16);
+    // An interrupt that accesses one of this timer's 16-bit registers between
+    // the low and high byte reads will corrupt the high byte, so keep reading
+    // until two reads in a row agree
+    ticks16_t sys = readSysRange();
+
+    while (true)
+    {
+      ticks16_t sysAfter = readSysRange();
+
+      if ((sys >> 8) == (sysAfter >> 8) && sys <= sysAfter)
+      {
+        return sysAfter;
+      }
+
+      sys = sysAfter;
+    }
   }
   else
   {
-    // subtract 256 from the overflow ticks counter on overflow for 8-bit timers
-    return ticks - (1UL << 8);
+    // 8-bit counter
+    return *_tcntl;
   }
 }
 
-ticksExtraRange_t ExtTimer::getOverflowTicks() const
+void ExtTimer::readTicks(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks) const
 {
-  ticksExtraRange_t overflowTicks;
+  if (_dualSlope)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      readTicksFromIsr(overflowTicks, sysTicks);
+    }
+
+    return;
+  }
+
+  if (_lazyOverflow)
+  {
+    // Reads update the overflow ticks, so they can't be lock-free
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      readTicksLazyFromIsr(overflowTicks, sysTicks);
+    }
+
+    return;
+  }
+
   uint8_t tifrVal;
 
+#if EXT_TIMER_LOCK_FREE_READS
+  // Leave interrupts on, and start over if an overflow was processed while reading
+  ticksExtraRange_t overflowTicksAfter;
+
+  do
+  {
+    overflowTicks = getOverflowTicksInternal();
+    sysTicks = readSysRangeLockFree();
+    tifrVal = *_tifr;
+    overflowTicksAfter = getOverflowTicksInternal();
+  }
+  while (overflowTicks != overflowTicksAfter);
+#else
+  // Prevent overflow ticks from incrementing and prevent TOV flag from clearing
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
     overflowTicks = getOverflowTicksInternal();
+    sysTicks = readSysRange();
     tifrVal = *_tifr;
   }
+#endif
+
+  overflowTicks = compensateForUnprocessedOverflow(overflowTicks, sysTicks, tifrVal);
+}
+
+void ExtTimer::readTicksFromIsr(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks) const
+{
+  if (_dualSlope)
+  {
+    ticksExtraRange_t extraTicks;
+
+    readDualSlopeFromIsr(extraTicks, sysTicks);
+
+    overflowTicks = getOverflowTicksInternal() + extraTicks;
+    return;
+  }
+
+  if (_lazyOverflow)
+  {
+    readTicksLazyFromIsr(overflowTicks, sysTicks);
+    return;
+  }
+
+  // Interrupts are already off, so the overflow ticks and TOV flag can't change
+  overflowTicks = getOverflowTicksInternal();
+  sysTicks = readSysRange();
+  uint8_t tifrVal = *_tifr;
+
+  overflowTicks = compensateForUnprocessedOverflow(overflowTicks, sysTicks, tifrVal);
+}
 
-  return compensateForUnprocessedOverflow(overflowTicks, tifrVal);
+void ExtTimer::readExtendTicks(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks) const
+{
+  if (_dualSlope || _lazyOverflow)
+  {
+    readTicks(overflowTicks, sysTicks);
+    return;
+  }
+
+  uint8_t tifrVal;
+
+#if EXT_TIMER_LOCK_FREE_READS
+  // Leave interrupts on, and start over if an overflow was processed while reading
+  ticksExtraRange_t overflowTicksAfter;
+
+  do
+  {
+    overflowTicks = getOverflowTicksInternal();
+    tifrVal = *_tifr;
+    sysTicks = readSysRangeLockFree();
+    overflowTicksAfter = getOverflowTicksInternal();
+  }
+  while (overflowTicks != overflowTicksAfter);
+#else
+  // Prevent overflow ticks from incrementing and prevent TOV flag from clearing
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    overflowTicks = getOverflowTicksInternal();
+    tifrVal = *_tifr;
+    sysTicks = readSysRange();
+  }
+#endif
+
+  // See if there was an unprocessed overflow
+  if (hasUnprocessedOverflow(tifrVal))
+  {
+    overflowTicks = incrementOverflow(overflowTicks);
+  }
+}
+
+void ExtTimer::readExtendTicksFromIsr(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks) const
+{
+  if (_dualSlope || _lazyOverflow)
+  {
+    readTicksFromIsr(overflowTicks, sysTicks);
+    return;
+  }
+
+  overflowTicks = getOverflowTicksInternal();
+  uint8_t tifrVal = *_tifr;
+  sysTicks = readSysRange();
+
+  // See if there was an unprocessed overflow
+  if (hasUnprocessedOverflow(tifrVal))
+  {
+    overflowTicks = incrementOverflow(overflowTicks);
+  }
+}
+
+void ExtTimer::readDualSlopeFromIsr(ticksExtraRange_t &extraTicks, ticks16_t &sysTicks) const
+{
+  // Read the flags on both sides of TCNT, to catch TOP or BOTTOM while reading
+  uint8_t tifrBefore = *_tifr;
+  ticks16_t tcnt = readSysRange();
+  uint8_t tifrAfter = *_tifr;
+
+  if (tifrBefore & (1 << _wrapFlag))
+  {
+    // Passed BOTTOM, but the overflow hasn't been processed yet
+    extraTicks = _ticksPerOverflow;
+    sysTicks = tcnt;
+  }
+  else if (tifrAfter & (1 << _wrapFlag))
+  {
+    // Passed BOTTOM while reading. TCNT is near BOTTOM either way, so read
+    // it again now that it's on the way up
+    extraTicks = _ticksPerOverflow;
+    sysTicks = readSysRange();
+  }
+  else if ((tifrBefore ^ tifrAfter) & (1 << _topFlag))
+  {
+    // Reached TOP while reading
+    extraTicks = 0;
+    sysTicks = _top;
+  }
+  else if (tifrAfter & (1 << _topFlag))
+  {
+    // Counting down. Split 2 * TOP - TCNT so it fits in 16 bits
+    extraTicks = _top;
+    sysTicks = _top - tcnt;
+  }
+  else
+  {
+    // Counting up
+    extraTicks = 0;
+    sysTicks = tcnt;
+  }
+}
+
+void ExtTimer::readTicksLazyFromIsr(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks) const
+{
+  sysTicks = readSysRange();
+  updateLazyOverflow(sysTicks, *_tifr);
+  overflowTicks = _overflowTicks;
+}
+
+void ExtTimer::updateLazyOverflow(ticks16_t sysTicks, uint8_t tifrVal) const
+{
+  // TCNT going backwards means it wrapped since the last read. The TOV flag
+  // with TCNT in the bottom half means it wrapped a full period after a read
+  // in the bottom half. The TOV flag with TCNT in the top half means it
+  // wrapped just after TCNT was read, so leave that for the next read.
+  bool wrapped = sysTicks < _lastSysTicks
+    || (hasUnprocessedOverflow(tifrVal) && sysTicks < getTicksPerOverflow() / 2);
+
+  _lastSysTicks = sysTicks;
+
+  if (wrapped)
+  {
+    *_tifr = (1 << _wrapFlag);
+
+    addOverflow();
+  }
+}
+
+ticksExtraRange_t ExtTimer::combineFromIsr(ticks16_t sysTicks, uint8_t tifrVal) const
+{
+  if (_dualSlope)
+  {
+    // The direction can't be told from one read, so read again
+    return getFromIsr();
+  }
+
+  if (_lazyOverflow)
+  {
+    updateLazyOverflow(sysTicks, tifrVal);
+    return _overflowTicks + sysTicks;
+  }
+
+  return compensateForUnprocessedOverflow(getOverflowTicksInternal(), sysTicks, tifrVal) + sysTicks;
+}
+
+ticksExtraRange_t ExtTimer::compensateForUnprocessedOverflow(ticksExtraRange_t overflowTicks,
+    ticks16_t sysTicks, uint8_t tifrVal) const
+{
+  // Handle overflow only if the time overflowed recently
+  // and the overflow flag is set
+  if (hasUnprocessedOverflow(tifrVal) && sysTicks < getTicksPerOverflow() / 2)
+  {
+    return incrementOverflow(overflowTicks);
+  }
+  else
+  {
+    return overflowTicks;
+  }
+}
+
+void ExtTimer::readTicks64(ticksExtraRange64_t &overflowTicks, ticks16_t &sysTicks) const
+{
+  if (_dualSlope)
+  {
+    ticksExtraRange_t extraTicks;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      readDualSlopeFromIsr(extraTicks, sysTicks);
+      overflowTicks = getOverflowTicksInternal64();
+    }
+
+    overflowTicks += extraTicks;
+    return;
+  }
+
+  if (_lazyOverflow)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      sysTicks = readSysRange();
+      updateLazyOverflow(sysTicks, *_tifr);
+      overflowTicks = getOverflowTicksInternal64();
+    }
+
+    return;
+  }
+
+  uint8_t tifrVal;
+
+#if EXT_TIMER_LOCK_FREE_READS
+  // Leave interrupts on, and start over if an overflow was processed while reading
+  ticksExtraRange64_t overflowTicksAfter;
+
+  do
+  {
+    overflowTicks = getOverflowTicksInternal64();
+    sysTicks = readSysRangeLockFree();
+    tifrVal = *_tifr;
+    overflowTicksAfter = getOverflowTicksInternal64();
+  }
+  while (overflowTicks != overflowTicksAfter);
+#else
+  // Prevent overflow ticks from incrementing and prevent TOV flag from clearing
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    overflowTicks = getOverflowTicksInternal64();
+    sysTicks = readSysRange();
+    tifrVal = *_tifr;
+  }
+#endif
+
+  // Handle overflow only if the time overflowed recently
+  // and the overflow flag is set
+  if (hasUnprocessedOverflow(tifrVal) && sysTicks < getTicksPerOverflow() / 2)
+  {
+    overflowTicks += getTicksPerOverflow();
+  }
+}
+
+void ExtTimer::readExtendTicks64(ticksExtraRange64_t &overflowTicks, ticks16_t &sysTicks) const
+{
+  if (_dualSlope || _lazyOverflow)
+  {
+    readTicks64(overflowTicks, sysTicks);
+    return;
+  }
+
+  uint8_t tifrVal;
+
+#if EXT_TIMER_LOCK_FREE_READS
+  // Leave interrupts on, and start over if an overflow was processed while reading
+  ticksExtraRange64_t overflowTicksAfter;
+
+  do
+  {
+    overflowTicks = getOverflowTicksInternal64();
+    tifrVal = *_tifr;
+    sysTicks = readSysRangeLockFree();
+    overflowTicksAfter = getOverflowTicksInternal64();
+  }
+  while (overflowTicks != overflowTicksAfter);
+#else
+  // Prevent overflow ticks from incrementing and prevent TOV flag from clearing
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    overflowTicks = getOverflowTicksInternal64();
+    tifrVal = *_tifr;
+    sysTicks = readSysRange();
+  }
+#endif
+
+  if (hasUnprocessedOverflow(tifrVal))
+  {
+    overflowTicks += getTicksPerOverflow();
+  }
 }
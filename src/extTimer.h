@@ -21,6 +21,31 @@
 #include <avr/io.h>
 #include "timerUtil.h"
 
+#ifndef IMPLEMENT_TIMER0_OVERFLOW
+#define IMPLEMENT_TIMER0_OVERFLOW 0
+#endif
+
+#define USE_ARDUINO_TIMER0_OVERFLOW (!IMPLEMENT_TIMER0_OVERFLOW)
+
+#if USE_ARDUINO_TIMER0_OVERFLOW
+
+extern volatile unsigned long timer0_overflow_count;
+
+#endif
+
+// Read the extended time without disabling interrupts. Reads are retried
+// if the overflow interrupt runs in the middle of them, so interrupt latency
+// isn't affected by code that polls the time
+#ifndef EXT_TIMER_LOCK_FREE_READS
+#define EXT_TIMER_LOCK_FREE_READS 0
+#endif
+
+template <uint8_t timer>
+class ExtTimerT;
+
+struct ExtTimerSnapshot;
+class TimerAction;
+
 // Extend the range of 16-bit AVR timers
 class ExtTimer
 {
@@ -34,6 +59,25 @@ public:
   ExtTimer& operator=(ExtTimer &&) = delete;
   
   void configure(TimerClock clock = TimerClock::Clk);
+
+  // Extend a timer running in CTC or PWM mode. The ticks advance by TOP + 1
+  // per wrap in Fast PWM and CTC modes, and by 2 * TOP in the dual-slope
+  // PWM_PC and PWM_PFC modes, so they keep counting ticks of the clock. Set
+  // ICR or OCRA to TOP first. Resets the ticks when the period changes.
+  //
+  // CTC mode requires lazy overflow mode. Dual-slope modes require OCRA or
+  // ICR as TOP, and don't support lazy overflow mode. extend() and
+  // extendTimeInPast() only make sense in single-slope modes.
+  bool configure(TimerClock clock, TimerMode mode,
+    TimerResolution resolution = TimerResolution::NA);
+
+  // Change the clock while running. The timer is stopped for a few cycles,
+  // the extended ticks are rescaled into units of the new clock, and any
+  // pending TimerAction on this timer is moved to the same point in time.
+  // Returns false without changing anything while an action is pending for
+  // a chain, TimerSequence, PulseGen, ServoDriver, TimerScheduler or
+  // TimingWheel, since they keep ticks of their own
+  bool reconfigure(TimerClock clock);
   
   ticksExtraRange_t get() const;
   void set(ticksExtraRange_t ticks);
@@ -44,13 +88,40 @@ public:
 
   ticksExtraRange_t extendTimeInPast(ticks16_t ticks) const;
 
+  // Versions of get(), extend(), extendTimeInPast() and getSysRange() that
+  // skip disabling interrupts. Only call when interrupts are already
+  // disabled, such as from inside an ISR
+  ticksExtraRange_t getFromIsr() const;
+  ticksExtraRange_t extendFromIsr(ticks16_t ticks) const;
+  ticksExtraRange_t extendTimeInPastFromIsr(ticks16_t ticks) const;
+  ticks16_t getSysRangeFromIsr() const;
+
+  // 64-bit versions of get(), extend() and extendTimeInPast(). These don't
+  // wrap for thousands of years, even at the speed of the system clock
+  ticksExtraRange64_t get64() const;
+  ticksExtraRange64_t extend64(ticks16_t ticks) const;
+  ticksExtraRange64_t extendTimeInPast64(ticks16_t ticks) const;
+
+  // Clock cycles since the ticks were last set. Unlike the ticks, this
+  // doesn't change units when reconfigure() changes the clock
+  ticksExtraRange64_t getClockCycles64() const;
+
   ticks16_t getSysRange() const;
   uint16_t getMaxSysTicks() const;
 
+  // Lazy overflow mode turns off the overflow interrupt. Instead, each read
+  // counts a wrap when TCNT is below the last value read, or when the TOV
+  // flag is set. Only valid if the time is read at least once per wrap, such
+  // as from a low-rate compare interrupt. Overflow callbacks aren't called
+  // in this mode. Returns false for ExtTimer0 when Arduino owns its overflow
+  bool setLazyOverflowEnabled(bool enabled);
+  bool getLazyOverflowEnabled() const;
+
   uint32_t getOverflowCount() const;
   void resetOverflowCount();
 
   ticksExtraRange_t getOverflowTicks() const;
+  ticksExtraRange64_t getOverflowTicks64() const;
 
   int getTimer() const;
   volatile uint8_t *getTIMSK() const;
@@ -63,13 +134,61 @@ public:
   void setOverflowCallback(OverflowCallback cb);
 
 private:
+  template <uint8_t timer>
+  friend class ExtTimerT;
+
+  friend ExtTimerSnapshot takeExtTimerSnapshot();
+  friend class TimerAction;
+
+  // Set the ticks without disabling interrupts
+  void setFromIsr(ticksExtraRange64_t ticks);
+  void setCustomPeriodFromIsr(ticksExtraRange64_t ticks);
+  void writeSysRange(ticks16_t sysTicks);
+
+  // Remember that action needs to be rescaled on reconfigure(). Only
+  // takes the lock the first time for each action
+  void addAction(TimerAction *action);
+
   bool hasUnprocessedOverflow(uint8_t tifrVal) const;
-  ticksExtraRange_t compensateForUnprocessedOverflow(ticksExtraRange_t ticks, uint8_t tifrVal) const;
+  ticks16_t readSysRange() const;
+  ticks16_t readSysRangeLockFree() const;
+
+  // Read the overflow ticks and TCNT as a consistent pair. Any overflow
+  // that hasn't been processed yet is included in overflowTicks
+  void readTicks(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks) const;
+  void readTicks64(ticksExtraRange64_t &overflowTicks, ticks16_t &sysTicks) const;
+  void readTicksFromIsr(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks) const;
+  void readTicksLazyFromIsr(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks) const;
+
+  // Like readTicks(), but the way extend() and getOverflowTicks() have
+  // always read: TOV before TCNT, and a flagged overflow always counted
+  void readExtendTicks(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks) const;
+  void readExtendTicks64(ticksExtraRange64_t &overflowTicks, ticks16_t &sysTicks) const;
+  void readExtendTicksFromIsr(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks) const;
+  void readDualSlopeFromIsr(ticksExtraRange_t &extraTicks, ticks16_t &sysTicks) const;
+  void updateLazyOverflow(ticks16_t sysTicks, uint8_t tifrVal) const;
+  void addOverflow() const;
+
+  // Combine a TCNT and TIFR read with the overflow ticks. Interrupts must be disabled
+  ticksExtraRange_t combineFromIsr(ticks16_t sysTicks, uint8_t tifrVal) const;
+  ticksExtraRange_t compensateForUnprocessedOverflow(ticksExtraRange_t overflowTicks,
+    ticks16_t sysTicks, uint8_t tifrVal) const;
+
+  ticksExtraRange_t extend(ticks16_t ticks, ticksExtraRange_t overflowTicks, ticks16_t sysTicks) const;
+  ticksExtraRange_t extendTimeInPast(ticks16_t ticks, ticksExtraRange_t overflowTicks,
+    ticks16_t sysTicks) const;
+
   ticksExtraRange_t getOverflowTicksInternal() const;
+  ticksExtraRange64_t getOverflowTicksInternal64() const;
+  ticksExtraRange_t getTicksPerOverflow() const;
   ticksExtraRange_t incrementOverflow(ticksExtraRange_t ticks) const;
   ticksExtraRange_t decrementOverflow(ticksExtraRange_t ticks) const;
 
-  volatile ticksExtraRange_t _overflowTicks = 0;
+  // Mutable since reads count wraps in lazy overflow mode
+  mutable volatile ticksExtraRange_t _overflowTicks = 0;
+
+  // Upper 32 bits of the 64-bit overflow ticks. Incremented when _overflowTicks wraps
+  mutable volatile uint32_t _overflowTicksHigh = 0;
 
   volatile uint8_t *_tcntl;
   volatile uint8_t *_tcnth;
@@ -83,6 +202,35 @@ private:
   int _timer;
 
   OverflowCallback _overflowCallback = nullptr;
+
+  // Ticks added per wrap, and the flag that marks a wrap. TOV and TOP + 1
+  // in Normal and Fast PWM modes, the TOP compare flag and TOP + 1 in CTC
+  // mode, and TOV and 2 * TOP in dual-slope modes
+  ticksExtraRange_t _ticksPerOverflow;
+  uint8_t _wrapFlag;
+
+  // Set in dual-slope modes while counting down from TOP
+  uint8_t _topFlag = 0;
+  ticks16_t _top = 0;
+  bool _dualSlope = false;
+
+  // Not in Normal mode, so ExtTimerT can't use its compile-time period
+  bool _customPeriod = false;
+
+  // Overflow interrupt can't take the fast path
+  volatile bool _slowOverflow = false;
+
+  bool _lazyOverflow = false;
+
+  // TCNT as of the last read, for lazy overflow mode
+  mutable ticks16_t _lastSysTicks = 0;
+
+  // Ticks and clock cycles as of the last clock change, for getClockCycles64()
+  ticksExtraRange64_t _ticksAtClockChange = 0;
+  ticksExtraRange64_t _clockCyclesAtClockChange = 0;
+
+  // TimerActions that have been scheduled on this timer
+  TimerAction *_actions = nullptr;
 };
 
 #ifdef TCNT0
@@ -0,0 +1,226 @@
+// Extended Range AVR Timer Snapshot
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "extTimerSnapshot.h"
+
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "timerUtil.h"
+
+namespace {
+
+// The counter reads below compile to one instruction per byte, in order:
+//
+//   in  TCNT0    1 cycle   (TCNT0 is in the I/O space on every ATmega)
+//   lds TCNT1L   2 cycles  (reading the low byte latches the high byte)
+//   lds TCNT1H   2 cycles
+//   lds TCNT2    2 cycles
+//   lds TCNT3L   2 cycles ...
+//
+// An I/O read samples the counter in the instruction's last cycle, so the
+// gap between two samples is the instructions after the first sample, up
+// to and including the one that takes the second. Every read after TCNT0
+// is an lds, so an 8-bit counter is sampled one lds before the next, and a
+// 16-bit counter two. TCNT0's own 1-cycle in doesn't add to any gap
+constexpr uint8_t LdsCycles = 2;
+constexpr uint8_t ReadCycles8Bit = LdsCycles;
+constexpr uint8_t ReadCycles16Bit = 2 * LdsCycles;
+
+// Remove the ticks that elapsed between the first counter read and this one
+ticksExtraRange_t correctReadOffset(ticksExtraRange_t ticks, uint8_t timer, uint8_t offsetCycles)
+{
+  int cyclesPerTick = clockCyclesPerTick(getTimerClock(timer));
+
+  if (0 == cyclesPerTick)
+  {
+    // Timer is stopped
+    return ticks;
+  }
+
+  // Round to the nearest tick
+  return ticks - (offsetCycles + cyclesPerTick / 2) / cyclesPerTick;
+}
+
+} // namespace
+
+ticksExtraRange_t ExtTimerSnapshot::get(uint8_t timer) const
+{
+  switch (timer)
+  {
+#ifdef HAVE_TCNT0
+    case TIMER0:
+      return timer0;
+#endif
+#ifdef HAVE_TCNT1
+    case TIMER1:
+      return timer1;
+#endif
+#ifdef HAVE_TCNT2
+    case TIMER2:
+      return timer2;
+#endif
+#ifdef HAVE_TCNT3
+    case TIMER3:
+      return timer3;
+#endif
+#ifdef HAVE_TCNT4
+    case TIMER4:
+      return timer4;
+#endif
+#ifdef HAVE_TCNT5
+    case TIMER5:
+      return timer5;
+#endif
+    default:
+      return 0;
+  }
+}
+
+ExtTimerSnapshot takeExtTimerSnapshot()
+{
+  ExtTimerSnapshot snapshot;
+
+#ifdef HAVE_TCNT0
+  // 8-bit counters are read into 8 bits, so zero extending doesn't get
+  // scheduled between the reads
+  ticks8_t sys0;
+  uint8_t tifr0;
+  ticksExtraRange_t ticks0;
+#endif
+#ifdef HAVE_TCNT1
+  ticks16_t sys1;
+  uint8_t tifr1;
+  ticksExtraRange_t ticks1;
+#endif
+#ifdef HAVE_TCNT2
+  ticks8_t sys2;
+  uint8_t tifr2;
+  ticksExtraRange_t ticks2;
+#endif
+#ifdef HAVE_TCNT3
+  ticks16_t sys3;
+  uint8_t tifr3;
+  ticksExtraRange_t ticks3;
+#endif
+#ifdef HAVE_TCNT4
+  ticks16_t sys4;
+  uint8_t tifr4;
+  ticksExtraRange_t ticks4;
+#endif
+#ifdef HAVE_TCNT5
+  ticks16_t sys5;
+  uint8_t tifr5;
+  ticksExtraRange_t ticks5;
+#endif
+
+  // Keep the overflow ticks and TOV flags from changing, and keep anything
+  // else from using the 16-bit temp register
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    // Read the counters first and back to back, so they're as close together as possible
+#ifdef HAVE_TCNT0
+    sys0 = TCNT0;
+#endif
+#ifdef HAVE_TCNT1
+    sys1 = TCNT1;
+#endif
+#ifdef HAVE_TCNT2
+    sys2 = TCNT2;
+#endif
+#ifdef HAVE_TCNT3
+    sys3 = TCNT3;
+#endif
+#ifdef HAVE_TCNT4
+    sys4 = TCNT4;
+#endif
+#ifdef HAVE_TCNT5
+    sys5 = TCNT5;
+#endif
+
+    // Then the overflow flags, so that an overflow just after a counter read
+    // is still recognizable as such
+#ifdef HAVE_TCNT0
+    tifr0 = TIFR0;
+#endif
+#ifdef HAVE_TCNT1
+    tifr1 = TIFR1;
+#endif
+#ifdef HAVE_TCNT2
+    tifr2 = TIFR2;
+#endif
+#ifdef HAVE_TCNT3
+    tifr3 = TIFR3;
+#endif
+#ifdef HAVE_TCNT4
+    tifr4 = TIFR4;
+#endif
+#ifdef HAVE_TCNT5
+    tifr5 = TIFR5;
+#endif
+
+#ifdef HAVE_TCNT0
+    ticks0 = ExtTimer0.combineFromIsr(sys0, tifr0);
+#endif
+#ifdef HAVE_TCNT1
+    ticks1 = ExtTimer1.combineFromIsr(sys1, tifr1);
+#endif
+#ifdef HAVE_TCNT2
+    ticks2 = ExtTimer2.combineFromIsr(sys2, tifr2);
+#endif
+#ifdef HAVE_TCNT3
+    ticks3 = ExtTimer3.combineFromIsr(sys3, tifr3);
+#endif
+#ifdef HAVE_TCNT4
+    ticks4 = ExtTimer4.combineFromIsr(sys4, tifr4);
+#endif
+#ifdef HAVE_TCNT5
+    ticks5 = ExtTimer5.combineFromIsr(sys5, tifr5);
+#endif
+  }
+
+  // Cycles between the first counter read and the current one
+  uint8_t offsetCycles = 0;
+
+#ifdef HAVE_TCNT0
+  snapshot.timer0 = correctReadOffset(ticks0, TIMER0, offsetCycles);
+  offsetCycles += ReadCycles8Bit;
+#endif
+#ifdef HAVE_TCNT1
+  snapshot.timer1 = correctReadOffset(ticks1, TIMER1, offsetCycles);
+  offsetCycles += ReadCycles16Bit;
+#endif
+#ifdef HAVE_TCNT2
+  snapshot.timer2 = correctReadOffset(ticks2, TIMER2, offsetCycles);
+  offsetCycles += ReadCycles8Bit;
+#endif
+#ifdef HAVE_TCNT3
+  snapshot.timer3 = correctReadOffset(ticks3, TIMER3, offsetCycles);
+  offsetCycles += ReadCycles16Bit;
+#endif
+#ifdef HAVE_TCNT4
+  snapshot.timer4 = correctReadOffset(ticks4, TIMER4, offsetCycles);
+  offsetCycles += ReadCycles16Bit;
+#endif
+#ifdef HAVE_TCNT5
+  snapshot.timer5 = correctReadOffset(ticks5, TIMER5, offsetCycles);
+  offsetCycles += ReadCycles16Bit;
+#endif
+
+  (void)offsetCycles;
+
+  return snapshot;
+}
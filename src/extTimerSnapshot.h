@@ -0,0 +1,55 @@
+// Extended Range AVR Timer Snapshot
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TIMER_EXT_EXT_TIMER_SNAPSHOT_H_
+#define TIMER_EXT_EXT_TIMER_SNAPSHOT_H_
+
+#include "extTimer.h"
+#include "timerTypes.h"
+
+// Extended ticks of every ExtTimer, as of the same instant
+struct ExtTimerSnapshot
+{
+#ifdef HAVE_TCNT0
+  ticksExtraRange_t timer0;
+#endif
+#ifdef HAVE_TCNT1
+  ticksExtraRange_t timer1;
+#endif
+#ifdef HAVE_TCNT2
+  ticksExtraRange_t timer2;
+#endif
+#ifdef HAVE_TCNT3
+  ticksExtraRange_t timer3;
+#endif
+#ifdef HAVE_TCNT4
+  ticksExtraRange_t timer4;
+#endif
+#ifdef HAVE_TCNT5
+  ticksExtraRange_t timer5;
+#endif
+
+  // Ticks of the given timer (TIMER1, TIMER2, etc.), or 0 if there's no such timer
+  ticksExtraRange_t get(uint8_t timer) const;
+};
+
+// Read all of the ExtTimers in a single critical section. The counters are
+// read back to back, and each value is corrected by the number of clock
+// cycles between the first counter read and its own, so the values line
+// up as if they were all read at once
+ExtTimerSnapshot takeExtTimerSnapshot();
+
+#endif // TIMER_EXT_EXT_TIMER_SNAPSHOT_H_
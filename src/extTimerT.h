@@ -0,0 +1,561 @@
+// Compile-time Extended Range AVR Timer
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TIMER_EXT_EXT_TIMER_T_H_
+#define TIMER_EXT_EXT_TIMER_T_H_
+
+#include "extTimer.h"
+
+#include <avr/io.h>
+#include <util/atomic.h>
+
+// Use hand-written overflow ISRs that only save two registers and touch
+// two bytes in the common case
+#ifndef EXT_TIMER_FAST_OVERFLOW_ISR
+#define EXT_TIMER_FAST_OVERFLOW_ISR 1
+#endif
+
+#ifdef __AVR_HAVE_RAMPZ__
+#define EXT_TIMER_PUSH_RAMPZ "in r0, __RAMPZ__\n\t" "push r0\n\t"
+#define EXT_TIMER_POP_RAMPZ "pop r0\n\t" "out __RAMPZ__, r0\n\t"
+#else
+#define EXT_TIMER_PUSH_RAMPZ
+#define EXT_TIMER_POP_RAMPZ
+#endif
+
+// Registers and width of each timer, known at compile time
+template <uint8_t timer>
+struct ExtTimerTraits;
+
+#ifdef HAVE_TCNT0
+template <>
+struct ExtTimerTraits<TIMER0>
+{
+  static constexpr bool is16Bit = false;
+  static constexpr uint8_t tov = TOV0;
+  static ticks16_t readTCNT() { return TCNT0; }
+  static volatile uint8_t &tifr() { return TIFR0; }
+  static constexpr ExtTimer &extTimer() { return ExtTimer0; }
+};
+#endif // HAVE_TCNT0
+
+#ifdef HAVE_TCNT1
+template <>
+struct ExtTimerTraits<TIMER1>
+{
+  static constexpr bool is16Bit = true;
+  static constexpr uint8_t tov = TOV1;
+  static ticks16_t readTCNT() { return TCNT1; }
+  static volatile uint8_t &tifr() { return TIFR1; }
+  static constexpr ExtTimer &extTimer() { return ExtTimer1; }
+};
+#endif // HAVE_TCNT1
+
+#ifdef HAVE_TCNT2
+template <>
+struct ExtTimerTraits<TIMER2>
+{
+  static constexpr bool is16Bit = false;
+  static constexpr uint8_t tov = TOV2;
+  static ticks16_t readTCNT() { return TCNT2; }
+  static volatile uint8_t &tifr() { return TIFR2; }
+  static constexpr ExtTimer &extTimer() { return ExtTimer2; }
+};
+#endif // HAVE_TCNT2
+
+#ifdef HAVE_TCNT3
+template <>
+struct ExtTimerTraits<TIMER3>
+{
+  static constexpr bool is16Bit = true;
+  static constexpr uint8_t tov = TOV3;
+  static ticks16_t readTCNT() { return TCNT3; }
+  static volatile uint8_t &tifr() { return TIFR3; }
+  static constexpr ExtTimer &extTimer() { return ExtTimer3; }
+};
+#endif // HAVE_TCNT3
+
+#ifdef HAVE_TCNT4
+template <>
+struct ExtTimerTraits<TIMER4>
+{
+  static constexpr bool is16Bit = true;
+  static constexpr uint8_t tov = TOV4;
+  static ticks16_t readTCNT() { return TCNT4; }
+  static volatile uint8_t &tifr() { return TIFR4; }
+  static constexpr ExtTimer &extTimer() { return ExtTimer4; }
+};
+#endif // HAVE_TCNT4
+
+#ifdef HAVE_TCNT5
+template <>
+struct ExtTimerTraits<TIMER5>
+{
+  static constexpr bool is16Bit = true;
+  static constexpr uint8_t tov = TOV5;
+  static ticks16_t readTCNT() { return TCNT5; }
+  static volatile uint8_t &tifr() { return TIFR5; }
+  static constexpr ExtTimer &extTimer() { return ExtTimer5; }
+};
+#endif // HAVE_TCNT5
+
+// Compile-time version of ExtTimer. Register addresses and timer width
+// are constants, so reads and the overflow ISR compile down to direct
+// loads and stores with no pointer loads or width checks.
+//
+// Shares its state with the matching ExtTimer instance (ExtTimerT<TIMER1>
+// with ExtTimer1, etc.), so the two can be used interchangeably.
+template <uint8_t timer>
+class ExtTimerT
+{
+public:
+  typedef ExtTimerTraits<timer> Traits;
+
+  static constexpr ticksExtraRange_t ticksPerOverflow = Traits::is16Bit ? (1UL << 16) : (1UL << 8);
+  static constexpr uint16_t maxSysTicks = Traits::is16Bit ? UINT16_MAX : UINT8_MAX;
+
+  ExtTimerT() = delete;
+
+  static ExtTimer &getExtTimer()
+  {
+    return Traits::extTimer();
+  }
+
+  static ticksExtraRange_t get()
+  {
+    ticksExtraRange_t ovfTicks;
+    ticks16_t sys;
+
+    readTicks(ovfTicks, sys);
+
+    return ovfTicks + sys;
+  }
+
+  // Extend the range of the passed-in ticks
+  // Assumes that ticks is in the future
+  static ticksExtraRange_t extend(ticks16_t ticks)
+  {
+    ticksExtraRange_t overflowTicks;
+    ticks16_t sysTicks;
+
+    readExtendTicks(overflowTicks, sysTicks);
+
+    return extend(ticks, overflowTicks, sysTicks);
+  }
+
+  static ticksExtraRange_t extendTimeInPast(ticks16_t ticks)
+  {
+    ticksExtraRange_t overflowTicks;
+    ticks16_t sysTicks;
+
+    readExtendTicks(overflowTicks, sysTicks);
+
+    return extendTimeInPast(ticks, overflowTicks, sysTicks);
+  }
+
+  // Versions of get(), extend(), extendTimeInPast() and getSysRange() that
+  // skip disabling interrupts. Only call when interrupts are already
+  // disabled, such as from inside an ISR
+  static ticksExtraRange_t getFromIsr()
+  {
+    ticksExtraRange_t ovfTicks;
+    ticks16_t sys;
+
+    readTicksFromIsr(ovfTicks, sys);
+
+    return ovfTicks + sys;
+  }
+
+  static ticksExtraRange_t extendFromIsr(ticks16_t ticks)
+  {
+    ticksExtraRange_t overflowTicks;
+    ticks16_t sysTicks;
+
+    readExtendTicksFromIsr(overflowTicks, sysTicks);
+
+    return extend(ticks, overflowTicks, sysTicks);
+  }
+
+  static ticksExtraRange_t extendTimeInPastFromIsr(ticks16_t ticks)
+  {
+    ticksExtraRange_t overflowTicks;
+    ticks16_t sysTicks;
+
+    readExtendTicksFromIsr(overflowTicks, sysTicks);
+
+    return extendTimeInPast(ticks, overflowTicks, sysTicks);
+  }
+
+  static ticks16_t getSysRangeFromIsr()
+  {
+    return Traits::readTCNT();
+  }
+
+  static ticks16_t getSysRange()
+  {
+#if EXT_TIMER_LOCK_FREE_READS
+    return readSysRangeLockFree();
+#else
+    if (!Traits::is16Bit)
+    {
+      return Traits::readTCNT();
+    }
+
+    ticks16_t sys;
+
+    // Ensure there's no race with someone trying to use the temp register
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      sys = Traits::readTCNT();
+    }
+
+    return sys;
+#endif
+  }
+
+  static ticksExtraRange_t getOverflowTicks()
+  {
+    ticksExtraRange_t overflowTicks;
+    ticks16_t sysTicks;
+
+    readExtendTicks(overflowTicks, sysTicks);
+
+    return overflowTicks;
+  }
+
+  // Call from the overflow ISR
+  static void processOverflow()
+  {
+    ExtTimer &extTimer = Traits::extTimer();
+
+    if (extTimer._customPeriod)
+    {
+      extTimer.processOverflow();
+      return;
+    }
+
+    ticksExtraRange_t overflowTicks = extTimer._overflowTicks + ticksPerOverflow;
+
+    extTimer._overflowTicks = overflowTicks;
+
+    // Carry into the upper 32 bits when the lower 32 bits wrap
+    if (0 == overflowTicks)
+    {
+      extTimer._overflowTicksHigh = extTimer._overflowTicksHigh + 1;
+    }
+
+    ExtTimer::OverflowCallback cb = extTimer._overflowCallback;
+
+    if (cb)
+    {
+      cb();
+    }
+  }
+
+  // Body of a naked overflow ISR. Use like this:
+  //
+  // ISR(TIMER1_OVF_vect, ISR_NAKED)
+  // {
+  //   ExtTimerT<TIMER1>::fastOverflowIsr();
+  // }
+  //
+  // Only increments the two bytes of the overflow ticks that change on
+  // nearly every overflow. A carry out of those bytes, a registered
+  // overflow callback, or a non-Normal mode is handed off to processOverflow().
+  __attribute__((always_inline))
+  static inline void fastOverflowIsr()
+  {
+    asm volatile(
+      "push r24"                "\n\t"
+      "in r24, __SREG__"        "\n\t"
+      "push r24"                "\n\t"
+      "push r25"                "\n\t"
+
+      // Take the slow path if there's a callback or a custom period
+      "lds r24, %[flag]"        "\n\t"
+      "tst r24"                 "\n\t"
+      "brne 1f"                 "\n\t"
+
+      // Increment the overflow ticks, and take the slow path on carry
+      "lds r24, %[ovf]+%[byte]" "\n\t"
+      "lds r25, %[ovf]+%[byte]+1""\n\t"
+      "adiw r24, 1"             "\n\t"
+      "breq 1f"                 "\n\t"
+      "sts %[ovf]+%[byte]+1, r25""\n\t"
+      "sts %[ovf]+%[byte], r24" "\n\t"
+      "rjmp 2f"                 "\n\t"
+
+      // Slow path: save the rest of the call-clobbered registers and
+      // call processOverflow()
+    "1:"                        "\n\t"
+      "push r0"                 "\n\t"
+      EXT_TIMER_PUSH_RAMPZ
+      "push r1"                 "\n\t"
+      "clr __zero_reg__"        "\n\t"
+      "push r18"                "\n\t"
+      "push r19"                "\n\t"
+      "push r20"                "\n\t"
+      "push r21"                "\n\t"
+      "push r22"                "\n\t"
+      "push r23"                "\n\t"
+      "push r26"                "\n\t"
+      "push r27"                "\n\t"
+      "push r30"                "\n\t"
+      "push r31"                "\n\t"
+      "ldi r30, lo8(%[slow])"   "\n\t"
+      "ldi r31, hi8(%[slow])"   "\n\t"
+      "icall"                   "\n\t"
+      "pop r31"                 "\n\t"
+      "pop r30"                 "\n\t"
+      "pop r27"                 "\n\t"
+      "pop r26"                 "\n\t"
+      "pop r23"                 "\n\t"
+      "pop r22"                 "\n\t"
+      "pop r21"                 "\n\t"
+      "pop r20"                 "\n\t"
+      "pop r19"                 "\n\t"
+      "pop r18"                 "\n\t"
+      "pop r1"                  "\n\t"
+      EXT_TIMER_POP_RAMPZ
+      "pop r0"                  "\n\t"
+
+    "2:"                        "\n\t"
+      "pop r25"                 "\n\t"
+      "pop r24"                 "\n\t"
+      "out __SREG__, r24"       "\n\t"
+      "pop r24"                 "\n\t"
+      "reti"                    "\n\t"
+      :
+      : [flag] "i" (&Traits::extTimer()._slowOverflow),
+        [ovf] "i" (&Traits::extTimer()._overflowTicks),
+        // The lowest byte that changes: byte 2 for 16-bit timers, byte 1 for 8-bit timers
+        [byte] "n" (Traits::is16Bit ? 2 : 1),
+        [slow] "i" (&processOverflow)
+    );
+  }
+
+private:
+  // Lazy overflow mode and non-Normal modes don't match the compile-time
+  // assumptions, so hand those off to ExtTimer
+  static bool usesRuntimeReads()
+  {
+    return Traits::extTimer()._lazyOverflow || Traits::extTimer()._customPeriod;
+  }
+
+  static bool hasUnprocessedOverflow(uint8_t tifrVal)
+  {
+    return tifrVal & (1 << Traits::tov);
+  }
+
+  static ticksExtraRange_t extend(ticks16_t ticks, ticksExtraRange_t overflowTicks, ticks16_t sysTicks)
+  {
+    ticksExtraRange_t extTicks = ticks + overflowTicks;
+
+    // Add another overflow if the ticks is before tcnt.
+    if (ticks < sysTicks)
+    {
+      extTicks += ticksPerOverflow;
+    }
+
+    return extTicks;
+  }
+
+  static ticksExtraRange_t extendTimeInPast(ticks16_t ticks, ticksExtraRange_t overflowTicks,
+      ticks16_t sysTicks)
+  {
+    ticksExtraRange_t extTicks = ticks + overflowTicks;
+
+    // Subtract another overflow if the ticks is after tcnt.
+    if (sysTicks <= ticks)
+    {
+      extTicks -= ticksPerOverflow;
+    }
+
+    return extTicks;
+  }
+
+  static ticks16_t readSysRangeLockFree()
+  {
+    ticks16_t sys = Traits::readTCNT();
+
+    if (!Traits::is16Bit)
+    {
+      return sys;
+    }
+
+    // An interrupt that accesses one of this timer's 16-bit registers between
+    // the low and high byte reads will corrupt the high byte, so keep reading
+    // until two reads in a row agree
+    while (true)
+    {
+      ticks16_t sysAfter = Traits::readTCNT();
+
+      if ((sys >> 8) == (sysAfter >> 8) && sys <= sysAfter)
+      {
+        return sysAfter;
+      }
+
+      sys = sysAfter;
+    }
+  }
+
+  // Read the overflow ticks and TCNT as a consistent pair. Any overflow
+  // that hasn't been processed yet is included in overflowTicks
+  static void readTicks(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks)
+  {
+    if (usesRuntimeReads())
+    {
+      Traits::extTimer().readTicks(overflowTicks, sysTicks);
+      return;
+    }
+
+    uint8_t tifrVal;
+
+#if EXT_TIMER_LOCK_FREE_READS
+    // Leave interrupts on, and start over if an overflow was processed while reading
+    ticksExtraRange_t overflowTicksAfter;
+
+    do
+    {
+      overflowTicks = getOverflowTicksInternal();
+      sysTicks = readSysRangeLockFree();
+      tifrVal = Traits::tifr();
+      overflowTicksAfter = getOverflowTicksInternal();
+    }
+    while (overflowTicks != overflowTicksAfter);
+#else
+    // Prevent overflow ticks from incrementing and prevent TOV flag from clearing
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      overflowTicks = getOverflowTicksInternal();
+      sysTicks = Traits::readTCNT();
+      tifrVal = Traits::tifr();
+    }
+#endif
+
+    overflowTicks = compensateForUnprocessedOverflow(overflowTicks, sysTicks, tifrVal);
+  }
+
+  static void readTicksFromIsr(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks)
+  {
+    if (usesRuntimeReads())
+    {
+      Traits::extTimer().readTicksFromIsr(overflowTicks, sysTicks);
+      return;
+    }
+
+    // Interrupts are already off, so the overflow ticks and TOV flag can't change
+    overflowTicks = getOverflowTicksInternal();
+    sysTicks = Traits::readTCNT();
+    uint8_t tifrVal = Traits::tifr();
+
+    overflowTicks = compensateForUnprocessedOverflow(overflowTicks, sysTicks, tifrVal);
+  }
+
+  // Read TOV before TCNT, and always count a flagged overflow, the way
+  // extend() and getOverflowTicks() have always read
+  static void readExtendTicks(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks)
+  {
+    if (usesRuntimeReads())
+    {
+      Traits::extTimer().readExtendTicks(overflowTicks, sysTicks);
+      return;
+    }
+
+    uint8_t tifrVal;
+
+#if EXT_TIMER_LOCK_FREE_READS
+    // Leave interrupts on, and start over if an overflow was processed while reading
+    ticksExtraRange_t overflowTicksAfter;
+
+    do
+    {
+      overflowTicks = getOverflowTicksInternal();
+      tifrVal = Traits::tifr();
+      sysTicks = readSysRangeLockFree();
+      overflowTicksAfter = getOverflowTicksInternal();
+    }
+    while (overflowTicks != overflowTicksAfter);
+#else
+    // Prevent overflow ticks from incrementing and prevent TOV flag from clearing
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      overflowTicks = getOverflowTicksInternal();
+      tifrVal = Traits::tifr();
+      sysTicks = Traits::readTCNT();
+    }
+#endif
+
+    if (hasUnprocessedOverflow(tifrVal))
+    {
+      overflowTicks += ticksPerOverflow;
+    }
+  }
+
+  static void readExtendTicksFromIsr(ticksExtraRange_t &overflowTicks, ticks16_t &sysTicks)
+  {
+    if (usesRuntimeReads())
+    {
+      Traits::extTimer().readExtendTicksFromIsr(overflowTicks, sysTicks);
+      return;
+    }
+
+    overflowTicks = getOverflowTicksInternal();
+    uint8_t tifrVal = Traits::tifr();
+    sysTicks = Traits::readTCNT();
+
+    if (hasUnprocessedOverflow(tifrVal))
+    {
+      overflowTicks += ticksPerOverflow;
+    }
+  }
+
+  static ticksExtraRange_t compensateForUnprocessedOverflow(ticksExtraRange_t overflowTicks,
+      ticks16_t sysTicks, uint8_t tifrVal)
+  {
+    // Handle overflow only if the time overflowed recently
+    // and the overflow flag is set
+    if (hasUnprocessedOverflow(tifrVal) && sysTicks < ticksPerOverflow / 2)
+    {
+      return overflowTicks + ticksPerOverflow;
+    }
+    else
+    {
+      return overflowTicks;
+    }
+  }
+
+  static ticksExtraRange_t getOverflowTicksInternal()
+  {
+    // Use the Arduino overflow variable if defined
+#if USE_ARDUINO_TIMER0_OVERFLOW
+    if (TIMER0 == timer)
+    {
+      return timer0_overflow_count << 8;
+    }
+#endif
+
+    return Traits::extTimer()._overflowTicks;
+  }
+};
+
+template <uint8_t timer>
+constexpr ticksExtraRange_t ExtTimerT<timer>::ticksPerOverflow;
+
+template <uint8_t timer>
+constexpr uint16_t ExtTimerT<timer>::maxSysTicks;
+
+#endif // TIMER_EXT_EXT_TIMER_T_H_
@@ -17,7 +17,7 @@
 #ifndef TIMER_EXT_EXT_TIMER0_H_
 #define TIMER_EXT_EXT_TIMER0_H_
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #include<avr/interrupt.h>
 
@@ -27,13 +27,24 @@ ExtTimer ExtTimer0(&TCNT0, nullptr, &TIMSK0, TOIE0, &TIFR0, TOV0, TIMER0);
 
 #if defined(IMPLEMENT_TIMER0_OVERFLOW) && IMPLEMENT_TIMER0_OVERFLOW
 
+#if EXT_TIMER_FAST_OVERFLOW_ISR
+
+ISR(TIMER0_OVF_vect, ISR_NAKED)
+{
+  ExtTimerT<TIMER0>::fastOverflowIsr();
+}
+
+#else
+
 ISR(TIMER0_OVF_vect)
 {
-  ExtTimer0.processOverflow();
+  ExtTimerT<TIMER0>::processOverflow();
 }
 
 #endif
 
+#endif
+
 #endif // HAVE_TCNT0
 
 #endif // TIMER_EXT_EXT_TIMER0_H_
\ No newline at end of file
@@ -17,7 +17,7 @@
 #ifndef TIMER_EXT_EXT_TIMER1_H_
 #define TIMER_EXT_EXT_TIMER1_H_
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #include<avr/interrupt.h>
 
@@ -25,11 +25,22 @@
 
 ExtTimer ExtTimer1(&TCNT1L, &TCNT1H, &TIMSK1, TOIE1, &TIFR1, TOV1, TIMER1);
 
+#if EXT_TIMER_FAST_OVERFLOW_ISR
+
+ISR(TIMER1_OVF_vect, ISR_NAKED)
+{
+  ExtTimerT<TIMER1>::fastOverflowIsr();
+}
+
+#else
+
 ISR(TIMER1_OVF_vect)
 {
-  ExtTimer1.processOverflow();
+  ExtTimerT<TIMER1>::processOverflow();
 }
 
+#endif
+
 #endif // HAVE_TCNT1
 
 #endif // TIMER_EXT_EXT_TIMER1_H_
\ No newline at end of file
@@ -17,7 +17,7 @@
 #ifndef TIMER_EXT_EXT_TIMER2_H_
 #define TIMER_EXT_EXT_TIMER2_H_
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #include<avr/interrupt.h>
 
@@ -25,11 +25,22 @@
 
 ExtTimer ExtTimer2(&TCNT2, nullptr, &TIMSK2, TOIE2, &TIFR2, TOV2, TIMER2);
 
+#if EXT_TIMER_FAST_OVERFLOW_ISR
+
+ISR(TIMER2_OVF_vect, ISR_NAKED)
+{
+  ExtTimerT<TIMER2>::fastOverflowIsr();
+}
+
+#else
+
 ISR(TIMER2_OVF_vect)
 {
-  ExtTimer2.processOverflow();
+  ExtTimerT<TIMER2>::processOverflow();
 }
 
+#endif
+
 #endif // HAVE_TCNT2
 
 #endif // TIMER_EXT_EXT_TIMER2_H_
\ No newline at end of file
@@ -17,7 +17,7 @@
 #ifndef TIMER_EXT_EXT_TIMER3_H_
 #define TIMER_EXT_EXT_TIMER3_H_
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #include<avr/interrupt.h>
 
@@ -25,11 +25,22 @@
 
 ExtTimer ExtTimer3(&TCNT3L, &TCNT3H, &TIMSK3, TOIE3, &TIFR3, TOV3, TIMER3);
 
+#if EXT_TIMER_FAST_OVERFLOW_ISR
+
+ISR(TIMER3_OVF_vect, ISR_NAKED)
+{
+  ExtTimerT<TIMER3>::fastOverflowIsr();
+}
+
+#else
+
 ISR(TIMER3_OVF_vect)
 {
-  ExtTimer3.processOverflow();
+  ExtTimerT<TIMER3>::processOverflow();
 }
 
+#endif
+
 #endif // HAVE_TCNT3
 
 #endif // TIMER_EXT_EXT_TIMER3_H_
\ No newline at end of file
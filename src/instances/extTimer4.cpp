@@ -17,7 +17,7 @@
 #ifndef TIMER_EXT_EXT_TIMER4_H_
 #define TIMER_EXT_EXT_TIMER4_H_
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #include<avr/interrupt.h>
 
@@ -25,11 +25,22 @@
 
 ExtTimer ExtTimer4(&TCNT4L, &TCNT4H, &TIMSK4, TOIE4, &TIFR4, TOV4, TIMER4);
 
+#if EXT_TIMER_FAST_OVERFLOW_ISR
+
+ISR(TIMER4_OVF_vect, ISR_NAKED)
+{
+  ExtTimerT<TIMER4>::fastOverflowIsr();
+}
+
+#else
+
 ISR(TIMER4_OVF_vect)
 {
-  ExtTimer4.processOverflow();
+  ExtTimerT<TIMER4>::processOverflow();
 }
 
+#endif
+
 #endif // HAVE_TCNT4
 
 #endif // TIMER_EXT_EXT_TIMER4_H_
\ No newline at end of file
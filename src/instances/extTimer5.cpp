@@ -17,7 +17,7 @@
 #ifndef TIMER_EXT_EXT_TIMER5_H_
 #define TIMER_EXT_EXT_TIMER5_H_
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #include<avr/interrupt.h>
 
@@ -25,11 +25,22 @@
 
 ExtTimer ExtTimer5(&TCNT5L, &TCNT5H, &TIMSK5, TOIE5, &TIFR5, TOV5, TIMER5);
 
+#if EXT_TIMER_FAST_OVERFLOW_ISR
+
+ISR(TIMER5_OVF_vect, ISR_NAKED)
+{
+  ExtTimerT<TIMER5>::fastOverflowIsr();
+}
+
+#else
+
 ISR(TIMER5_OVF_vect)
 {
-  ExtTimer5.processOverflow();
+  ExtTimerT<TIMER5>::processOverflow();
 }
 
+#endif
+
 #endif // HAVE_TCNT5
 
 #endif // TIMER_EXT_EXT_TIMER5_H_
\ No newline at end of file
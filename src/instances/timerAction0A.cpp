@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR0A
 
 TimerAction TimerAction0A(TIMER0A, &ExtTimer0, OCIE0A, OCF0A);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION0A_ISR
 ISR(TIMER0_COMPA_vect)
 {
-  TimerAction0A.processInterrupt();
+  TimerAction0A.processInterrupt(ExtTimerT<TIMER0>::getFromIsr());
 }
+#endif
 
 #endif
 
@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR0B
 
 TimerAction TimerAction0B(TIMER0B, &ExtTimer0, OCIE0B, OCF0B);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION0B_ISR
 ISR(TIMER0_COMPB_vect)
 {
-  TimerAction0B.processInterrupt();
+  TimerAction0B.processInterrupt(ExtTimerT<TIMER0>::getFromIsr());
 }
+#endif
 
 #endif
 
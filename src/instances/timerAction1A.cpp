@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR1A
 
 TimerAction TimerAction1A(TIMER1A, &ExtTimer1, OCIE1A, OCF1A);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION1A_ISR
 ISR(TIMER1_COMPA_vect)
 {
-  TimerAction1A.processInterrupt();
+  TimerAction1A.processInterrupt(ExtTimerT<TIMER1>::getFromIsr());
 }
+#endif
 
 #endif
 
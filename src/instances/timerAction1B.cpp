@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR1B
 
 TimerAction TimerAction1B(TIMER1B, &ExtTimer1, OCIE1B, OCF1B);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION1B_ISR
 ISR(TIMER1_COMPB_vect)
 {
-  TimerAction1B.processInterrupt();
+  TimerAction1B.processInterrupt(ExtTimerT<TIMER1>::getFromIsr());
 }
+#endif
 
 #endif
 
@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR1C
 
 TimerAction TimerAction1C(TIMER1C, &ExtTimer1, OCIE1C, OCF1C);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION1C_ISR
 ISR(TIMER1_COMPC_vect)
 {
-  TimerAction1C.processInterrupt();
+  TimerAction1C.processInterrupt(ExtTimerT<TIMER1>::getFromIsr());
 }
+#endif
 
 #endif
 
@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR2A
 
 TimerAction TimerAction2A(TIMER2A, &ExtTimer2, OCIE2A, OCF2A);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION2A_ISR
 ISR(TIMER2_COMPA_vect)
 {
-  TimerAction2A.processInterrupt();
+  TimerAction2A.processInterrupt(ExtTimerT<TIMER2>::getFromIsr());
 }
+#endif
 
 #endif
 
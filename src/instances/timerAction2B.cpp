@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR2B
 
 TimerAction TimerAction2B(TIMER2B, &ExtTimer2, OCIE2B, OCF2B);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION2B_ISR
 ISR(TIMER2_COMPB_vect)
 {
-  TimerAction2B.processInterrupt();
+  TimerAction2B.processInterrupt(ExtTimerT<TIMER2>::getFromIsr());
 }
+#endif
 
 #endif
 
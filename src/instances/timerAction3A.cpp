@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR3A
 
 TimerAction TimerAction3A(TIMER3A, &ExtTimer3, OCIE3A, OCF3A);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION3A_ISR
 ISR(TIMER3_COMPA_vect)
 {
-  TimerAction3A.processInterrupt();
+  TimerAction3A.processInterrupt(ExtTimerT<TIMER3>::getFromIsr());
 }
+#endif
 
 #endif
 
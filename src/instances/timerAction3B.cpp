@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR3B
 
 TimerAction TimerAction3B(TIMER3B, &ExtTimer3, OCIE3B, OCF3B);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION3B_ISR
 ISR(TIMER3_COMPB_vect)
 {
-  TimerAction3B.processInterrupt();
+  TimerAction3B.processInterrupt(ExtTimerT<TIMER3>::getFromIsr());
 }
+#endif
 
 #endif
 
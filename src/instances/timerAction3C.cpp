@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR3C
 
 TimerAction TimerAction3C(TIMER3C, &ExtTimer3, OCIE3C, OCF3C);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION3C_ISR
 ISR(TIMER3_COMPC_vect)
 {
-  TimerAction3C.processInterrupt();
+  TimerAction3C.processInterrupt(ExtTimerT<TIMER3>::getFromIsr());
 }
+#endif
 
 #endif
 
@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR4A
 
 TimerAction TimerAction4A(TIMER4A, &ExtTimer4, OCIE4A, OCF4A);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION4A_ISR
 ISR(TIMER4_COMPA_vect)
 {
-  TimerAction4A.processInterrupt();
+  TimerAction4A.processInterrupt(ExtTimerT<TIMER4>::getFromIsr());
 }
+#endif
 
 #endif
 
@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR4B
 
 TimerAction TimerAction4B(TIMER4B, &ExtTimer4, OCIE4B, OCF4B);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION4B_ISR
 ISR(TIMER4_COMPB_vect)
 {
-  TimerAction4B.processInterrupt();
+  TimerAction4B.processInterrupt(ExtTimerT<TIMER4>::getFromIsr());
 }
+#endif
 
 #endif
 
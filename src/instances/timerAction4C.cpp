@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR4C
 
 TimerAction TimerAction4C(TIMER4C, &ExtTimer4, OCIE4C, OCF4C);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION4C_ISR
 ISR(TIMER4_COMPC_vect)
 {
-  TimerAction4C.processInterrupt();
+  TimerAction4C.processInterrupt(ExtTimerT<TIMER4>::getFromIsr());
 }
+#endif
 
 #endif
 
@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR5A
 
 TimerAction TimerAction5A(TIMER5A, &ExtTimer5, OCIE5A, OCF5A);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION5A_ISR
 ISR(TIMER5_COMPA_vect)
 {
-  TimerAction5A.processInterrupt();
+  TimerAction5A.processInterrupt(ExtTimerT<TIMER5>::getFromIsr());
 }
+#endif
 
 #endif
 
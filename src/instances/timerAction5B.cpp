@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR5B
 
 TimerAction TimerAction5B(TIMER5B, &ExtTimer5, OCIE5B, OCF5B);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION5B_ISR
 ISR(TIMER5_COMPB_vect)
 {
-  TimerAction5B.processInterrupt();
+  TimerAction5B.processInterrupt(ExtTimerT<TIMER5>::getFromIsr());
 }
+#endif
 
 #endif
 
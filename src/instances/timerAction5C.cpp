@@ -22,16 +22,18 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
-#include "extTimer.h"
+#include "extTimerT.h"
 
 #ifdef OCR5C
 
 TimerAction TimerAction5C(TIMER5C, &ExtTimer5, OCIE5C, OCF5C);
 
+#ifndef TIMER_EXT_NO_TIMER_ACTION5C_ISR
 ISR(TIMER5_COMPC_vect)
 {
-  TimerAction5C.processInterrupt();
+  TimerAction5C.processInterrupt(ExtTimerT<TIMER5>::getFromIsr());
 }
+#endif
 
 #endif
 
@@ -31,6 +31,13 @@ void startTimerActionCallback(TimerAction *timerAction, void *data)
   pulseGen->scheduleEndAction();
 }
 
+void shortWakeCallback(TimerAction *timerAction, void *data)
+{
+  PulseGen *pulseGen = static_cast<PulseGen *>(data);
+
+  pulseGen->armShortPulse();
+}
+
 void endTimerActionCallback(TimerAction *timerAction, void *data)
 {
   PulseGen *pulseGen = static_cast<PulseGen *>(data);
@@ -43,16 +50,270 @@ void endTimerActionCallback(TimerAction *timerAction, void *data)
 
 bool PulseGen::schedule(ticksExtraRange_t start, ticksExtraRange_t end)
 {
-  bool scheduled = _timerAction->schedule(start, CompareAction::Set, startTimerActionCallback, this);
+  _train = false;
+  _pulseCount = 0;
+
+  return scheduleStart(start, end);
+}
+
+bool PulseGen::scheduleShort(ticksExtraRange_t start, ticksExtraRange_t end)
+{
+  TimerClock clock = getTimerClock(_timerAction->getTimer());
+  ticksExtraRange_t width = end - start;
+
+  if (width < getMinShortWidthTicks(clock) || width > _timerAction->getExtTimer()->getMaxSysTicks())
+  {
+    return false;
+  }
+
+  // Round down, so the ISR doesn't wait longer than the lead for the start
+  ticksExtraRange_t leadTicks = clockCyclesToTicks(_shortLeadCycles, clock);
+
+  if (!leadTicks)
+  {
+    leadTicks = 1;
+  }
+
+  _train = false;
+  _pulseCount = 0;
+  _short = true;
+  _start = start;
+  _end = end;
+  _state = ScheduledStart;
+
+  // The pulse times can't be rescaled if the clock changes
+  _timerAction->setFixedClock(true);
+
+  bool scheduled = _timerAction->schedule(start - leadTicks, CompareAction::Nothing,
+    shortWakeCallback, this);
 
   if (!scheduled)
   {
     _state = MissedStart;
-      
-    if (_cb)
+
+    notifyStateChange();
+    return false;
+  }
+
+  return true;
+}
+
+bool PulseGen::scheduleTrain(ticksExtraRange_t start, ticksExtraRange_t widthTicks,
+    ticksExtraRange_t periodTicks, uint16_t count)
+{
+  if (widthTicks >= periodTicks)
+  {
+    return false;
+  }
+
+  _width = widthTicks;
+  _period = periodTicks;
+  _trainCount = count;
+  _pulseCount = 0;
+  _timingChanged = false;
+  _train = true;
+
+  return scheduleStart(start, start + widthTicks);
+}
+
+bool PulseGen::setTrainTiming(ticksExtraRange_t widthTicks, ticksExtraRange_t periodTicks)
+{
+  if (widthTicks >= periodTicks)
+  {
+    return false;
+  }
+
+  bool successful = true;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    // The next pulse starts a new period after the current one started, so
+    // it has to start after the current one ends
+    if (_train && _width >= periodTicks)
+    {
+      successful = false;
+    }
+    else
     {
-      _cb(this, _cbData);
+      _nextWidth = widthTicks;
+      _nextPeriod = periodTicks;
+      _timingChanged = true;
     }
+  }
+
+  return successful;
+}
+
+uint8_t PulseGen::getShortEdgeTicks() const
+{
+  return _shortEdgeTicks;
+}
+
+void PulseGen::setShortLeadCycles(uint16_t cycles)
+{
+  _shortLeadCycles = cycles;
+}
+
+uint16_t PulseGen::getShortLeadCycles() const
+{
+  return _shortLeadCycles;
+}
+
+void PulseGen::stopTrain()
+{
+  _train = false;
+}
+
+bool PulseGen::isTrainRunning() const
+{
+  return _train;
+}
+
+uint16_t PulseGen::getPulseCount() const
+{
+  uint16_t pulseCount;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    pulseCount = _pulseCount;
+  }
+
+  return pulseCount;
+}
+
+bool PulseGen::setQueue(PulseGenPulse *buffer, uint8_t size)
+{
+  // A ring of one slot can never hold a pulse
+  if (buffer && size < 2)
+  {
+    return false;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    _queue = buffer;
+    _queueSize = buffer ? size : 0;
+    _queueHead = 0;
+    _queueTail = 0;
+  }
+
+  return true;
+}
+
+PulseGen::QueueResult PulseGen::enqueue(ticksExtraRange_t start, ticksExtraRange_t end)
+{
+  bool startNow = false;
+  QueueResult result = Queued;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    bool busy = ScheduledStart == _state || ScheduledEnd == _state;
+
+    if (!busy && _queueHead == _queueTail)
+    {
+      // Nothing's running to start it from the ISR later
+      startNow = true;
+    }
+    else
+    {
+      uint8_t nextHead = _queueHead + 1;
+
+      if (nextHead >= _queueSize)
+      {
+        nextHead = 0;
+      }
+
+      if (nextHead == _queueTail)
+      {
+        result = Full;
+      }
+      else
+      {
+        _queue[_queueHead] = {start, end};
+        _queueHead = nextHead;
+      }
+    }
+  }
+
+  if (startNow)
+  {
+    _train = false;
+    _pulseCount = 0;
+
+    if (!scheduleStart(start, end))
+    {
+      result = Missed;
+    }
+  }
+
+  return result;
+}
+
+uint8_t PulseGen::getQueuedCount() const
+{
+  uint8_t head;
+  uint8_t tail;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    head = _queueHead;
+    tail = _queueTail;
+  }
+
+  return head >= tail ? head - tail : _queueSize - tail + head;
+}
+
+void PulseGen::clearQueue()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    _queueTail = _queueHead;
+  }
+}
+
+void PulseGen::startQueuedPulse()
+{
+  bool settled = Idle == _state || MissedStart == _state || MissedEnd == _state;
+
+  // Called from the ISRs, so the queue can't change under it
+  while (settled && _queueTail != _queueHead)
+  {
+    PulseGenPulse pulse = _queue[_queueTail];
+
+    uint8_t nextTail = _queueTail + 1;
+    _queueTail = nextTail >= _queueSize ? 0 : nextTail;
+
+    if (scheduleStart(pulse.start, pulse.end))
+    {
+      notifyStateChange();
+      return;
+    }
+
+    // A missed start was reported, so move on to the next one
+  }
+
+  if (settled)
+  {
+    // Nothing left to play, so the clock is free to change again
+    _timerAction->setFixedClock(false);
+  }
+}
+
+bool PulseGen::scheduleStart(ticksExtraRange_t start, ticksExtraRange_t end)
+{
+  _short = false;
+
+  // The pulse times can't be rescaled if the clock changes
+  _timerAction->setFixedClock(true);
+
+  bool scheduled = _timerAction->schedule(start, CompareAction::Set, startTimerActionCallback, this);
+
+  if (!scheduled)
+  {
+    _state = MissedStart;
+    _train = false;
+      
+    notifyStateChange();
     return false;
   }
 
@@ -112,8 +373,13 @@ bool PulseGen::cancelEnd()
 
 bool PulseGen::cancelStartOrEnd()
 {
+  _train = false;
+  clearQueue();
+
   bool cancelled = _timerAction->cancel();
 
+  _timerAction->setFixedClock(false);
+
   if (!cancelled)
   {
     _state = Idle;
@@ -146,52 +412,202 @@ void PulseGen::scheduleEndAction()
     {
       _state = ScheduledEnd;
 
-      if (_cb)
-      {
-        _cb(this, _cbData);
-      }
+      notifyStateChange();
     }
     else
     {
       _state = MissedEnd;
+      _train = false;
       
-      if (_cb)
-      {
-        _cb(this, _cbData);
-      }
+      notifyStateChange();
     }
   }
   else if (TimerAction::MissedAction == timerActionState)
   {
     _state = MissedStart;
+    _train = false;
 
-    if (_cb)
+    notifyStateChange();
+  }
+
+  startQueuedPulse();
+}
+
+void PulseGen::armShortPulse()
+{
+  if (TimerAction::Idle != _timerAction->getState())
+  {
+    _state = MissedStart;
+
+    notifyStateChange();
+    startQueuedPulse();
+    return;
+  }
+
+  TimerClock clock = getTimerClock(_timerAction->getTimer());
+  int32_t waitTicks = _start - _timerAction->getExtTimer()->getFromIsr();
+
+  if (waitTicks > static_cast<int32_t>(clockCyclesToTicks(PULSE_GEN_SHORT_MAX_SPIN_CYCLES, clock)))
+  {
+    // Too long to wait with interrupts off, so set the end from the ISR of
+    // the start, as schedule() does. A missed start is reported, and the
+    // next pulse started
+    _shortEdgeTicks = 0;
+
+    if (!scheduleStart(_start, _end))
     {
-      _cb(this, _cbData);
+      startQueuedPulse();
     }
+
+    return;
+  }
+
+  uint8_t setTicks = 0;
+  bool armed = _timerAction->armEdgePair(_start, _end, endTimerActionCallback, this, setTicks);
+
+  if (armed)
+  {
+    _shortEdgeTicks = setTicks;
+  }
+
+  if (armed && ScheduledStart == _state)
+  {
+    _state = ScheduledEnd;
+
+    notifyStateChange();
   }
+  else if (!armed && TimerAction::Idle == _timerAction->getState())
+  {
+    _state = MissedStart;
+
+    notifyStateChange();
+  }
+
+  // finish() reports a missed end
+
+  startQueuedPulse();
 }
 
 void PulseGen::finish()
 {
   TimerAction::State timerActionState = _timerAction->getState();
 
+  if (_short)
+  {
+    // Stop the toggle from happening again when the timer comes round
+    setOutputCompareAction(_timerAction->getTimer(), CompareAction::Clear);
+  }
+
   if (TimerAction::Idle == timerActionState)
   {
-    _state = Idle;
+    _pulseCount++;
 
-    if (_cb)
+    if (_train)
     {
-      _cb(this, _cbData);
+      if (!_trainCount || _pulseCount < _trainCount)
+      {
+        scheduleNextPulse();
+        return;
+      }
+
+      _train = false;
     }
+
+    _state = Idle;
+
+    notifyStateChange();
   }
   else if (TimerAction::MissedAction == timerActionState)
   {
     _state = MissedEnd;
+    _train = false;
+
+    notifyStateChange();
+  }
+
+  startQueuedPulse();
+}
+
+void PulseGen::scheduleNextPulse()
+{
+  if (_timingChanged)
+  {
+    _width = _nextWidth;
+    _period = _nextPeriod;
+    _timingChanged = false;
+  }
+
+  // Time from the last start, not from now, so ISR latency doesn't add up.
+  // The last start is the origin, so a start that's already passed is
+  // reported as missed rather than taken to be far in the future
+  ticksExtraRange_t prevStart = _start;
 
-    if (_cb)
+  _start += _period;
+  _end = _start + _width;
+
+  bool scheduled = _timerAction->schedule(_start, CompareAction::Set, prevStart,
+    startTimerActionCallback, this);
+
+  if (scheduled)
+  {
+    _state = ScheduledStart;
+  }
+  else
+  {
+    _state = MissedStart;
+    _train = false;
+  }
+
+  notifyStateChange();
+  startQueuedPulse();
+}
+
+void PulseGen::setDeferredCallbacks(bool deferred)
+{
+#if TIMER_EVENT_QUEUE_SIZE
+  _deferCallbacks = deferred;
+#endif
+}
+
+bool PulseGen::getDeferredCallbacks() const
+{
+#if TIMER_EVENT_QUEUE_SIZE
+  return _deferCallbacks;
+#else
+  return false;
+#endif
+}
+
+void PulseGen::notifyStateChange()
+{
+  if (!_cb)
+  {
+    return;
+  }
+
+#if TIMER_EVENT_QUEUE_SIZE
+  if (_deferCallbacks)
+  {
+    // Also called outside ISRs, when scheduling misses
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-      _cb(this, _cbData);
+      pushTimerEvent({dispatchEvent, this, reinterpret_cast<TimerEvent::Callback>(_cb), _cbData,
+        _state, _timerAction->getExtTimer()->getFromIsr()});
     }
+
+    return;
   }
-}
\ No newline at end of file
+#endif
+
+  _cb(this, _cbData);
+}
+
+#if TIMER_EVENT_QUEUE_SIZE
+void PulseGen::dispatchEvent(const TimerEvent &event)
+{
+  // The callback when the state changed, even if it's been set since
+  stateChangeCallback_t cb = reinterpret_cast<stateChangeCallback_t>(event.callback);
+
+  cb(static_cast<PulseGen *>(event.source), event.callbackData);
+}
+#endif
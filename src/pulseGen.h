@@ -19,6 +19,37 @@
 
 #include "timerTypes.h"
 #include "timerAction.h"
+#include "timerUtil.h"
+
+// Time scheduleShort() wakes the ISR up before the start. Must cover the
+// ISR latency and TimerAction's processing, and the ISR waits out the rest
+#ifndef PULSE_GEN_SHORT_LEAD_CYCLES
+#define PULSE_GEN_SHORT_LEAD_CYCLES 512
+#endif
+
+// Longest scheduleShort() waits in the ISR, with interrupts off, for the
+// start edge. If its ISR wakes up further ahead than this, the pulse is
+// made with schedule()'s two compares instead, which is fine once a tick
+// is longer than the ISR latency. Other interrupts can be held off for
+// this long plus PULSE_GEN_SHORT_EDGE_CYCLES, or a tick and that if the
+// tick is longer
+#ifndef PULSE_GEN_SHORT_MAX_SPIN_CYCLES
+#define PULSE_GEN_SHORT_MAX_SPIN_CYCLES 512
+#endif
+
+// Worst case time scheduleShort() takes from the start edge to setting
+// the compare for the end edge. test_pulse checks it against
+// getShortEdgeTicks() under simavr
+#ifndef PULSE_GEN_SHORT_EDGE_CYCLES
+#define PULSE_GEN_SHORT_EDGE_CYCLES 16
+#endif
+
+// A pulse waiting in a PulseGen's queue
+struct PulseGenPulse
+{
+  ticksExtraRange_t start;
+  ticksExtraRange_t end;
+};
 
 class PulseGen
 {
@@ -31,6 +62,75 @@ public:
 
   bool schedule(ticksExtraRange_t start, ticksExtraRange_t end);
 
+  enum QueueResult : uint8_t {Queued, Full, Missed};
+
+  // Give the PulseGen a queue for enqueue(), or take it away with nullptr.
+  // It holds one less pulse than size, and must stay alive while it's used.
+  // Returns false, leaving the old queue, if size is less than 2
+  bool setQueue(PulseGenPulse *buffer, uint8_t size);
+
+  // Start a pulse now if nothing is running, or queue it to start from the
+  // ISR when the pulses before it finish. Returns Full rather than waiting
+  // when there's no room, and Missed if a pulse started now missed. A
+  // queued pulse that misses is reported through the callback, and the
+  // next one starts
+  QueueResult enqueue(ticksExtraRange_t start, ticksExtraRange_t end);
+
+  uint8_t getQueuedCount() const;
+
+  // Drop the queued pulses. cancel() and cancelEnd() do this too
+  void clearQueue();
+
+  // Generate a pulse too short for the ISR to set the end after the start,
+  // down to getMinShortWidthTicks(). The ISR wakes up before the start,
+  // sets the start edge, waits for it, and sets the end edge straight after.
+  // Both edges toggle the pin, so it must start low. Returns false if the
+  // pulse is too short or too long for one timer period, or if it was missed
+  bool scheduleShort(ticksExtraRange_t start, ticksExtraRange_t end);
+
+  // Shortest pulse scheduleShort() can make at a clock
+  static constexpr ticksExtraRange_t getMinShortWidthTicks(TimerClock clock)
+  {
+    return (PULSE_GEN_SHORT_EDGE_CYCLES + clockCyclesPerTick(clock) - 1) / clockCyclesPerTick(clock) + 1;
+  }
+
+  // Ticks from the start edge of the last scheduleShort() pulse to when the
+  // compare for its end was set, read just after setting it. Less than the
+  // width means the end edge was on time, and the pulse was exactly as wide
+  // as asked. 0 if it was made with two compares, past
+  // PULSE_GEN_SHORT_MAX_SPIN_CYCLES
+  uint8_t getShortEdgeTicks() const;
+
+  // How long before the start scheduleShort() wakes the ISR up, from
+  // PULSE_GEN_SHORT_LEAD_CYCLES until set. applyCalibration() sets it from
+  // the measured timing. Takes effect from the next scheduleShort()
+  void setShortLeadCycles(uint16_t cycles);
+  uint16_t getShortLeadCycles() const;
+
+  // Generate count pulses, or pulses until stopped if count is 0. Each
+  // pulse starts periodTicks after the last one started, timed from start
+  // rather than from when the ISR ran, so the train doesn't drift. The
+  // ISRs schedule every pulse. Returns false if the width isn't shorter
+  // than the period, or the first start was missed
+  bool scheduleTrain(ticksExtraRange_t start, ticksExtraRange_t widthTicks,
+    ticksExtraRange_t periodTicks, uint16_t count = 0);
+
+  // Change the width and period from the next pulse of a train on. Taken
+  // between pulses, so no pulse mixes the old and new timing. Returns false
+  // if the width isn't shorter than the period, or the period isn't longer
+  // than the width of the running train, since the next pulse would start
+  // before the current one ends
+  bool setTrainTiming(ticksExtraRange_t widthTicks, ticksExtraRange_t periodTicks);
+
+  // Stop a train after the pulse in progress, or after the next one if
+  // it's between pulses, since that one is already scheduled
+  void stopTrain();
+
+  bool isTrainRunning() const;
+
+  // Pulses finished since schedule() or scheduleTrain()
+  uint16_t getPulseCount() const;
+
   ticksExtraRange_t getStart() const;
   ticksExtraRange_t getEnd() const;
 
@@ -46,7 +146,13 @@ public:
 
   void setStateChangeCallback(stateChangeCallback_t _cb, const void *_cbData = nullptr);
 
+  // Queue state changes to run the callback from TimerExtensions::poll(),
+  // instead of calling it from the ISR
+  void setDeferredCallbacks(bool deferred);
+  bool getDeferredCallbacks() const;
+
   void scheduleEndAction();
+  void armShortPulse();
   void finish();
 
 private:
@@ -59,6 +165,40 @@ private:
   ticksExtraRange_t _end;
 
   volatile State _state = State::Idle;
+
+  // Pulse train timing. The next timing waits for the end of a pulse
+  volatile bool _train = false;
+  uint16_t _trainCount;
+  volatile uint16_t _pulseCount = 0;
+  ticksExtraRange_t _width;
+  ticksExtraRange_t _period;
+  ticksExtraRange_t _nextWidth;
+  ticksExtraRange_t _nextPeriod;
+  volatile bool _timingChanged = false;
+
+  // Both edges of the pulse toggle
+  bool _short = false;
+  volatile uint8_t _shortEdgeTicks = 0;
+  uint16_t _shortLeadCycles = PULSE_GEN_SHORT_LEAD_CYCLES;
+
+  // Ring of pulses waiting to start. enqueue() adds at the head, and the
+  // ISRs take from the tail
+  PulseGenPulse *_queue = nullptr;
+  uint8_t _queueSize = 0;
+  volatile uint8_t _queueHead = 0;
+  volatile uint8_t _queueTail = 0;
+
+  bool scheduleStart(ticksExtraRange_t start, ticksExtraRange_t end);
+  void startQueuedPulse();
+  void scheduleNextPulse();
+
+#if TIMER_EVENT_QUEUE_SIZE
+  bool _deferCallbacks = false;
+
+  static void dispatchEvent(const TimerEvent &event);
+#endif
+
+  void notifyStateChange();
 };
 
 
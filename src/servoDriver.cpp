@@ -0,0 +1,548 @@
+// Servo driver for many servos on one compare channel
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "servoDriver.h"
+
+#include "avr/interrupt.h"
+#include "util/atomic.h"
+
+#include "extTimer.h"
+
+namespace
+{
+
+void servoTimerActionCallback(TimerAction *timerAction, void *data)
+{
+  ServoDriver *servoDriver = static_cast<ServoDriver *>(data);
+
+  servoDriver->processInterrupt();
+}
+
+uint16_t clampMicroseconds(uint16_t microseconds)
+{
+  if (microseconds < SERVO_DRIVER_MIN_MICROSECONDS)
+  {
+    return SERVO_DRIVER_MIN_MICROSECONDS;
+  }
+  else if (microseconds > SERVO_DRIVER_MAX_MICROSECONDS)
+  {
+    return SERVO_DRIVER_MAX_MICROSECONDS;
+  }
+
+  return microseconds;
+}
+
+void recordLate(ticksExtraRange_t lateTicks, ticksExtraRange_t &minLateTicks,
+  ticksExtraRange_t &maxLateTicks)
+{
+  if (lateTicks < minLateTicks)
+  {
+    minLateTicks = lateTicks;
+  }
+
+  if (lateTicks > maxLateTicks)
+  {
+    maxLateTicks = lateTicks;
+  }
+}
+
+} // namespace
+
+int8_t ServoDriver::attach(volatile uint8_t *port, uint8_t mask, uint16_t microseconds)
+{
+  return addServo(port, mask, false, microseconds);
+}
+
+int8_t ServoDriver::attachCompareOutput(uint16_t microseconds)
+{
+  if (_hardwareServo >= 0)
+  {
+    return -1;
+  }
+
+  return addServo(nullptr, 0, true, microseconds);
+}
+
+int8_t ServoDriver::addServo(volatile uint8_t *port, uint8_t mask, bool hardware,
+  uint16_t microseconds)
+{
+  if (_servoCount >= SERVO_DRIVER_MAX_SERVOS)
+  {
+    return -1;
+  }
+
+  // The ISR may sort the servo into the next frame as soon as it's
+  // published, so it needs its width by then
+  microseconds = clampMicroseconds(microseconds);
+
+  Servo servo;
+  servo.out = port;
+  servo.mask = mask;
+  servo.attached = true;
+  servo.microseconds = microseconds;
+  servo.widthTicks = _timerAction->microsecondsToTicks(microseconds);
+  servo.minRiseLateTicks = ~(ticksExtraRange_t)0;
+  servo.maxRiseLateTicks = 0;
+  servo.minLateTicks = ~(ticksExtraRange_t)0;
+  servo.maxLateTicks = 0;
+
+  int8_t index;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    index = _servoCount++;
+    _servos[index] = servo;
+
+    if (hardware)
+    {
+      _hardwareServo = index;
+    }
+  }
+
+  return index;
+}
+
+void ServoDriver::detach(uint8_t index)
+{
+  if (index >= _servoCount)
+  {
+    return;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    // The edge list already made still ends its pulse
+    _servos[index].attached = false;
+  }
+}
+
+void ServoDriver::writeMicroseconds(uint8_t index, uint16_t microseconds)
+{
+  if (index >= _servoCount)
+  {
+    return;
+  }
+
+  microseconds = clampMicroseconds(microseconds);
+
+  ticksExtraRange_t widthTicks = _timerAction->microsecondsToTicks(microseconds);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    _servos[index].microseconds = microseconds;
+    _servos[index].widthTicks = widthTicks;
+  }
+}
+
+uint16_t ServoDriver::readMicroseconds(uint8_t index) const
+{
+  if (index >= _servoCount)
+  {
+    return 0;
+  }
+
+  uint16_t microseconds;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    microseconds = _servos[index].microseconds;
+  }
+
+  return microseconds;
+}
+
+bool ServoDriver::begin()
+{
+  end();
+
+  TimerClock clock = getTimerClock(_timerAction->getTimer());
+
+  _frameTicks = _timerAction->microsecondsToTicks(SERVO_DRIVER_FRAME_MICROSECONDS);
+  _spinTicks = clockCyclesToTicks(SERVO_DRIVER_SPIN_CYCLES, clock);
+
+  // The clock may have changed since the widths were set
+  for (uint8_t i = 0; i < _servoCount; ++i)
+  {
+    writeMicroseconds(i, _servos[i].microseconds);
+  }
+
+  resetLateTicks();
+
+  // Frames are timed in ticks, so keep the clock as it is while running
+  _timerAction->setFixedClock(true);
+
+  int timer = _timerAction->getTimer();
+
+  if (_hardwareServo >= 0)
+  {
+    // Connect the compare pin, low
+    setOutputCompareAction(timer, CompareAction::Clear);
+    forceOutputCompare(timer);
+  }
+
+  bool scheduled;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    buildFrame();
+
+    _frameStart = _timerAction->getExtTimer()->get() + _timerAction->microsecondsToTicks(1000);
+    _inFrame = false;
+    _running = true;
+
+    scheduled = _timerAction->schedule(_frameStart, _frameAction,
+      servoTimerActionCallback, this);
+
+    if (!scheduled)
+    {
+      _running = false;
+      _timerAction->setFixedClock(false);
+    }
+  }
+
+  return scheduled;
+}
+
+void ServoDriver::end()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    _running = false;
+    _timerAction->cancel();
+    _timerAction->setFixedClock(false);
+
+    for (uint8_t i = 0; i < _servoCount; ++i)
+    {
+      if (i != _hardwareServo)
+      {
+        *_servos[i].out &= ~_servos[i].mask;
+      }
+    }
+
+    if (_hardwareServo >= 0)
+    {
+      int timer = _timerAction->getTimer();
+
+      setOutputCompareAction(timer, CompareAction::Clear);
+      forceOutputCompare(timer);
+    }
+  }
+}
+
+bool ServoDriver::isRunning() const
+{
+  return _running;
+}
+
+ticksExtraRange_t ServoDriver::getMinRiseLateTicks(uint8_t index) const
+{
+  if (index >= _servoCount)
+  {
+    return 0;
+  }
+
+  ticksExtraRange_t lateTicks;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    lateTicks = _servos[index].minRiseLateTicks;
+  }
+
+  return lateTicks;
+}
+
+ticksExtraRange_t ServoDriver::getMaxRiseLateTicks(uint8_t index) const
+{
+  if (index >= _servoCount)
+  {
+    return 0;
+  }
+
+  ticksExtraRange_t lateTicks;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    lateTicks = _servos[index].maxRiseLateTicks;
+  }
+
+  return lateTicks;
+}
+
+ticksExtraRange_t ServoDriver::getMinLateTicks(uint8_t index) const
+{
+  if (index >= _servoCount)
+  {
+    return 0;
+  }
+
+  ticksExtraRange_t lateTicks;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    lateTicks = _servos[index].minLateTicks;
+  }
+
+  return lateTicks;
+}
+
+ticksExtraRange_t ServoDriver::getMaxLateTicks(uint8_t index) const
+{
+  if (index >= _servoCount)
+  {
+    return 0;
+  }
+
+  ticksExtraRange_t lateTicks;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    lateTicks = _servos[index].maxLateTicks;
+  }
+
+  return lateTicks;
+}
+
+void ServoDriver::resetLateTicks()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (uint8_t i = 0; i < _servoCount; ++i)
+    {
+      _servos[i].minRiseLateTicks = ~(ticksExtraRange_t)0;
+      _servos[i].maxRiseLateTicks = 0;
+      _servos[i].minLateTicks = ~(ticksExtraRange_t)0;
+      _servos[i].maxLateTicks = 0;
+    }
+  }
+}
+
+ticksExtraRange_t ServoDriver::getFrameStart() const
+{
+  ticksExtraRange_t frameStart;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    frameStart = _frameStart;
+  }
+
+  return frameStart;
+}
+
+TimerAction *ServoDriver::getTimerAction() const
+{
+  return _timerAction;
+}
+
+void ServoDriver::processInterrupt()
+{
+  if (_processing)
+  {
+    // A schedule() below missed, and the loop there deals with it
+    return;
+  }
+
+  _processing = true;
+
+  ExtTimer *extTimer = _timerAction->getExtTimer();
+  bool fired = TimerAction::MissedAction != _timerAction->getState();
+
+  while (_running)
+  {
+    ticksExtraRange_t curTicks = extTimer->getFromIsr();
+
+    if (!_inFrame)
+    {
+      startFrame(curTicks, fired);
+      fired = false;
+    }
+
+    clearDueEdges(curTicks, fired);
+    fired = false;
+
+    bool scheduled;
+
+    if (_edgeIndex < _edgeCount)
+    {
+      const Edge &edge = _edges[_edgeIndex];
+
+      if (_frameStart + edge.ticks - curTicks <= _spinTicks)
+      {
+        // Sooner than the interrupt would come
+        continue;
+      }
+
+      _armedTicks = edge.ticks;
+
+      scheduled = _timerAction->schedule(_frameStart + edge.ticks, edge.action,
+        servoTimerActionCallback, this);
+    }
+    else
+    {
+      // Sort the next frame while there's time before it
+      buildFrame();
+
+      _frameStart += _frameTicks;
+      _inFrame = false;
+
+      scheduled = _timerAction->schedule(_frameStart, _frameAction,
+        servoTimerActionCallback, this);
+    }
+
+    if (scheduled)
+    {
+      break;
+    }
+  }
+
+  _processing = false;
+}
+
+void ServoDriver::buildFrame()
+{
+  _edgeCount = 0;
+
+  // Insertion sort, as there are only a few servos
+  for (uint8_t i = 0; i < _servoCount; ++i)
+  {
+    if (!_servos[i].attached)
+    {
+      continue;
+    }
+
+    ticksExtraRange_t ticks = _servos[i].widthTicks;
+    uint8_t j = _edgeCount++;
+
+    while (j > 0 && _edges[j - 1].ticks > ticks)
+    {
+      _edges[j] = _edges[j - 1];
+      --j;
+    }
+
+    _edges[j].ticks = ticks;
+    _edges[j].servo = i;
+  }
+
+  // With a servo on the compare pin, the compare must never be
+  // disconnected, or the pin would drop to its port bit. Edges before the
+  // hardware one set it, which it already is, and the rest clear it
+  if (_hardwareServo >= 0)
+  {
+    const Servo &hardwareServo = _servos[_hardwareServo];
+
+    for (uint8_t i = 0; i < _edgeCount; ++i)
+    {
+      bool high = hardwareServo.attached && _edges[i].ticks < hardwareServo.widthTicks;
+
+      _edges[i].action = high ? CompareAction::Set : CompareAction::Clear;
+    }
+
+    _frameAction = hardwareServo.attached ? CompareAction::Set : CompareAction::Clear;
+  }
+  else
+  {
+    for (uint8_t i = 0; i < _edgeCount; ++i)
+    {
+      _edges[i].action = CompareAction::Nothing;
+    }
+
+    _frameAction = CompareAction::Nothing;
+  }
+}
+
+void ServoDriver::startFrame(ticksExtraRange_t curTicks, bool fired)
+{
+  ExtTimer *extTimer = _timerAction->getExtTimer();
+
+  // Lateness is from the time the frame was scheduled for
+  ticksExtraRange_t scheduledStart = _frameStart;
+  ticksExtraRange_t hardwareLateTicks = 0;
+
+  if (!fired)
+  {
+    // Too late for the hardware edge, so the frame starts now
+    _frameStart = curTicks;
+
+    if (CompareAction::Set == _frameAction)
+    {
+      int timer = _timerAction->getTimer();
+
+      setOutputCompareAction(timer, CompareAction::Set);
+      forceOutputCompare(timer);
+
+      hardwareLateTicks = extTimer->getFromIsr() - scheduledStart;
+    }
+  }
+
+  // Raise every pin before reading the time, so the last servo doesn't
+  // rise later than the first and get a shorter pulse
+  for (uint8_t i = 0; i < _edgeCount; ++i)
+  {
+    if (_edges[i].servo != _hardwareServo)
+    {
+      Servo &servo = _servos[_edges[i].servo];
+
+      *servo.out |= servo.mask;
+    }
+  }
+
+  ticksExtraRange_t softwareLateTicks = extTimer->getFromIsr() - scheduledStart;
+
+  for (uint8_t i = 0; i < _edgeCount; ++i)
+  {
+    Servo &servo = _servos[_edges[i].servo];
+    ticksExtraRange_t lateTicks = _edges[i].servo != _hardwareServo
+      ? softwareLateTicks : hardwareLateTicks;
+
+    recordLate(lateTicks, servo.minRiseLateTicks, servo.maxRiseLateTicks);
+  }
+
+  _edgeIndex = 0;
+  _inFrame = true;
+}
+
+void ServoDriver::clearDueEdges(ticksExtraRange_t curTicks, bool fired)
+{
+  ExtTimer *extTimer = _timerAction->getExtTimer();
+  ticksExtraRange_t frameTicks = curTicks - _frameStart;
+
+  while (_edgeIndex < _edgeCount && frameTicks >= _edges[_edgeIndex].ticks)
+  {
+    const Edge &edge = _edges[_edgeIndex++];
+    Servo &servo = _servos[edge.servo];
+    ticksExtraRange_t lateTicks = 0;
+
+    if (edge.servo != _hardwareServo)
+    {
+      *servo.out &= ~servo.mask;
+
+      // Read straight after the pin write, so the time is the edge's
+      lateTicks = extTimer->getFromIsr() - (_frameStart + edge.ticks);
+    }
+    else if (!fired || edge.ticks != _armedTicks)
+    {
+      int timer = _timerAction->getTimer();
+
+      setOutputCompareAction(timer, CompareAction::Clear);
+      forceOutputCompare(timer);
+
+      lateTicks = extTimer->getFromIsr() - (_frameStart + edge.ticks);
+    }
+
+    // Otherwise the compare cleared it on time
+
+    recordLate(lateTicks, servo.minLateTicks, servo.maxLateTicks);
+  }
+}
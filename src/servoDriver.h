@@ -0,0 +1,150 @@
+// Servo driver for many servos on one compare channel
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TIMER_EXT_SERVO_DRIVER_H_
+#define TIMER_EXT_SERVO_DRIVER_H_
+
+#include "timerTypes.h"
+#include "timerAction.h"
+#include "timerUtil.h"
+
+#ifndef SERVO_DRIVER_MAX_SERVOS
+#define SERVO_DRIVER_MAX_SERVOS 12
+#endif
+
+#ifndef SERVO_DRIVER_FRAME_MICROSECONDS
+#define SERVO_DRIVER_FRAME_MICROSECONDS 20000
+#endif
+
+// Pulse widths are held to this range
+#ifndef SERVO_DRIVER_MIN_MICROSECONDS
+#define SERVO_DRIVER_MIN_MICROSECONDS 500
+#endif
+
+#ifndef SERVO_DRIVER_MAX_MICROSECONDS
+#define SERVO_DRIVER_MAX_MICROSECONDS 2500
+#endif
+
+// Edges closer than this to the last one are waited for in the ISR, rather
+// than scheduled, since the next interrupt would take longer to come
+#ifndef SERVO_DRIVER_SPIN_CYCLES
+#define SERVO_DRIVER_SPIN_CYCLES 512
+#endif
+
+class ServoDriver
+{
+public:
+  ServoDriver(TimerAction &timerAction)
+    : _timerAction{&timerAction}
+  {}
+
+  // Add a servo on the pin for mask in port, which the ISR sets and clears.
+  // Returns the servo's index, or -1 if there's no room
+  int8_t attach(volatile uint8_t *port, uint8_t mask, uint16_t microseconds = 1500);
+
+  // Add a servo on the channel's own compare pin, whose edges come from the
+  // hardware, so it has no jitter. Returns -1 if there's already one
+  int8_t attachCompareOutput(uint16_t microseconds = 1500);
+
+  // Stop pulsing a servo after the pulse in progress. Its index isn't
+  // reused
+  void detach(uint8_t index);
+
+  // Takes effect from the next frame, so no pulse is cut short
+  void writeMicroseconds(uint8_t index, uint16_t microseconds);
+  uint16_t readMicroseconds(uint8_t index) const;
+
+  // Start a frame every SERVO_DRIVER_FRAME_MICROSECONDS. Returns false if
+  // the first frame was missed
+  bool begin();
+
+  // Stop straight away, and set the pins low. The compare pin stays
+  // connected to the compare
+  void end();
+
+  bool isRunning() const;
+
+  // How late the rising and falling edges of a servo's pulse have been
+  // since begin() or resetLateTicks(), read from the timer straight after
+  // the pin was written. The spread of each is its jitter. Hardware edges
+  // are 0 unless the ISR had to make them
+  ticksExtraRange_t getMinRiseLateTicks(uint8_t index) const;
+  ticksExtraRange_t getMaxRiseLateTicks(uint8_t index) const;
+  ticksExtraRange_t getMinLateTicks(uint8_t index) const;
+  ticksExtraRange_t getMaxLateTicks(uint8_t index) const;
+  void resetLateTicks();
+
+  ticksExtraRange_t getFrameStart() const;
+
+  TimerAction *getTimerAction() const;
+
+  void processInterrupt();
+
+private:
+  struct Servo
+  {
+    volatile uint8_t *out;
+    uint8_t mask;
+    bool attached;
+    uint16_t microseconds;
+    ticksExtraRange_t widthTicks;
+    ticksExtraRange_t minRiseLateTicks;
+    ticksExtraRange_t maxRiseLateTicks;
+    ticksExtraRange_t minLateTicks;
+    ticksExtraRange_t maxLateTicks;
+  };
+
+  // A falling edge, in ticks from the start of the frame
+  struct Edge
+  {
+    ticksExtraRange_t ticks;
+    uint8_t servo;
+    CompareAction action;
+  };
+
+  TimerAction *_timerAction;
+
+  Servo _servos[SERVO_DRIVER_MAX_SERVOS];
+  uint8_t _servoCount = 0;
+
+  // Servo on the channel's compare pin, or -1
+  int8_t _hardwareServo = -1;
+
+  // This frame's edges, sorted by time when the last frame finished
+  Edge _edges[SERVO_DRIVER_MAX_SERVOS];
+  uint8_t _edgeCount = 0;
+  uint8_t _edgeIndex = 0;
+  CompareAction _frameAction;
+
+  ticksExtraRange_t _frameStart;
+  ticksExtraRange_t _frameTicks;
+  ticksExtraRange_t _spinTicks;
+
+  // Ticks of the edge the compare is set for
+  ticksExtraRange_t _armedTicks;
+
+  volatile bool _running = false;
+  bool _inFrame = false;
+  bool _processing = false;
+
+  int8_t addServo(volatile uint8_t *port, uint8_t mask, bool hardware,
+    uint16_t microseconds);
+  void buildFrame();
+  void startFrame(ticksExtraRange_t curTicks, bool fired);
+  void clearDueEdges(ticksExtraRange_t curTicks, bool fired);
+};
+
+#endif
@@ -0,0 +1,237 @@
+// Tick Service
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TIMER_EXT_TICK_SERVICE_H_
+#define TIMER_EXT_TICK_SERVICE_H_
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "extTimer.h"
+#include "timerTypes.h"
+#include "timerUtil.h"
+
+// Compare A registers of each timer, known at compile time
+template <uint8_t timer>
+struct TickServiceTraits;
+
+#ifdef HAVE_TCNT0
+template <>
+struct TickServiceTraits<TIMER0>
+{
+  static constexpr uint8_t compareA = TIMER0A;
+  static constexpr uint8_t ocieA = OCIE0A;
+  static constexpr uint8_t ocfA = OCF0A;
+  static volatile uint8_t &timsk() { return TIMSK0; }
+  static volatile uint8_t &tifr() { return TIFR0; }
+  static void clearTCNT() { TCNT0 = 0; }
+};
+#endif // HAVE_TCNT0
+
+#ifdef HAVE_TCNT1
+template <>
+struct TickServiceTraits<TIMER1>
+{
+  static constexpr uint8_t compareA = TIMER1A;
+  static constexpr uint8_t ocieA = OCIE1A;
+  static constexpr uint8_t ocfA = OCF1A;
+  static volatile uint8_t &timsk() { return TIMSK1; }
+  static volatile uint8_t &tifr() { return TIFR1; }
+  static void clearTCNT() { TCNT1 = 0; }
+};
+#endif // HAVE_TCNT1
+
+#ifdef HAVE_TCNT2
+template <>
+struct TickServiceTraits<TIMER2>
+{
+  static constexpr uint8_t compareA = TIMER2A;
+  static constexpr uint8_t ocieA = OCIE2A;
+  static constexpr uint8_t ocfA = OCF2A;
+  static volatile uint8_t &timsk() { return TIMSK2; }
+  static volatile uint8_t &tifr() { return TIFR2; }
+  static void clearTCNT() { TCNT2 = 0; }
+};
+#endif // HAVE_TCNT2
+
+#ifdef HAVE_TCNT3
+template <>
+struct TickServiceTraits<TIMER3>
+{
+  static constexpr uint8_t compareA = TIMER3A;
+  static constexpr uint8_t ocieA = OCIE3A;
+  static constexpr uint8_t ocfA = OCF3A;
+  static volatile uint8_t &timsk() { return TIMSK3; }
+  static volatile uint8_t &tifr() { return TIFR3; }
+  static void clearTCNT() { TCNT3 = 0; }
+};
+#endif // HAVE_TCNT3
+
+#ifdef HAVE_TCNT4
+template <>
+struct TickServiceTraits<TIMER4>
+{
+  static constexpr uint8_t compareA = TIMER4A;
+  static constexpr uint8_t ocieA = OCIE4A;
+  static constexpr uint8_t ocfA = OCF4A;
+  static volatile uint8_t &timsk() { return TIMSK4; }
+  static volatile uint8_t &tifr() { return TIFR4; }
+  static void clearTCNT() { TCNT4 = 0; }
+};
+#endif // HAVE_TCNT4
+
+#ifdef HAVE_TCNT5
+template <>
+struct TickServiceTraits<TIMER5>
+{
+  static constexpr uint8_t compareA = TIMER5A;
+  static constexpr uint8_t ocieA = OCIE5A;
+  static constexpr uint8_t ocfA = OCF5A;
+  static volatile uint8_t &timsk() { return TIMSK5; }
+  static volatile uint8_t &tifr() { return TIFR5; }
+  static void clearTCNT() { TCNT5 = 0; }
+};
+#endif // HAVE_TCNT5
+
+// Fixed-rate tick for high-rate control loops. The timer runs in CTC mode
+// with OCRnA as TOP, so the hardware restarts each period by itself, and the
+// compare A ISR only counts the tick and calls a handler bound at compile
+// time. There's no TimerAction state machine, time read, or callback pointer
+// on the way.
+//
+// The timer is given over to the service: its ExtTimer and TimerActions
+// can't be used while it runs. Define the ISR with TICK_SERVICE_ISR(), and
+// build with TIMER_EXT_NO_TIMER_ACTIONnA_ISR defined so the TimerActionnA
+// instance leaves the vector free.
+template <uint8_t timer>
+class TickService
+{
+public:
+  typedef TickServiceTraits<timer> Traits;
+
+  static_assert(TIMER0 != timer || !USE_ARDUINO_TIMER0_OVERFLOW,
+    "Arduino needs TIMER0 for millis()");
+
+  TickService() = delete;
+
+  // Start ticking every periodTicks ticks of the clock. Restarts the count
+  static bool begin(TimerClock clock, ticks16_t periodTicks)
+  {
+    if (0 == periodTicks || TimerClock::None == clock
+      || periodTicks - 1u > getTimerTop(timer, TimerResolution::NA))
+    {
+      return false;
+    }
+
+    bool successful = true;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      Traits::timsk() &= ~(1 << Traits::ocieA);
+      setTimerClock(timer, TimerClock::None);
+
+      if (!setTimerMode(timer, TimerMode::CTC, TimerResolution::OCRA))
+      {
+        successful = false;
+      }
+      else
+      {
+        // TCNT counts 0 to TOP inclusive
+        setOutputCompareTicks(Traits::compareA, periodTicks - 1);
+        Traits::clearTCNT();
+
+        _tickCount = 0;
+        _periodTicks = periodTicks;
+
+        Traits::tifr() = (1 << Traits::ocfA);
+        Traits::timsk() |= (1 << Traits::ocieA);
+
+        successful = setTimerClock(timer, clock);
+      }
+    }
+
+    return successful;
+  }
+
+  // Stop the timer and the interrupt, and put the timer back in Normal mode.
+  // The count is kept
+  static void end()
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      setTimerClock(timer, TimerClock::None);
+      Traits::timsk() &= ~(1 << Traits::ocieA);
+      setTimerMode(timer, TimerMode::Normal);
+      Traits::tifr() = (1 << Traits::ocfA);
+    }
+  }
+
+  // Ticks since begin()
+  static uint32_t getTickCount()
+  {
+    uint32_t tickCount;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      tickCount = _tickCount;
+    }
+
+    return tickCount;
+  }
+
+  // Same, for use in the handler
+  static uint32_t getTickCountFromIsr()
+  {
+    return _tickCount;
+  }
+
+  static ticks16_t getPeriodTicks()
+  {
+    return _periodTicks;
+  }
+
+  // Called from the compare A ISR. The handler is a template argument, so
+  // it can be inlined
+  template <void (*handler)()>
+  static void processTick()
+  {
+    _tickCount = _tickCount + 1;
+    handler();
+  }
+
+private:
+  static volatile uint32_t _tickCount;
+  static ticks16_t _periodTicks;
+};
+
+template <uint8_t timer>
+volatile uint32_t TickService<timer>::_tickCount = 0;
+
+template <uint8_t timer>
+ticks16_t TickService<timer>::_periodTicks = 0;
+
+// Defines the compare A ISR for TIMERn, calling handler on each tick. The
+// TimerActionnA instance uses the same vector, so define
+// TIMER_EXT_NO_TIMER_ACTIONnA_ISR in the build flags to leave it out.
+// Ex: TICK_SERVICE_ISR(1, controlLoop)
+#define TICK_SERVICE_ISR(n, handler) \
+  ISR(TIMER##n##_COMPA_vect) \
+  { \
+    TickService<TIMER##n>::processTick<handler>(); \
+  }
+
+#endif // TIMER_EXT_TICK_SERVICE_H_
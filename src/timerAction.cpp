@@ -15,6 +15,8 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "timerAction.h"
+#include "timerEvents.h"
+#include "timerSequence.h"
 
 #include <util/atomic.h>
 
@@ -43,8 +45,47 @@ ticksExtraRange_t TimerAction::getNow()
 bool TimerAction::schedule(ticksExtraRange_t actionTicks, CompareAction action,
     ticksExtraRange_t originTicks, TimerActionCallback cb, void *cbData)
 {
+  return scheduleAction(actionTicks, action, originTicks, 0, nullptr, cb, cbData);
+}
+
+bool TimerAction::scheduleAction(ticksExtraRange_t actionTicks, CompareAction action,
+    ticksExtraRange_t originTicks, ticksExtraRange_t periodTicks, TimerSequence *sequence,
+    TimerActionCallback cb, void *cbData, const TimerActionLink *link)
+{
+  prepareAction(actionTicks, action, originTicks, periodTicks, sequence, cb, cbData, link);
+
+  // Set the action
+  tryScheduleSysRange(_extTimer->get());
+
+  bool successful = true;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    // Set the action time and figure out if it should have hit
+    setOutputCompareTicks(_timer, static_cast<uint16_t>(actionTicks));
+
+    successful = checkLate(_extTimer->getFromIsr());
+  }
+
+  return successful;
+}
+
+void TimerAction::prepareAction(ticksExtraRange_t actionTicks, CompareAction action,
+    ticksExtraRange_t originTicks, ticksExtraRange_t periodTicks, TimerSequence *sequence,
+    TimerActionCallback cb, void *cbData, const TimerActionLink *link)
+{
+  // Let the ExtTimer find this action if the clock changes
+  if (!_addedToExtTimer)
+  {
+    _extTimer->addAction(this);
+  }
+
   _prevCompareAction = getOutputCompareAction(_timer);
 
+  _periodTicks = periodTicks;
+  _sequence = sequence;
+  _link = link;
+  _late = false;
   _cb = cb;
   _cbData = cbData;
   _originTicks = originTicks;
@@ -52,6 +93,11 @@ bool TimerAction::schedule(ticksExtraRange_t actionTicks, CompareAction action,
   _action = action;
   _actionTicks = actionTicks;
 
+  if (link)
+  {
+    _linkTicks = actionTicks + link->offsetTicks;
+  }
+
   // Set OCR to a known value in the past and clear any pending int flag
   // Ensures that we have plety of time to set OCR without accidentally
   // matching
@@ -60,49 +106,255 @@ bool TimerAction::schedule(ticksExtraRange_t actionTicks, CompareAction action,
   
   // Enable the interrupt
   *_extTimer->getTIMSK() |= (1 << _ocie);
+}
 
-  // Set the action
-  tryScheduleSysRange(_extTimer->get());
+void TimerAction::armLink(ticksExtraRange_t actionTicks, ticksExtraRange_t originTicks,
+    const TimerActionLink *link)
+{
+  if (actionTicks - originTicks > _extTimer->getMaxSysTicks())
+  {
+    // Too far off to arm directly
+    scheduleAction(actionTicks, link->action, originTicks, 0, nullptr, link->cb, link->cbData,
+      link->next);
+    return;
+  }
 
-  bool successful = true;
+  // The time was worked out when the action before was armed. Park the
+  // compare in the recent past while the action is set, so nothing can
+  // match before the pin action is connected, then move it to the time
+  _prevCompareAction = getOutputCompareAction(_timer);
+  setOutputCompareTicks(_timer, _extTimer->getSysRangeFromIsr() - 1);
+  setOutputCompareAction(_timer, link->action);
+  *_extTimer->getTIFR() = (1 << _ocf);
+  setOutputCompareTicks(_timer, static_cast<uint16_t>(actionTicks));
 
-  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  if (!_addedToExtTimer)
   {
-    // Set the action time and figure out if it should have hit
-    setOutputCompareTicks(_timer, static_cast<uint16_t>(actionTicks));
+    _extTimer->addAction(this);
+  }
+
+  *_extTimer->getTIMSK() |= (1 << _ocie);
+
+  _periodTicks = 0;
+  _sequence = nullptr;
+  _late = false;
+  _cb = link->cb;
+  _cbData = link->cbData;
+  _originTicks = originTicks;
+  _state = Scheduled;
+  _action = link->action;
+  _actionTicks = actionTicks;
+  _link = link->next;
+
+  if (_link)
+  {
+    _linkTicks = actionTicks + _link->offsetTicks;
+  }
+
+  checkLate(_extTimer->getFromIsr());
+}
+
+bool TimerAction::armEdgePair(ticksExtraRange_t firstTicks, ticksExtraRange_t secondTicks,
+    TimerActionCallback cb, void *cbData, uint8_t &setTicks)
+{
+  volatile uint8_t *tifr = _extTimer->getTIFR();
+  volatile uint8_t *ocr = getOutputCompareRegister(_timer);
+  volatile uint8_t *tcntl = _extTimer->_tcntl;
+  uint8_t ocfMask = 1 << _ocf;
+  bool wide = _extTimer->getMaxSysTicks() > UINT8_MAX;
 
-    ticksExtraRange_t ticksAfterSet = _extTimer->get();
+  // Work out the second compare value before the wait
+  uint8_t secondLow = static_cast<uint8_t>(secondTicks);
+  uint8_t secondHigh = static_cast<uint8_t>(secondTicks >> 8);
 
-    // Are we now after the action time?
-    bool shouldHaveHit = ticksAfterSet - _originTicks > _actionTicks - _originTicks;
+  _prevCompareAction = getOutputCompareAction(_timer);
+
+  // Park the compare in the recent past before switching to Toggle, so a
+  // match can't happen before the pin toggles on it. Then move it to the
+  // first edge
+  setOutputCompareTicks(_timer, _extTimer->getSysRangeFromIsr() - 1);
+  setOutputCompareAction(_timer, CompareAction::Toggle);
+  *tifr = ocfMask;
+  setOutputCompareTicks(_timer, static_cast<uint16_t>(firstTicks));
+
+  ticksExtraRange_t curTicks = _extTimer->getFromIsr();
+  ticksExtraRange_t originTicks = curTicks - getBackdateTicks();
+
+  if (curTicks - originTicks >= firstTicks - originTicks && !(*tifr & ocfMask))
+  {
+    // Too late for the first edge
+    setOutputCompareAction(_timer, _prevCompareAction);
+    return false;
+  }
+
+  while (!(*tifr & ocfMask)) {}
+
+  *tifr = ocfMask;
+
+  if (wide)
+  {
+    ocr[1] = secondHigh;
+  }
+
+  ocr[0] = secondLow;
+
+  // How long after the first edge the second compare was set. Only the low
+  // byte of TCNT is read, so it costs two cycles
+  setTicks = *tcntl - static_cast<uint8_t>(firstTicks);
+
+  *_extTimer->getTIMSK() |= (1 << _ocie);
+
+  _periodTicks = 0;
+  _sequence = nullptr;
+  _link = nullptr;
+  _late = false;
+  _cb = cb;
+  _cbData = cbData;
+  _originTicks = firstTicks;
+  _state = Scheduled;
+  _action = CompareAction::Toggle;
+  _actionTicks = secondTicks;
+
+  return checkLate(_extTimer->getFromIsr());
+}
+
+bool TimerAction::checkLate(ticksExtraRange_t curTicks)
+{
+  // Are we now after the action time?
+  bool shouldHaveHit = curTicks - _originTicks > _actionTicks - _originTicks;
+
+  if (shouldHaveHit)
+  {
+    bool didHit = *_extTimer->getTIFR() & (1 << _ocf);
 
-    if (shouldHaveHit)
+    if (!didHit)
     {
-      bool didHit = *_extTimer->getTIFR() & (1 << _ocf);
+      return processLateAction(curTicks);
+    }
+  }
+
+  return true;
+}
 
-      if (!didHit)
+bool TimerAction::reschedule(ticksExtraRange_t actionTicks)
+{
+  bool successful = false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    ticksExtraRange_t beforeTicks = _extTimer->getFromIsr();
+    uint32_t newDiff = actionTicks - beforeTicks;
+
+    // Fast path: a one-shot action already in compare range, moving to a
+    // time that's also in range. Its compare action is already connected,
+    // so only the compare time needs writing
+    if (Scheduled == _state && !_periodTicks && !_sequence
+      && newDiff - 1 < _extTimer->getMaxSysTicks())
+    {
+      setOutputCompareTicks(_timer, static_cast<uint16_t>(actionTicks));
+
+      ticksExtraRange_t afterTicks = _extTimer->getFromIsr();
+      bool newReached = afterTicks - beforeTicks >= newDiff;
+
+      if ((*_extTimer->getTIFR() & (1 << _ocf)) && !newReached)
       {
-        // Disable the interrupt, clear the interrupt flag, and set previous compare action
-        setOutputCompareAction(_timer, _prevCompareAction);
-        *_extTimer->getTIMSK() &= ~(1 << _ocie);
-        *_extTimer->getTIFR() = (1 << _ocf);
-        
-        _state = MissedAction;
-        successful = false;
+        // The old time matched before the write. Keep the new time from
+        // matching too, and leave the interrupt to finish the old action
+        setOutputCompareTicks(_timer, _extTimer->getSysRangeFromIsr() - 1);
+      }
+      else
+      {
+        _originTicks = beforeTicks;
+        _actionTicks = actionTicks;
+        _late = false;
 
-        if (_cb) {
-          _cb(this, _cbData);
+        if (_link)
+        {
+          _linkTicks = actionTicks + _link->offsetTicks;
         }
+
+        successful = checkLate(afterTicks);
       }
     }
+    else
+    {
+      successful = rescheduleSlow(actionTicks);
+    }
   }
 
   return successful;
 }
 
+bool TimerAction::rescheduleSlow(ticksExtraRange_t actionTicks)
+{
+  bool pending = Scheduled == _state || WaitingToSchedule == _state;
+
+  if (Scheduled == _state)
+  {
+    // Like cancel(), move the compare to the recent past so the old action
+    // can't happen, then see if it already did. If so, leave the interrupt
+    // to finish it
+    ticks16_t recentPastTime = _extTimer->getSysRangeFromIsr() - 1;
+    setOutputCompareTicks(_timer, recentPastTime);
+
+    pending = !(*_extTimer->getTIFR() & (1 << _ocf));
+  }
+
+  if (!pending)
+  {
+    return false;
+  }
+
+  ticksExtraRange_t curTicks = _extTimer->getFromIsr();
+
+  _originTicks = curTicks - getBackdateTicks();
+  _actionTicks = actionTicks;
+  _late = false;
+
+  if (_link)
+  {
+    _linkTicks = actionTicks + _link->offsetTicks;
+  }
+
+  // Keep the compare out of the way and the old action off while the
+  // new one is set up
+  setOutputCompareTicks(_timer, static_cast<uint16_t>(_originTicks - 1));
+  *_extTimer->getTIFR() = (1 << _ocf);
+  setOutputCompareAction(_timer, _prevCompareAction);
+
+  tryScheduleSysRange(curTicks);
+
+  setOutputCompareTicks(_timer, static_cast<uint16_t>(actionTicks));
+
+  return checkLate(_extTimer->getFromIsr());
+}
+
+bool TimerAction::scheduleSequence(ticksExtraRange_t actionTicks, CompareAction action,
+    ticksExtraRange_t deltaTicks, TimerSequence *sequence, TimerActionCallback cb, void *cbData)
+{
+  // Missed steps can't be skipped or caught up without breaking the
+  // waveform, so any miss stops the sequence
+  _missedPeriodPolicy = ReportMissed;
+  _missedPeriods = 0;
+
+  ticksExtraRange_t originTicks = _extTimer->get() - getBackdateTicks();
+
+  return scheduleAction(actionTicks, action, originTicks, deltaTicks, sequence, cb, cbData);
+}
+
+void TimerAction::armStopped(ticksExtraRange_t actionTicks, CompareAction action,
+    ticksExtraRange_t backdateTicks, TimerActionCallback cb, void *cbData)
+{
+  ticksExtraRange_t curTicks = _extTimer->getFromIsr();
+
+  prepareAction(actionTicks, action, curTicks - backdateTicks, 0, nullptr, cb, cbData);
+  tryScheduleSysRange(curTicks);
+  setOutputCompareTicks(_timer, static_cast<uint16_t>(actionTicks));
+}
+
 ticksExtraRange_t TimerAction::getBackdateTicks()
 {
-  static constexpr ticksExtraRange_t backdateClockCycles = 8192ul;
+  ticksExtraRange_t backdateClockCycles = _missHorizonCycles;
 
   TimerClock clk = getTimerClock(_timer);
 
@@ -127,6 +379,52 @@ ticksExtraRange_t TimerAction::getBackdateTicks()
   }
 }
 
+bool TimerAction::processLateAction(ticksExtraRange_t curTicks)
+{
+  // Disable the interrupt and clear the interrupt flag
+  *_extTimer->getTIMSK() &= ~(1 << _ocie);
+  *_extTimer->getTIFR() = (1 << _ocf);
+
+  _periodTicks = 0;
+  _sequence = nullptr;
+  _link = nullptr;
+  _late = true;
+
+  // The compare can only be forced outside the PWM modes
+  bool fire = (FireLate == _latePolicy || FireLateAndReport == _latePolicy)
+    && !isTimerModePwm(_extTimer->getTimer());
+  bool fired = fire && FireLate == _latePolicy;
+
+  if (fire)
+  {
+    // Perform the compare action now, rather than not at all
+    setOutputCompareAction(_timer, _action);
+    forceOutputCompare(_timer);
+  }
+  else
+  {
+    setOutputCompareAction(_timer, _prevCompareAction);
+  }
+
+  if (fired)
+  {
+    _state = Idle;
+    recordFired(curTicks);
+  }
+  else
+  {
+    _state = MissedAction;
+    recordMissed();
+  }
+
+  if (DropLate != _latePolicy)
+  {
+    invokeCallback();
+  }
+
+  return fired;
+}
+
 bool TimerAction::schedule(ticksExtraRange_t actionTicks, CompareAction action,
     TimerActionCallback cb, void *cbData)
 {
@@ -146,6 +444,85 @@ bool TimerAction::schedule(ticksExtraRange_t actionTicks, TimerActionCallback cb
   return schedule(actionTicks, CompareAction::Nothing, cb, cbData);
 }
 
+namespace {
+
+// True if every link of the chain is on extTimer. Steps one pointer two
+// links at a time and another one at a time, and stops when they meet,
+// since by then every link of a loop has been seen
+bool chainStaysOnTimer(const TimerActionLink *link, const ExtTimer *extTimer)
+{
+  const TimerActionLink *slow = link;
+  const TimerActionLink *fast = link;
+
+  while (fast)
+  {
+    if (fast->timerAction->getExtTimer() != extTimer)
+    {
+      return false;
+    }
+
+    fast = fast->next;
+
+    if (!fast)
+    {
+      break;
+    }
+
+    if (fast->timerAction->getExtTimer() != extTimer)
+    {
+      return false;
+    }
+
+    fast = fast->next;
+    slow = slow->next;
+
+    if (fast == slow)
+    {
+      break;
+    }
+  }
+
+  return true;
+}
+
+} // namespace
+
+bool TimerAction::scheduleChain(ticksExtraRange_t actionTicks, CompareAction action,
+    const TimerActionLink *link, TimerActionCallback cb, void *cbData)
+{
+  // Link times are worked out in this timer's ticks
+  if (!chainStaysOnTimer(link, _extTimer))
+  {
+    return false;
+  }
+
+  ticksExtraRange_t originTicks = _extTimer->get() - getBackdateTicks();
+
+  return scheduleAction(actionTicks, action, originTicks, 0, nullptr, cb, cbData, link);
+}
+
+bool TimerAction::schedulePeriodic(ticksExtraRange_t firstTicks, ticksExtraRange_t periodTicks,
+    CompareAction action, TimerActionCallback cb, void *cbData, MissedPeriodPolicy policy)
+{
+  if (0 == periodTicks)
+  {
+    return false;
+  }
+
+  _missedPeriodPolicy = policy;
+  _missedPeriods = 0;
+
+  ticksExtraRange_t originTicks = _extTimer->get() - getBackdateTicks();
+
+  return scheduleAction(firstTicks, action, originTicks, periodTicks, nullptr, cb, cbData);
+}
+
+bool TimerAction::schedulePeriodic(ticksExtraRange_t firstTicks, ticksExtraRange_t periodTicks,
+    TimerActionCallback cb, void *cbData, MissedPeriodPolicy policy)
+{
+  return schedulePeriodic(firstTicks, periodTicks, CompareAction::Nothing, cb, cbData, policy);
+}
+
 void TimerAction::tryScheduleSysRange(ticksExtraRange_t curTicks)
 {
   uint32_t actionTicksDiff = _actionTicks - curTicks;
@@ -165,86 +542,285 @@ void TimerAction::tryScheduleSysRange(ticksExtraRange_t curTicks)
 
 bool TimerAction::cancel()
 {
-  if (WaitingToSchedule == _state)
+  bool cancelled = false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
-    // Disable the interrupt, clear the interrupt flag, and set previous compare action
-    setOutputCompareAction(_timer, _prevCompareAction);
-    *_extTimer->getTIMSK() &= ~(1 << _ocie);
-    *_extTimer->getTIFR() = (1 << _ocf);
-    return true;
+    // Don't let a periodic action, sequence, or chain rearm itself
+    _periodTicks = 0;
+    _sequence = nullptr;
+    _link = nullptr;
+
+    if (WaitingToSchedule == _state || Scheduled == _state)
+    {
+      cancelled = true;
+
+      if (Scheduled == _state)
+      {
+        ticks16_t recentPastTime = _extTimer->getSysRangeFromIsr() - 1;
+
+        // Set the action time to a time in the recent past so it won't hit
+        setOutputCompareTicks(_timer, recentPastTime);
+
+        // If it already hit, we missed the chance to cancel
+        cancelled = !(*_extTimer->getTIFR() & (1 << _ocf));
+      }
+
+      // Disable the interrupt, clear the interrupt flag, and set previous compare action
+      setOutputCompareAction(_timer, _prevCompareAction);
+      *_extTimer->getTIMSK() &= ~(1 << _ocie);
+      *_extTimer->getTIFR() = (1 << _ocf);
+
+      recordCancel(cancelled);
+    }
   }
-  else if (Scheduled == _state)
-  {
-    ticks16_t recentPastTime = _extTimer->getSysRange() - 1;
 
-    bool didHit;
+  return cancelled;
+}
 
-    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+bool TimerAction::tryProcessActionInPast(ticksExtraRange_t curTicks)
+{
+  // The action is now in the past
+  if (curTicks - _originTicks >= _actionTicks - _originTicks)
+  {
+    if (_periodTicks || _sequence)
     {
-      // Set the action time to a time in the recent past so it won't hit
-      setOutputCompareTicks(_timer, recentPastTime);
+      processPeriod(curTicks);
+      return true;
+    }
 
-      didHit = *_extTimer->getTIFR() & (1 << _ocf);
+    // Check for miss
+    if (WaitingToSchedule == _state)
+    {
+      processLateAction(curTicks);
+      return true;
     }
 
-    // Disable the interrupt, clear the interrupt flag, and set previous compare action
-    setOutputCompareAction(_timer, _prevCompareAction);
+    // Disable interrupt and clear the interrupt flag
     *_extTimer->getTIMSK() &= ~(1 << _ocie);
     *_extTimer->getTIFR() = (1 << _ocf);
 
-    if (didHit)
-    {
-      // We missed the chance to cancel
-      return false;
-    }
-    else
+    _state = Idle;
+    recordFired(curTicks);
+
+    if (_link)
     {
-      // Cancelled successfully
+      // Arm the next action before anything else, since it's the one in a
+      // hurry. It may be this one, which replaces the callback
+      TimerActionCallback cb = _cb;
+      void *cbData = _cbData;
+
+      _link->timerAction->armLink(_linkTicks, _actionTicks, _link);
+
+      invokeCallback(cb, cbData);
+
       return true;
     }
+
+    invokeCallback();
+
+    return true;
   }
   else
   {
-    // Totally missed
     return false;
   }
 }
 
-bool TimerAction::tryProcessActionInPast(ticksExtraRange_t curTicks)
+void TimerAction::processPeriod(ticksExtraRange_t curTicks)
 {
-  // The action is now in the past
-  if (curTicks - _originTicks >= _actionTicks - _originTicks)
+  // If the action is still waiting, the compare was never set in time
+  bool missed = WaitingToSchedule == _state;
+
+  if (!missed)
   {
-    // Disable interrupt and clear the interrupt flag
-    *_extTimer->getTIMSK() &= ~(1 << _ocie);
-    *_extTimer->getTIFR() = (1 << _ocf);
+    recordFired(curTicks);
+  }
 
-    // Check for miss
-    if (WaitingToSchedule == _state)
+  for (;;)
+  {
+    if (missed)
     {
-      _state = MissedAction;
+      _missedPeriods++;
+      recordMissed();
+
+      if (ReportMissed == _missedPeriodPolicy)
+      {
+        // Disable the interrupt, clear the interrupt flag, and set previous compare action
+        setOutputCompareAction(_timer, _prevCompareAction);
+        *_extTimer->getTIMSK() &= ~(1 << _ocie);
+        *_extTimer->getTIFR() = (1 << _ocf);
+
+        _state = MissedAction;
+        _periodTicks = 0;
+        _sequence = nullptr;
+
+        invokeCallback();
+
+        return;
+      }
     }
-    else
+
+    // A sequence supplies the length and action of each step
+    if (_sequence && !_sequence->nextStep(_periodTicks, _action))
     {
+      // Disable interrupt and clear the interrupt flag
+      *_extTimer->getTIMSK() &= ~(1 << _ocie);
+      *_extTimer->getTIFR() = (1 << _ocf);
+
       _state = Idle;
+      _periodTicks = 0;
+      _sequence = nullptr;
+
+      invokeCallback();
+
+      return;
     }
 
-    if (_cb) {
-      _cb(this, _cbData);
+    // Set up the next period before the callback, so a slow callback
+    // doesn't make it late
+    _actionTicks += _periodTicks;
+    missed = !tryArmPeriod();
+
+    if (missed && SkipMissed == _missedPeriodPolicy)
+    {
+      skipMissedPeriods();
+      missed = false;
     }
 
-    return true;
+    ticksExtraRange_t armedTicks = _actionTicks;
+
+    invokeCallback();
+
+    // Only loop to catch up, and not if the callback cancelled or rescheduled
+    if (!missed || (!_periodTicks && !_sequence) || armedTicks != _actionTicks)
+    {
+      return;
+    }
+  }
+}
+
+bool TimerAction::tryArmPeriod()
+{
+  // The period that just ended is the origin, so the whole period counts as
+  // the future
+  _originTicks = _actionTicks - _periodTicks;
+
+  // OCR still holds the time that just matched, so it can't match again
+  // before it's moved. Set the next period's compare action first, or take
+  // the action off if the period is out of range, so the move can't match
+  // with the last period's action
+  tryScheduleSysRange(_extTimer->getFromIsr());
+
+  if (WaitingToSchedule == _state)
+  {
+    setOutputCompareAction(_timer, _prevCompareAction);
+  }
+
+  setOutputCompareTicks(_timer, static_cast<uint16_t>(_actionTicks));
+
+  ticksExtraRange_t curTicks = _extTimer->getFromIsr();
+
+  bool shouldHaveHit = curTicks - _originTicks >= _actionTicks - _originTicks;
+
+  // If the compare matched anyway, the interrupt will handle this period
+  return !shouldHaveHit || (*_extTimer->getTIFR() & (1 << _ocf));
+}
+
+void TimerAction::skipMissedPeriods()
+{
+  do
+  {
+    // Move to the first period after now
+    ticksExtraRange_t behind = _extTimer->getFromIsr() - _actionTicks;
+    ticksExtraRange_t skipped = behind / _periodTicks + 1;
+
+    _actionTicks += skipped * _periodTicks;
+    _missedPeriods += skipped;
+
+    recordMissed(skipped > UINT16_MAX ? UINT16_MAX : skipped);
+  } while (!tryArmPeriod());
+}
+
+namespace {
+
+// Rescale the time between now and ticks, rounding later
+ticksExtraRange_t rescaleTicks(ticksExtraRange_t ticks, ticksExtraRange_t oldNow,
+  ticksExtraRange_t newNow, int oldCyclesPerTick, int newCyclesPerTick)
+{
+  int64_t clockCycles = static_cast<int64_t>(static_cast<int32_t>(ticks - oldNow)) * oldCyclesPerTick;
+
+  if (clockCycles >= 0)
+  {
+    return newNow + (clockCycles + newCyclesPerTick - 1) / newCyclesPerTick;
   }
   else
   {
-    return false;
+    return newNow - (-clockCycles) / newCyclesPerTick;
+  }
+}
+
+} // namespace
+
+bool TimerAction::hasFixedTicks() const
+{
+  return (WaitingToSchedule == _state || Scheduled == _state)
+    && (_fixedClock || _link || _sequence);
+}
+
+void TimerAction::rescale(ticksExtraRange_t oldNow, ticksExtraRange_t newNow,
+  int oldCyclesPerTick, int newCyclesPerTick)
+{
+  if (WaitingToSchedule != _state && Scheduled != _state)
+  {
+    return;
+  }
+
+  bool alreadyDue = oldNow - _originTicks >= _actionTicks - _originTicks;
+
+  _actionTicks = rescaleTicks(_actionTicks, oldNow, newNow, oldCyclesPerTick, newCyclesPerTick);
+  _originTicks = rescaleTicks(_originTicks, oldNow, newNow, oldCyclesPerTick, newCyclesPerTick);
+
+  if (_periodTicks)
+  {
+    // The new clock may not divide the period evenly, so round to the nearest tick
+    uint64_t periodCycles = static_cast<uint64_t>(_periodTicks) * oldCyclesPerTick;
+    _periodTicks = (periodCycles + newCyclesPerTick / 2) / newCyclesPerTick;
+
+    if (0 == _periodTicks)
+    {
+      _periodTicks = 1;
+    }
+  }
+
+  if (alreadyDue)
+  {
+    // Leave the interrupt flag alone, so the pending interrupt finishes the action
+    return;
+  }
+
+  // Move the compare to the new action time. Rounding later guarantees that
+  // it's at least one tick after now, so it can't match right away
+  setOutputCompareTicks(_timer, static_cast<uint16_t>(_actionTicks));
+  *_extTimer->getTIFR() = (1 << _ocf);
+
+  tryScheduleSysRange(newNow);
+
+  if (WaitingToSchedule == _state)
+  {
+    // The action may have moved out of range, so don't let the next
+    // compare match perform it early
+    setOutputCompareAction(_timer, _prevCompareAction);
   }
 }
 
 void TimerAction::processInterrupt()
 {
-  const ticksExtraRange_t curTicks = _extTimer->get();
+  processInterrupt(_extTimer->getFromIsr());
+}
 
+void TimerAction::processInterrupt(ticksExtraRange_t curTicks)
+{
   // The action is now in the past
   if (!tryProcessActionInPast(curTicks))
   {
@@ -252,6 +828,16 @@ void TimerAction::processInterrupt()
   }
 }
 
+void TimerAction::setFixedClock(bool fixedClock)
+{
+  _fixedClock = fixedClock;
+}
+
+bool TimerAction::getFixedClock() const
+{
+  return _fixedClock;
+}
+
 TimerAction::State TimerAction::getState() const
 {
   return _state;
@@ -267,6 +853,126 @@ ticksExtraRange_t TimerAction::getOriginTicks() const
   return _originTicks;
 }
 
+void TimerAction::setMissHorizonCycles(uint32_t cycles)
+{
+  _missHorizonCycles = cycles;
+}
+
+uint32_t TimerAction::getMissHorizonCycles() const
+{
+  return _missHorizonCycles;
+}
+
+void TimerAction::setLatePolicy(LatePolicy policy)
+{
+  _latePolicy = policy;
+}
+
+TimerAction::LatePolicy TimerAction::getLatePolicy() const
+{
+  return _latePolicy;
+}
+
+bool TimerAction::wasLate() const
+{
+  return _late;
+}
+
+void TimerAction::setDeferredCallbacks(bool deferred)
+{
+#if TIMER_EVENT_QUEUE_SIZE
+  _deferCallbacks = deferred;
+#endif
+}
+
+bool TimerAction::getDeferredCallbacks() const
+{
+#if TIMER_EVENT_QUEUE_SIZE
+  return _deferCallbacks;
+#else
+  return false;
+#endif
+}
+
+void TimerAction::invokeCallback()
+{
+  invokeCallback(_cb, _cbData);
+}
+
+void TimerAction::invokeCallback(TimerActionCallback cb, void *cbData)
+{
+  if (!cb)
+  {
+    return;
+  }
+
+#if TIMER_EVENT_QUEUE_SIZE
+  if (_deferCallbacks)
+  {
+    // Also called outside ISRs, when scheduling misses
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      pushTimerEvent({dispatchEvent, this, reinterpret_cast<TimerEvent::Callback>(cb), cbData,
+        _state, _extTimer->getFromIsr()});
+    }
+
+    return;
+  }
+#endif
+
+  cb(this, cbData);
+}
+
+#if TIMER_ACTION_STATS
+TimerActionStats TimerAction::getStats() const
+{
+  TimerActionStats stats;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    stats = _stats;
+  }
+
+  return stats;
+}
+
+void TimerAction::resetStats()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    _stats = {};
+  }
+}
+#endif
+
+#if TIMER_EVENT_QUEUE_SIZE
+void TimerAction::dispatchEvent(const TimerEvent &event)
+{
+  // Run the callback that was due when the event was raised, even if the
+  // action has been scheduled with another since
+  TimerActionCallback cb = reinterpret_cast<TimerActionCallback>(event.callback);
+
+  cb(static_cast<TimerAction *>(event.source), const_cast<void *>(event.callbackData));
+}
+#endif
+
+ticksExtraRange_t TimerAction::getPeriodTicks() const
+{
+  return _periodTicks;
+}
+
+uint16_t TimerAction::getMissedPeriods() const
+{
+  uint16_t missedPeriods;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    missedPeriods = _missedPeriods;
+  }
+
+  return missedPeriods;
+}
+
 ExtTimer *TimerAction::getExtTimer() const
 {
   return _extTimer;
@@ -20,11 +20,71 @@
 #include <stdint.h>
 
 #include "extTimer.h"
+#include "timerEvents.h"
 #include "timerUtil.h"
 
+// Count fired, missed, and cancelled actions, and how late each one's
+// interrupt ran, for each TimerAction
+#ifndef TIMER_ACTION_STATS
+#define TIMER_ACTION_STATS 0
+#endif
+
+// Default for how far back from now schedule() counts an action time as
+// missed, rather than far in the future
+#ifndef TIMER_ACTION_MISS_HORIZON_CYCLES
+#define TIMER_ACTION_MISS_HORIZON_CYCLES 8192ul
+#endif
+
+#ifndef TIMER_ACTION_LATENESS_BUCKETS
+#define TIMER_ACTION_LATENESS_BUCKETS 8
+#endif
+
+#if TIMER_ACTION_STATS
+
+// Counts stop at their maximum rather than wrapping
+struct TimerActionStats
+{
+  uint16_t fired;
+  uint16_t missed;
+
+  // cancel() stopped the action, or the compare matched first
+  uint16_t cancelsWon;
+  uint16_t cancelsLost;
+
+  // Ticks from the action time to when the interrupt read the time. Bucket
+  // 0 counts 0 ticks, bucket n counts 2^(n-1) to 2^n - 1 ticks, and the last
+  // bucket also counts anything later
+  uint16_t lateness[TIMER_ACTION_LATENESS_BUCKETS];
+  ticksExtraRange_t maxLateness;
+};
+
+#endif // TIMER_ACTION_STATS
+
+class TimerSequence;
+struct TimerActionLink;
+
 class TimerAction {
 public:
   enum State : uint8_t {Idle, WaitingToSchedule, Scheduled, MissedAction};
+
+  // What a periodic action does when the interrupt is too late to set the
+  // compare for the next period in time:
+  // SkipMissed    - skip ahead to the next period that's still in the future
+  // CatchUpMissed - call the callback for each missed period, back to back
+  // ReportMissed  - stop, and call the callback with the state set to MissedAction
+  enum MissedPeriodPolicy : uint8_t {SkipMissed, CatchUpMissed, ReportMissed};
+
+  // What a one-shot action does when its time has passed before the
+  // compare could be set:
+  // MissLate          - don't perform it, and call the callback with the state
+  //                     set to MissedAction
+  // FireLate          - perform the compare action and callback now, as if on time
+  // DropLate          - don't perform it, and don't call the callback
+  // FireLateAndReport - perform the compare action now, and call the
+  //                     callback with the state set to MissedAction
+  // The compare can't be forced in PWM modes, so there the Fire policies
+  // act like MissLate
+  enum LatePolicy : uint8_t {MissLate, FireLate, DropLate, FireLateAndReport};
   
   TimerAction(const TimerAction&) = delete;
   TimerAction(TimerAction&&) = delete;
@@ -52,24 +112,118 @@ public:
   bool schedule(ticksExtraRange_t actionTicks,
       TimerActionCallback cb = nullptr, void *cbData = nullptr);
 
+  // Repeat the action every periodTicks, starting at firstTicks. Each period
+  // is measured from the last action time rather than from when the
+  // interrupt ran, so latency doesn't add up. The callback runs once per
+  // period
+  bool schedulePeriodic(ticksExtraRange_t firstTicks, ticksExtraRange_t periodTicks,
+      CompareAction action, TimerActionCallback cb = nullptr, void *cbData = nullptr,
+      MissedPeriodPolicy policy = SkipMissed);
+  bool schedulePeriodic(ticksExtraRange_t firstTicks, ticksExtraRange_t periodTicks,
+      TimerActionCallback cb = nullptr, void *cbData = nullptr,
+      MissedPeriodPolicy policy = SkipMissed);
+
+  // Schedule an action that starts a chain. When it fires, the ISR arms the
+  // first link's TimerAction straight away, offsetTicks after this action's
+  // time, and so on down the links. A miss stops the chain. Returns false
+  // if a link is on another timer, or the first action was missed
+  bool scheduleChain(ticksExtraRange_t actionTicks, CompareAction action,
+      const TimerActionLink *link, TimerActionCallback cb = nullptr, void *cbData = nullptr);
+
   bool cancel();
 
+  // Move a Scheduled or WaitingToSchedule action to actionTicks, keeping
+  // its compare action and callback. A one-shot action moving within the
+  // 16-bit range only needs its compare register written again. Returns
+  // false if nothing was pending, the old time already matched, in which
+  // case the old action still happens, or the new time was missed
+  bool reschedule(ticksExtraRange_t actionTicks);
+
+  // Action times up to this many clock cycles before now count as late.
+  // Earlier ones count as far in the future
+  void setMissHorizonCycles(uint32_t cycles);
+  uint32_t getMissHorizonCycles() const;
+
+  // The miss horizon in ticks of the current clock, to take from now to get
+  // an origin
+  ticksExtraRange_t getBackdateTicks();
+
+  // For TimerSequence: schedule the first step, actionTicks, repeating every
+  // deltaTicks until the sequence's ISR gives the next step. A missed step
+  // stops the sequence
+  bool scheduleSequence(ticksExtraRange_t actionTicks, CompareAction action,
+      ticksExtraRange_t deltaTicks, TimerSequence *sequence, TimerActionCallback cb, void *cbData);
+
+  // For TimerActionBatch: set up the action and write its compare, with the
+  // timer stopped and the batch already checked for misses
+  void armStopped(ticksExtraRange_t actionTicks, CompareAction action,
+      ticksExtraRange_t backdateTicks, TimerActionCallback cb, void *cbData);
+
+  // For PulseGen: toggle the pin at firstTicks and at secondTicks, closer
+  // together than an ISR could manage. Call from this action's ISR before
+  // firstTicks. It waits in the ISR for the first edge, then sets the
+  // compare for the second straight away and schedules it with cb. setTicks
+  // is how many ticks after the first edge the second compare was set, read
+  // just after setting it. Returns false if either edge was missed. A missed
+  // first edge leaves the pin and state alone
+  bool armEdgePair(ticksExtraRange_t firstTicks, ticksExtraRange_t secondTicks,
+      TimerActionCallback cb, void *cbData, uint8_t &setTicks);
+
+  void setLatePolicy(LatePolicy policy);
+  LatePolicy getLatePolicy() const;
+
+  // True if the last action's time had passed before its compare was set
+  bool wasLate() const;
+
+  // Call from the compare ISR. curTicks is the current time, as returned
+  // by getFromIsr() on the ExtTimer
   void processInterrupt();
+  void processInterrupt(ticksExtraRange_t curTicks);
 
   State getState() const;
 
   ticksExtraRange_t getActionTicks() const;
   ticksExtraRange_t getOriginTicks() const;
 
+  // 0 for one-shot actions
+  ticksExtraRange_t getPeriodTicks() const;
+
+  // Periods missed since schedulePeriodic()
+  uint16_t getMissedPeriods() const;
+
   ExtTimer *getExtTimer() const;
 
+  // Queue the callback to run from TimerExtensions::poll(), instead of
+  // calling it from the ISR
+  void setDeferredCallbacks(bool deferred);
+  bool getDeferredCallbacks() const;
+
+  // Set by something that keeps ticks of its own while it uses this action,
+  // so ExtTimer::reconfigure() knows it can't rescale them. Clear it when
+  // giving the action up
+  void setFixedClock(bool fixedClock);
+  bool getFixedClock() const;
+
+#if TIMER_ACTION_STATS
+  TimerActionStats getStats() const;
+  void resetStats();
+#endif
+
   int getTimer() const;
 
   CompareAction getAction();
 
 private:
+  friend class ExtTimer;
+
   int _timer;
   ExtTimer *_extTimer;
+
+  // Next TimerAction scheduled on the same ExtTimer
+  TimerAction *_nextAction = nullptr;
+  bool _addedToExtTimer = false;
+
+  bool _fixedClock = false;
   
   ticksExtraRange_t _actionTicks;
 
@@ -95,9 +249,139 @@ private:
 
   CompareAction _prevCompareAction;
 
+  ticksExtraRange_t _periodTicks = 0;
+  MissedPeriodPolicy _missedPeriodPolicy = SkipMissed;
+  volatile uint16_t _missedPeriods = 0;
+
+  // Sequence playing on this action, which supplies each step
+  TimerSequence *_sequence = nullptr;
+
+  // Link to arm when this action fires, and the time it's armed for,
+  // worked out ahead so the ISR only has to copy it into OCR
+  const TimerActionLink *_link = nullptr;
+  ticksExtraRange_t _linkTicks = 0;
+
+  uint32_t _missHorizonCycles = TIMER_ACTION_MISS_HORIZON_CYCLES;
+  LatePolicy _latePolicy = MissLate;
+  volatile bool _late = false;
+
+#if TIMER_EVENT_QUEUE_SIZE
+  bool _deferCallbacks = false;
+
+  static void dispatchEvent(const TimerEvent &event);
+#endif
+
+  void invokeCallback();
+  void invokeCallback(TimerActionCallback cb, void *cbData);
+
+#if TIMER_ACTION_STATS
+  TimerActionStats _stats = {};
+
+  static void addSaturating(uint16_t &count, uint16_t add)
+  {
+    count = count > UINT16_MAX - add ? UINT16_MAX : count + add;
+  }
+#endif
+
+  // Inline, so they cost the ISRs nothing unless TIMER_ACTION_STATS is set
+  void recordFired(ticksExtraRange_t curTicks)
+  {
+#if TIMER_ACTION_STATS
+    ticksExtraRange_t lateness = curTicks - _actionTicks;
+
+    addSaturating(_stats.fired, 1);
+
+    if (lateness > _stats.maxLateness)
+    {
+      _stats.maxLateness = lateness;
+    }
+
+    uint8_t bucket = 0;
+
+    while (lateness && bucket < TIMER_ACTION_LATENESS_BUCKETS - 1)
+    {
+      lateness >>= 1;
+      bucket++;
+    }
+
+    addSaturating(_stats.lateness[bucket], 1);
+#else
+    (void)curTicks;
+#endif
+  }
+
+  void recordMissed(uint16_t count = 1)
+  {
+#if TIMER_ACTION_STATS
+    addSaturating(_stats.missed, count);
+#else
+    (void)count;
+#endif
+  }
+
+  void recordCancel(bool won)
+  {
+#if TIMER_ACTION_STATS
+    addSaturating(won ? _stats.cancelsWon : _stats.cancelsLost, 1);
+#else
+    (void)won;
+#endif
+  }
+
+  bool scheduleAction(ticksExtraRange_t actionTicks, CompareAction action,
+      ticksExtraRange_t originTicks, ticksExtraRange_t periodTicks, TimerSequence *sequence,
+      TimerActionCallback cb, void *cbData, const TimerActionLink *link = nullptr);
   void tryScheduleSysRange(ticksExtraRange_t curTicks);
   bool tryProcessActionInPast(ticksExtraRange_t curTicks);
-  ticksExtraRange_t getBackdateTicks();
+  bool processLateAction(ticksExtraRange_t curTicks);
+
+  // The steps of scheduleAction() up to setting the compare, shared with
+  // armStopped()
+  void prepareAction(ticksExtraRange_t actionTicks, CompareAction action,
+      ticksExtraRange_t originTicks, ticksExtraRange_t periodTicks, TimerSequence *sequence,
+      TimerActionCallback cb, void *cbData, const TimerActionLink *link = nullptr);
+
+  // Arm this action for link from the ISR of the action before it
+  void armLink(ticksExtraRange_t actionTicks, ticksExtraRange_t originTicks,
+      const TimerActionLink *link);
+
+  // Once the compare is set, handle the action if it's late. Returns false
+  // if it missed
+  bool checkLate(ticksExtraRange_t curTicks);
+  void processPeriod(ticksExtraRange_t curTicks);
+  bool tryArmPeriod();
+  void skipMissedPeriods();
+
+  // reschedule() when the compare register can't just be rewritten. Call
+  // with interrupts disabled
+  bool rescheduleSlow(ticksExtraRange_t actionTicks);
+
+  // Pending with ticks that rescale() can't reach, in a chain, a sequence,
+  // or while something has set a fixed clock
+  bool hasFixedTicks() const;
+
+  // Move the action and origin ticks into the units of a new clock. Called
+  // by ExtTimer::reconfigure() with interrupts disabled and the timer stopped
+  void rescale(ticksExtraRange_t oldNow, ticksExtraRange_t newNow,
+    int oldCyclesPerTick, int newCyclesPerTick);
+};
+
+// One step of a chain of actions. When the action before it fires, its
+// TimerAction is armed with action, offsetTicks later, and the chain moves
+// on to next. Links can loop back on themselves, must stay alive while the
+// chain runs, and the offset must fit in the timer's counter. Every link
+// must be on the same timer as the first action. A callback runs after the
+// next link is armed, so when the link is on the same TimerAction, it sees
+// that action already pending. ExtTimer::reconfigure() refuses to change
+// the clock while a chain runs, since the offsets are in ticks.
+struct TimerActionLink
+{
+  TimerAction *timerAction;
+  ticksExtraRange_t offsetTicks;
+  CompareAction action;
+  const TimerActionLink *next;
+  TimerAction::TimerActionCallback cb;
+  void *cbData;
 };
 
 #ifdef HAVE_TCNT0
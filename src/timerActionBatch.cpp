@@ -0,0 +1,141 @@
+// Timer Action Batch
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "timerActionBatch.h"
+
+#include <util/atomic.h>
+
+#include "timerUtil.h"
+
+bool TimerActionBatch::add(TimerAction &timerAction, ticksExtraRange_t actionTicks,
+    CompareAction action, TimerAction::TimerActionCallback cb, void *cbData)
+{
+  if (_count >= TIMER_ACTION_BATCH_SIZE)
+  {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < _count; ++i)
+  {
+    if (_entries[i].timerAction == &timerAction)
+    {
+      return false;
+    }
+  }
+
+  _entries[_count++] = {&timerAction, actionTicks, action, cb, cbData};
+
+  return true;
+}
+
+bool TimerActionBatch::commit()
+{
+  if (0 == _count)
+  {
+    return true;
+  }
+
+  bool late = false;
+
+  // Work out the backdates while the clocks are still selected
+  ticksExtraRange_t backdateTicks[TIMER_ACTION_BATCH_SIZE];
+
+  for (uint8_t i = 0; i < _count; ++i)
+  {
+    backdateTicks[i] = _entries[i].timerAction->getBackdateTicks();
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    bool stopTimers = crossesTimers();
+    uint8_t timer = _entries[0].timerAction->getExtTimer()->getTimer();
+    TimerConfig config = getTimerConfig(timer);
+
+    // Hold the timers still, so nothing can match part way through and
+    // they all see the same moment
+    if (stopTimers)
+    {
+      stopAllTimersAndSynchronize();
+    }
+    else
+    {
+      setTimerClock(timer, TimerClock::None);
+    }
+
+    // One miss check for the whole batch, before any compare is touched. A
+    // compare set to the tick a stopped timer is on may not match when it
+    // starts again, so that counts as late too
+    for (uint8_t i = 0; i < _count; ++i)
+    {
+      Entry &entry = _entries[i];
+
+      ticksExtraRange_t curTicks = entry.timerAction->getExtTimer()->getFromIsr();
+      ticksExtraRange_t originTicks = curTicks - backdateTicks[i];
+
+      if (curTicks - originTicks >= entry.actionTicks - originTicks)
+      {
+        late = true;
+      }
+    }
+
+    if (!late)
+    {
+      for (uint8_t i = 0; i < _count; ++i)
+      {
+        Entry &entry = _entries[i];
+
+        entry.timerAction->armStopped(entry.actionTicks, entry.action, backdateTicks[i],
+          entry.cb, entry.cbData);
+      }
+    }
+
+    if (stopTimers)
+    {
+      startAllTimers();
+    }
+    else
+    {
+      restoreTimerConfig(timer, config);
+    }
+  }
+
+  _count = 0;
+
+  return !late;
+}
+
+void TimerActionBatch::clear()
+{
+  _count = 0;
+}
+
+uint8_t TimerActionBatch::getCount() const
+{
+  return _count;
+}
+
+bool TimerActionBatch::crossesTimers() const
+{
+  for (uint8_t i = 1; i < _count; ++i)
+  {
+    if (_entries[i].timerAction->getExtTimer() != _entries[0].timerAction->getExtTimer())
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,76 @@
+// Timer Action Batch
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TIMER_EXT_TIMER_ACTION_BATCH_H_
+#define TIMER_EXT_TIMER_ACTION_BATCH_H_
+
+#include <stdint.h>
+
+#include "timerTypes.h"
+#include "timerAction.h"
+
+// Most actions one batch can hold
+#ifndef TIMER_ACTION_BATCH_SIZE
+#define TIMER_ACTION_BATCH_SIZE 6
+#endif
+
+// Schedules actions on several channels at once. The timer is stopped
+// while the compare values and actions are set, so edges at the same tick
+// line up exactly and nothing can match part way through. When the actions
+// are on more than one timer, all the timers are stopped and their
+// prescalers synchronized while committing, which holds every timer,
+// including TIMER0, for that time.
+class TimerActionBatch
+{
+public:
+  TimerActionBatch() = default;
+
+  TimerActionBatch(const TimerActionBatch&) = delete;
+  TimerActionBatch(TimerActionBatch&&) = delete;
+  TimerActionBatch& operator=(const TimerActionBatch &) = delete;
+  TimerActionBatch& operator=(TimerActionBatch &&) = delete;
+
+  // Stage an action, with the same arguments as TimerAction::schedule().
+  // Returns false if the batch is full or already has this TimerAction
+  bool add(TimerAction &timerAction, ticksExtraRange_t actionTicks, CompareAction action,
+      TimerAction::TimerActionCallback cb = nullptr, void *cbData = nullptr);
+
+  // Schedule the staged actions and empty the batch. The time is checked
+  // once for the whole batch before any compare is set. If any action's
+  // time has passed, none of them are scheduled and it returns false
+  bool commit();
+
+  void clear();
+
+  uint8_t getCount() const;
+
+private:
+  struct Entry
+  {
+    TimerAction *timerAction;
+    ticksExtraRange_t actionTicks;
+    CompareAction action;
+    TimerAction::TimerActionCallback cb;
+    void *cbData;
+  };
+
+  bool crossesTimers() const;
+
+  Entry _entries[TIMER_ACTION_BATCH_SIZE];
+  uint8_t _count = 0;
+};
+
+#endif // TIMER_EXT_TIMER_ACTION_BATCH_H_
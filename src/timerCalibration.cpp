@@ -0,0 +1,254 @@
+// Timer Calibration
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "timerCalibration.h"
+
+#include <stddef.h>
+
+#include <avr/eeprom.h>
+
+namespace
+{
+
+struct SavedCalibration
+{
+  uint32_t cpuFrequency;
+  TimerCalibration calibration;
+  uint8_t checksum;
+};
+
+volatile ticksExtraRange_t maxLatencyTicks = 0;
+
+void onCompare(TimerAction *timerAction, void *data)
+{
+  if (TimerAction::Idle != timerAction->getState())
+  {
+    return;
+  }
+
+  ticksExtraRange_t latency = timerAction->getExtTimer()->getFromIsr() - timerAction->getActionTicks();
+
+  if (latency > maxLatencyTicks)
+  {
+    maxLatencyTicks = latency;
+  }
+}
+
+void waitForAction(TimerAction &timerAction)
+{
+  TimerAction::State state;
+
+  do
+  {
+    state = timerAction.getState();
+  } while (TimerAction::Scheduled == state || TimerAction::WaitingToSchedule == state);
+}
+
+// True if every sample with this lead time hit
+bool leadHits(TimerAction &timerAction, ticksExtraRange_t leadTicks)
+{
+  ExtTimer *extTimer = timerAction.getExtTimer();
+
+  for (uint8_t i = 0; i < TIMER_CALIBRATION_SAMPLES; ++i)
+  {
+    bool scheduled = timerAction.schedule(extTimer->get() + leadTicks, CompareAction::Nothing, onCompare);
+
+    waitForAction(timerAction);
+
+    if (!scheduled || TimerAction::MissedAction == timerAction.getState())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint16_t saturate16(uint32_t value)
+{
+  return value > UINT16_MAX ? UINT16_MAX : value;
+}
+
+uint8_t getChecksum(const SavedCalibration &saved)
+{
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&saved);
+  uint8_t sum = 0;
+
+  for (uint8_t i = 0; i < offsetof(SavedCalibration, checksum); ++i)
+  {
+    sum += bytes[i];
+  }
+
+  return ~sum;
+}
+
+} // namespace
+
+namespace TimerExtensions
+{
+
+bool calibrate(TimerAction &timerAction, TimerCalibration &calibration)
+{
+  TimerClock clock = getTimerClock(timerAction.getTimer());
+
+  if (TimerClock::None == clock)
+  {
+    return false;
+  }
+
+  uint32_t cyclesPerTick = clockCyclesPerTick(clock);
+  ticksExtraRange_t maxLeadTicks = TIMER_CALIBRATION_MAX_LEAD_CYCLES / cyclesPerTick;
+
+  // Calibration needs misses reported, and callbacks run in the ISR
+  TimerAction::LatePolicy latePolicy = timerAction.getLatePolicy();
+  bool deferredCallbacks = timerAction.getDeferredCallbacks();
+
+  timerAction.setLatePolicy(TimerAction::MissLate);
+  timerAction.setDeferredCallbacks(false);
+
+  // Double the lead time until it hits, then narrow it down between the
+  // last miss and the first hit
+  ticksExtraRange_t missLeadTicks = 0;
+  ticksExtraRange_t hitLeadTicks = 1;
+
+  bool found = true;
+
+  while (!leadHits(timerAction, hitLeadTicks))
+  {
+    missLeadTicks = hitLeadTicks;
+    hitLeadTicks *= 2;
+
+    if (hitLeadTicks > maxLeadTicks)
+    {
+      found = false;
+      break;
+    }
+  }
+
+  if (found)
+  {
+    while (hitLeadTicks - missLeadTicks > 1)
+    {
+      ticksExtraRange_t leadTicks = missLeadTicks + (hitLeadTicks - missLeadTicks) / 2;
+
+      if (leadHits(timerAction, leadTicks))
+      {
+        hitLeadTicks = leadTicks;
+      }
+      else
+      {
+        missLeadTicks = leadTicks;
+      }
+    }
+
+    // Measure the latency with plenty of lead time
+    maxLatencyTicks = 0;
+    leadHits(timerAction, 2 * hitLeadTicks);
+
+    calibration.minLeadCycles = saturate16(hitLeadTicks * cyclesPerTick);
+    calibration.maxLatencyCycles = saturate16(maxLatencyTicks * cyclesPerTick);
+  }
+
+  timerAction.setLatePolicy(latePolicy);
+  timerAction.setDeferredCallbacks(deferredCallbacks);
+
+  return found;
+}
+
+uint32_t getMinLeadTicks(const TimerCalibration &calibration, TimerClock clock)
+{
+  uint32_t cyclesPerTick = clockCyclesPerTick(clock);
+
+  if (!cyclesPerTick)
+  {
+    return 0;
+  }
+
+  // Round up, and add a tick since the timer may be about to tick when read
+  return (calibration.minLeadCycles + cyclesPerTick - 1) / cyclesPerTick + 1;
+}
+
+uint32_t getMissHorizonCycles(const TimerCalibration &calibration)
+{
+  uint32_t cycles = TIMER_CALIBRATION_HORIZON_FACTOR *
+    (static_cast<uint32_t>(calibration.minLeadCycles) + calibration.maxLatencyCycles);
+
+  // Never narrow the default, or a schedule a little later than the
+  // horizon would be taken as far in the future instead of missed
+  return cycles < TIMER_ACTION_MISS_HORIZON_CYCLES ? TIMER_ACTION_MISS_HORIZON_CYCLES : cycles;
+}
+
+uint16_t getShortLeadCycles(const TimerCalibration &calibration)
+{
+  return saturate16(static_cast<uint32_t>(calibration.minLeadCycles) + calibration.maxLatencyCycles);
+}
+
+void applyCalibration(const TimerCalibration &calibration, TimerAction &timerAction)
+{
+  timerAction.setMissHorizonCycles(getMissHorizonCycles(calibration));
+}
+
+void applyCalibration(const TimerCalibration &calibration, PulseGen &pulseGen)
+{
+  applyCalibration(calibration, *pulseGen.getTimerAction());
+  pulseGen.setShortLeadCycles(getShortLeadCycles(calibration));
+}
+
+void saveCalibration(const TimerCalibration &calibration, uint16_t address)
+{
+  SavedCalibration saved;
+
+  saved.cpuFrequency = F_CPU;
+  saved.calibration = calibration;
+  saved.checksum = getChecksum(saved);
+
+  eeprom_update_block(&saved, reinterpret_cast<void *>(address), sizeof(saved));
+}
+
+bool loadCalibration(TimerCalibration &calibration, uint16_t address)
+{
+  SavedCalibration saved;
+
+  eeprom_read_block(&saved, reinterpret_cast<const void *>(address), sizeof(saved));
+
+  if (F_CPU != saved.cpuFrequency || getChecksum(saved) != saved.checksum)
+  {
+    return false;
+  }
+
+  calibration = saved.calibration;
+
+  return true;
+}
+
+bool loadOrCalibrate(TimerAction &timerAction, TimerCalibration &calibration, uint16_t address)
+{
+  if (loadCalibration(calibration, address))
+  {
+    return true;
+  }
+
+  if (!calibrate(timerAction, calibration))
+  {
+    return false;
+  }
+
+  saveCalibration(calibration, address);
+
+  return true;
+}
+
+} // namespace TimerExtensions
@@ -0,0 +1,96 @@
+// Timer Calibration
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TIMER_EXT_TIMER_CALIBRATION_H_
+#define TIMER_EXT_TIMER_CALIBRATION_H_
+
+#include <stdint.h>
+
+#include "pulseGen.h"
+#include "timerAction.h"
+#include "timerUtil.h"
+
+// Compare matches scheduled for each lead time tried, and for the
+// latency measurement
+#ifndef TIMER_CALIBRATION_SAMPLES
+#define TIMER_CALIBRATION_SAMPLES 16
+#endif
+
+// Longest lead time tried before calibration gives up
+#ifndef TIMER_CALIBRATION_MAX_LEAD_CYCLES
+#define TIMER_CALIBRATION_MAX_LEAD_CYCLES 8192ul
+#endif
+
+// How many times the measured lead plus latency the miss horizon is set
+// to, to allow for ISRs that didn't happen to run during calibration
+#ifndef TIMER_CALIBRATION_HORIZON_FACTOR
+#define TIMER_CALIBRATION_HORIZON_FACTOR 4
+#endif
+
+// Timing measured on this board, with this build and these ISRs
+struct TimerCalibration
+{
+  // Shortest time after reading the timer that schedule() could be given
+  // without a miss
+  uint16_t minLeadCycles;
+
+  // Longest time from a compare match to its callback
+  uint16_t maxLatencyCycles;
+};
+
+namespace TimerExtensions
+{
+
+// Measure using a TimerAction whose channel nothing else is using. Its
+// timer must be running, and is most precise on TimerClock::Clk. Takes
+// interrupts, so run with the other ISRs enabled to include them. Returns
+// false if the timer isn't running, or no lead time up to
+// TIMER_CALIBRATION_MAX_LEAD_CYCLES worked
+bool calibrate(TimerAction &timerAction, TimerCalibration &calibration);
+
+// Shortest lead time to give schedule() on a timer with this clock
+uint32_t getMinLeadTicks(const TimerCalibration &calibration, TimerClock clock);
+
+// Miss horizon that covers the measured timing, and at least
+// TIMER_ACTION_MISS_HORIZON_CYCLES. The default already covers all but
+// very slow ISRs, so this only widens it when the measured timing needs it
+uint32_t getMissHorizonCycles(const TimerCalibration &calibration);
+
+// Time a short pulse's ISR needs before the start: the longest latency to
+// wake up, plus the lead to set the compare for the start
+uint16_t getShortLeadCycles(const TimerCalibration &calibration);
+
+// Set the TimerAction's miss horizon from the calibration
+void applyCalibration(const TimerCalibration &calibration, TimerAction &timerAction);
+
+// Set the PulseGen's TimerAction as above, and its short pulse lead time,
+// so scheduleShort() holds off interrupts for no longer than it needs to
+void applyCalibration(const TimerCalibration &calibration, PulseGen &pulseGen);
+
+// Store a calibration in the EEPROM at address, along with F_CPU to
+// check it against when loading
+void saveCalibration(const TimerCalibration &calibration, uint16_t address);
+
+// Returns false if nothing was saved at address, or it was saved with
+// another F_CPU
+bool loadCalibration(TimerCalibration &calibration, uint16_t address);
+
+// Load a saved calibration, or calibrate and save it if there's none
+bool loadOrCalibrate(TimerAction &timerAction, TimerCalibration &calibration, uint16_t address);
+
+} // namespace TimerExtensions
+
+#endif // TIMER_EXT_TIMER_CALIBRATION_H_
@@ -0,0 +1,125 @@
+// Timer Events
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "timerEvents.h"
+
+#include <util/atomic.h>
+
+#if TIMER_EVENT_QUEUE_SIZE
+
+static_assert(!(TIMER_EVENT_QUEUE_SIZE & (TIMER_EVENT_QUEUE_SIZE - 1)) && TIMER_EVENT_QUEUE_SIZE <= 128,
+  "TIMER_EVENT_QUEUE_SIZE must be a power of two no bigger than 128");
+
+namespace
+{
+
+constexpr uint8_t queueMask = TIMER_EVENT_QUEUE_SIZE - 1;
+
+TimerEvent queue[TIMER_EVENT_QUEUE_SIZE];
+
+// Single producer, single consumer ring. Only the push side writes head,
+// and only poll() writes tail. One-byte indexes are read and written in one
+// instruction. The slots aren't volatile, so poll() keeps the compiler from
+// moving slot reads across the index accesses
+volatile uint8_t queueHead = 0;
+volatile uint8_t queueTail = 0;
+
+volatile uint16_t droppedEventCount = 0;
+
+const TimerEvent *polledEvent = nullptr;
+
+} // namespace
+
+bool pushTimerEvent(const TimerEvent &event)
+{
+  bool pushed = false;
+
+  // ISRs don't nest, so only pushes from the main context need this to
+  // stay single producer
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    uint8_t head = queueHead;
+    uint8_t nextHead = (head + 1) & queueMask;
+
+    if (nextHead == queueTail)
+    {
+      droppedEventCount = droppedEventCount + 1;
+    }
+    else
+    {
+      queue[head] = event;
+      queueHead = nextHead;
+      pushed = true;
+    }
+  }
+
+  return pushed;
+}
+
+namespace TimerExtensions
+{
+
+uint8_t poll()
+{
+  uint8_t count = 0;
+  uint8_t tail = queueTail;
+
+  // Events raised by the callbacks wait for the next poll()
+  uint8_t head = queueHead;
+
+  // Don't read any slot before the head that covers it
+  asm volatile("" ::: "memory");
+
+  while (tail != head)
+  {
+    // Copy the event out before giving its slot back
+    TimerEvent event = queue[tail];
+
+    asm volatile("" ::: "memory");
+
+    tail = (tail + 1) & queueMask;
+    queueTail = tail;
+
+    polledEvent = &event;
+    event.dispatch(event);
+    polledEvent = nullptr;
+
+    count++;
+  }
+
+  return count;
+}
+
+const TimerEvent *getPolledEvent()
+{
+  return polledEvent;
+}
+
+uint16_t getDroppedEventCount()
+{
+  uint16_t dropped;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    dropped = droppedEventCount;
+  }
+
+  return dropped;
+}
+
+} // namespace TimerExtensions
+
+#endif // TIMER_EVENT_QUEUE_SIZE
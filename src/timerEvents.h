@@ -0,0 +1,79 @@
+// Timer Events
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TIMER_EXT_TIMER_EVENTS_H_
+#define TIMER_EXT_TIMER_EVENTS_H_
+
+#include <stdint.h>
+
+#include "timerTypes.h"
+
+// Number of slots in the deferred callback queue, which holds one less
+// event than this. Must be a power of two no bigger than 128. Set to 0 to
+// leave deferred callbacks out
+#ifndef TIMER_EVENT_QUEUE_SIZE
+#define TIMER_EVENT_QUEUE_SIZE 8
+#endif
+
+// A callback deferred from an ISR to TimerExtensions::poll()
+struct TimerEvent
+{
+  typedef void (*Dispatch)(const TimerEvent &event);
+  typedef void (*Callback)();
+
+  // Runs the source's callback
+  Dispatch dispatch;
+
+  // TimerAction or PulseGen that raised the event
+  void *source;
+
+  // The source's callback and its data when the event was raised, cast to
+  // its own type by dispatch
+  Callback callback;
+  const void *callbackData;
+
+  // State of the source when the event was raised
+  uint8_t state;
+
+  // Time the event was raised, from the source's ExtTimer
+  ticksExtraRange_t ticks;
+};
+
+#if TIMER_EVENT_QUEUE_SIZE
+
+// Queue an event. Returns false, and counts the event as dropped, if the
+// queue is full
+bool pushTimerEvent(const TimerEvent &event);
+
+namespace TimerExtensions
+{
+
+// Run the callbacks of the queued events, oldest first. Call from loop().
+// Returns the number of callbacks run
+uint8_t poll();
+
+// The event whose callback poll() is running, or nullptr. Callbacks can
+// read the state and time from here, since the source may have moved on
+const TimerEvent *getPolledEvent();
+
+// Events lost because the queue was full
+uint16_t getDroppedEventCount();
+
+} // namespace TimerExtensions
+
+#endif // TIMER_EVENT_QUEUE_SIZE
+
+#endif // TIMER_EXT_TIMER_EVENTS_H_
@@ -0,0 +1,259 @@
+// Timer Scheduler
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "timerScheduler.h"
+
+#include "util/atomic.h"
+
+namespace
+{
+
+void timerActionCallback(TimerAction *timerAction, void *data)
+{
+  TimerScheduler *scheduler = static_cast<TimerScheduler *>(data);
+
+  scheduler->processAlarms();
+}
+
+// Is a before b? Assumes they're within 2^31 ticks of each other
+bool isBefore(ticksExtraRange_t a, ticksExtraRange_t b)
+{
+  return static_cast<int32_t>(a - b) < 0;
+}
+
+} // namespace
+
+bool TimerAlarm::isPending() const
+{
+  return _pending;
+}
+
+ticksExtraRange_t TimerAlarm::getTicks() const
+{
+  return _ticks;
+}
+
+void TimerScheduler::schedule(TimerAlarm &alarm, ticksExtraRange_t ticks,
+    TimerAlarm::AlarmCallback cb, void *cbData)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    remove(alarm);
+
+    // Alarms hold ticks that ExtTimer::reconfigure() can't reach
+    _timerAction->setFixedClock(true);
+
+    alarm._ticks = ticks;
+    alarm._cb = cb;
+    alarm._cbData = cbData;
+  }
+
+  insert(alarm);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    // Only a new earliest alarm changes what the TimerAction is waiting for.
+    // If the ISR got to it first, this just schedules the same time again
+    if (_head == &alarm)
+    {
+      processAlarms();
+    }
+  }
+}
+
+bool TimerScheduler::cancel(TimerAlarm &alarm)
+{
+  bool removed;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    bool wasHead = _head == &alarm;
+
+    removed = remove(alarm);
+
+    if (wasHead)
+    {
+      processAlarms();
+    }
+  }
+
+  return removed;
+}
+
+TimerAlarm *TimerScheduler::getNextAlarm() const
+{
+  return _head;
+}
+
+uint16_t TimerScheduler::getPendingCount() const
+{
+  uint16_t count = 0;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (TimerAlarm *alarm = _head; alarm; alarm = alarm->_next)
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+TimerAction *TimerScheduler::getTimerAction() const
+{
+  return _timerAction;
+}
+
+void TimerScheduler::processAlarms()
+{
+  if (_processing)
+  {
+    // The outer call picks up any changes
+    return;
+  }
+
+  _processing = true;
+
+  ExtTimer *extTimer = _timerAction->getExtTimer();
+
+  while (_head)
+  {
+    ticksExtraRange_t now = extTimer->getFromIsr();
+
+    if (!isBefore(now, _head->_ticks))
+    {
+      runDueAlarms(now);
+      continue;
+    }
+
+    // Schedule from now, so the whole range up to the alarm counts as the future
+    _timerAction->schedule(_head->_ticks, now, timerActionCallback, this);
+
+    TimerAction::State state = _timerAction->getState();
+
+    if (TimerAction::Scheduled == state || TimerAction::WaitingToSchedule == state)
+    {
+      _processing = false;
+      return;
+    }
+
+    // The alarm came due while scheduling. Whether the late policy missed,
+    // dropped or fired the action, the callback couldn't run the alarm
+    // from in here, so go around again to run it
+  }
+
+  // Nothing left to wait for
+  if (TimerAction::Idle != _timerAction->getState()
+    && TimerAction::MissedAction != _timerAction->getState())
+  {
+    _timerAction->cancel();
+  }
+
+  _timerAction->setFixedClock(false);
+
+  _processing = false;
+}
+
+void TimerScheduler::insert(TimerAlarm &alarm)
+{
+  // Keep the list sorted, with alarms at the same time in the order they
+  // were added. Interrupts are only off for one step of the walk at a time,
+  // so ISRs can change the list between steps. link is &_head, or the
+  // _next of prev. The walk only starts over if an ISR took prev out, or
+  // moved it after this alarm, rather than whenever the list changes
+  TimerAlarm *prev = nullptr;
+  TimerAlarm **link = &_head;
+  bool inserted = false;
+
+  while (!inserted)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      if (prev && (!prev->_pending || isBefore(alarm._ticks, prev->_ticks)))
+      {
+        prev = nullptr;
+        link = &_head;
+      }
+      else if (*link && !isBefore(alarm._ticks, (*link)->_ticks))
+      {
+        prev = *link;
+        link = &prev->_next;
+      }
+      else
+      {
+        alarm._next = *link;
+        alarm._link = link;
+
+        if (alarm._next)
+        {
+          alarm._next->_link = &alarm._next;
+        }
+
+        *link = &alarm;
+        alarm._pending = true;
+
+        inserted = true;
+      }
+    }
+  }
+}
+
+bool TimerScheduler::remove(TimerAlarm &alarm)
+{
+  if (!alarm._pending)
+  {
+    return false;
+  }
+
+  // The alarm knows what points to it, so there's nothing to search
+  *alarm._link = alarm._next;
+
+  if (alarm._next)
+  {
+    alarm._next->_link = alarm._link;
+  }
+
+  alarm._next = nullptr;
+  alarm._link = nullptr;
+  alarm._pending = false;
+
+  return true;
+}
+
+void TimerScheduler::runDueAlarms(ticksExtraRange_t now)
+{
+  while (_head && !isBefore(now, _head->_ticks))
+  {
+    TimerAlarm *alarm = _head;
+
+    _head = alarm->_next;
+
+    if (_head)
+    {
+      _head->_link = &_head;
+    }
+
+    alarm->_next = nullptr;
+    alarm->_link = nullptr;
+    alarm->_pending = false;
+
+    if (alarm->_cb)
+    {
+      alarm->_cb(alarm, alarm->_cbData);
+    }
+  }
+}
@@ -0,0 +1,113 @@
+// Timer Scheduler
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TIMER_EXT_TIMER_SCHEDULER_H_
+#define TIMER_EXT_TIMER_SCHEDULER_H_
+
+#include "timerTypes.h"
+#include "timerAction.h"
+
+class TimerScheduler;
+
+// An alarm for TimerScheduler. Allocated by the caller, and must stay
+// alive while it's pending
+class TimerAlarm
+{
+public:
+  typedef void (*AlarmCallback)(TimerAlarm *alarm, void *data);
+
+  TimerAlarm() = default;
+
+  TimerAlarm(const TimerAlarm&) = delete;
+  TimerAlarm(TimerAlarm&&) = delete;
+  TimerAlarm& operator=(const TimerAlarm &) = delete;
+  TimerAlarm& operator=(TimerAlarm &&) = delete;
+
+  bool isPending() const;
+  ticksExtraRange_t getTicks() const;
+
+private:
+  friend class TimerScheduler;
+
+  ticksExtraRange_t _ticks = 0;
+
+  AlarmCallback _cb = nullptr;
+  void *_cbData = nullptr;
+
+  // Next alarm in the scheduler's list, and whatever points to this one,
+  // so it can be removed without searching. nullptr when not pending
+  TimerAlarm *_next = nullptr;
+  TimerAlarm **_link = nullptr;
+
+  volatile bool _pending = false;
+};
+
+// Runs any number of alarms on one TimerAction. Pending alarms are kept in a
+// list sorted by time, and the TimerAction is always scheduled for the
+// earliest one. When it fires, every alarm that's due is run in one pass.
+//
+// Alarm callbacks run with interrupts disabled, and may schedule or cancel
+// alarms. Alarms must be within 2^31 ticks of each other.
+//
+// Cancelling takes constant time. Scheduling walks the list to find the
+// alarm's place, but only keeps interrupts off for one step of the walk
+// at a time, so it delays other interrupts by about as long as cancelling
+// does, however many alarms are pending.
+class TimerScheduler
+{
+public:
+  explicit TimerScheduler(TimerAction &timerAction)
+    : _timerAction{&timerAction}
+  {}
+
+  TimerScheduler(const TimerScheduler&) = delete;
+  TimerScheduler(TimerScheduler&&) = delete;
+  TimerScheduler& operator=(const TimerScheduler &) = delete;
+  TimerScheduler& operator=(TimerScheduler &&) = delete;
+
+  // Call cb at ticks. Moves the alarm if it's already pending. If ticks has
+  // already passed, cb is called before this returns
+  void schedule(TimerAlarm &alarm, ticksExtraRange_t ticks,
+    TimerAlarm::AlarmCallback cb, void *cbData = nullptr);
+
+  // Returns false if the alarm wasn't pending
+  bool cancel(TimerAlarm &alarm);
+
+  // Earliest pending alarm, or nullptr if there are none
+  TimerAlarm *getNextAlarm() const;
+  uint16_t getPendingCount() const;
+
+  TimerAction *getTimerAction() const;
+
+  // Run due alarms and schedule the TimerAction for the next one. Called
+  // from the TimerAction callback
+  void processAlarms();
+
+private:
+  TimerAction *_timerAction;
+
+  TimerAlarm *_head = nullptr;
+
+  // Keeps processAlarms() from running inside itself, such as when an
+  // alarm callback schedules a new earliest alarm
+  bool _processing = false;
+
+  void insert(TimerAlarm &alarm);
+  bool remove(TimerAlarm &alarm);
+  void runDueAlarms(ticksExtraRange_t now);
+};
+
+#endif // TIMER_EXT_TIMER_SCHEDULER_H_
@@ -0,0 +1,188 @@
+// Timer Sequence
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "timerSequence.h"
+
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+bool TimerSequence::start(ticksExtraRange_t startTicks, const TimerSequenceStep *steps,
+  uint16_t count, bool loop, SequenceCallback cb, void *cbData)
+{
+  return startSteps(startTicks, steps, count, false, loop, cb, cbData);
+}
+
+bool TimerSequence::start_P(ticksExtraRange_t startTicks, const TimerSequenceStep *steps,
+  uint16_t count, bool loop, SequenceCallback cb, void *cbData)
+{
+  return startSteps(startTicks, steps, count, true, loop, cb, cbData);
+}
+
+bool TimerSequence::startSteps(ticksExtraRange_t startTicks, const TimerSequenceStep *steps,
+  uint16_t count, bool progmem, bool loop, SequenceCallback cb, void *cbData)
+{
+  if (!count)
+  {
+    return false;
+  }
+
+  // Stop anything already playing before changing the table under it
+  _timerAction->cancel();
+
+  _steps = steps;
+  _count = count;
+  _progmem = progmem;
+  _loop = loop;
+  _cb = cb;
+  _cbData = cbData;
+
+  _stepIndex = 0;
+  _loopCount = 0;
+  _missed = false;
+  _playing = true;
+
+  ticksExtraRange_t deltaTicks;
+  CompareAction action;
+
+  readStep(0, deltaTicks, action);
+
+  return _timerAction->scheduleSequence(startTicks + deltaTicks, action, deltaTicks,
+    this, timerActionCallback, this);
+}
+
+void TimerSequence::stopAfterStep()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    _loop = false;
+    _count = _stepIndex + 1;
+  }
+}
+
+bool TimerSequence::stop()
+{
+  bool stopped = false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (_playing)
+    {
+      _playing = false;
+      stopped = _timerAction->cancel();
+    }
+  }
+
+  return stopped;
+}
+
+bool TimerSequence::isPlaying() const
+{
+  return _playing;
+}
+
+bool TimerSequence::wasMissed() const
+{
+  return _missed;
+}
+
+uint16_t TimerSequence::getStepIndex() const
+{
+  uint16_t stepIndex;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    stepIndex = _stepIndex;
+  }
+
+  return stepIndex;
+}
+
+uint16_t TimerSequence::getLoopCount() const
+{
+  uint16_t loopCount;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    loopCount = _loopCount;
+  }
+
+  return loopCount;
+}
+
+TimerAction *TimerSequence::getTimerAction() const
+{
+  return _timerAction;
+}
+
+void TimerSequence::readStep(uint16_t index, ticksExtraRange_t &deltaTicks,
+  CompareAction &action) const
+{
+  const TimerSequenceStep *step = _steps + index;
+
+  if (_progmem)
+  {
+    deltaTicks = pgm_read_dword(&step->deltaTicks);
+    action = static_cast<CompareAction>(pgm_read_byte(&step->action));
+  }
+  else
+  {
+    deltaTicks = step->deltaTicks;
+    action = step->action;
+  }
+}
+
+bool TimerSequence::nextStep(ticksExtraRange_t &deltaTicks, CompareAction &action)
+{
+  uint16_t stepIndex = _stepIndex + 1;
+
+  if (stepIndex >= _count)
+  {
+    if (!_loop)
+    {
+      return false;
+    }
+
+    stepIndex = 0;
+    _loopCount = _loopCount + 1;
+  }
+
+  _stepIndex = stepIndex;
+
+  readStep(stepIndex, deltaTicks, action);
+
+  return true;
+}
+
+void TimerSequence::timerActionCallback(TimerAction *timerAction, void *data)
+{
+  TimerSequence *sequence = static_cast<TimerSequence *>(data);
+
+  TimerAction::State state = timerAction->getState();
+
+  // Called after every step, but only the end matters
+  if (TimerAction::Scheduled == state || TimerAction::WaitingToSchedule == state)
+  {
+    return;
+  }
+
+  sequence->_playing = false;
+  sequence->_missed = TimerAction::MissedAction == state;
+
+  if (sequence->_cb)
+  {
+    sequence->_cb(sequence, sequence->_cbData);
+  }
+}
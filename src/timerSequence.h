@@ -0,0 +1,109 @@
+// Timer Sequence
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TIMER_EXT_TIMER_SEQUENCE_H_
+#define TIMER_EXT_TIMER_SEQUENCE_H_
+
+#include <stdint.h>
+
+#include "timerTypes.h"
+#include "timerAction.h"
+
+// One edge of a sequence: the compare action, and the ticks since the
+// previous edge (or since the start, for the first)
+struct TimerSequenceStep
+{
+  ticksExtraRange_t deltaTicks;
+  CompareAction action;
+};
+
+// Plays a table of steps on a TimerAction. The compare interrupt moves to
+// the next step and sets up its compare as soon as each one matches, so the
+// hardware is always a step ahead. Tables can be in RAM or PROGMEM, and
+// must stay alive while they play.
+class TimerSequence
+{
+public:
+  typedef void (*SequenceCallback)(TimerSequence *sequence, void *data);
+
+  explicit TimerSequence(TimerAction &timerAction)
+    : _timerAction{&timerAction}
+  {}
+
+  TimerSequence(const TimerSequence&) = delete;
+  TimerSequence(TimerSequence&&) = delete;
+  TimerSequence& operator=(const TimerSequence &) = delete;
+  TimerSequence& operator=(TimerSequence &&) = delete;
+
+  // Play count steps, starting from startTicks. When looping, the first
+  // step comes deltaTicks after the last one. cb is called when the sequence
+  // finishes or misses a step. Returns false if the first step was missed
+  bool start(ticksExtraRange_t startTicks, const TimerSequenceStep *steps, uint16_t count,
+    bool loop = false, SequenceCallback cb = nullptr, void *cbData = nullptr);
+
+  // Same, with the table in PROGMEM
+  bool start_P(ticksExtraRange_t startTicks, const TimerSequenceStep *steps, uint16_t count,
+    bool loop = false, SequenceCallback cb = nullptr, void *cbData = nullptr);
+
+  // Stop after the step that's playing, instead of looping or going on
+  void stopAfterStep();
+
+  bool stop();
+
+  bool isPlaying() const;
+
+  // True if the sequence stopped because a step was set up too late
+  bool wasMissed() const;
+
+  // Step the TimerAction is waiting for
+  uint16_t getStepIndex() const;
+
+  // Times the sequence has gone back to the first step
+  uint16_t getLoopCount() const;
+
+  TimerAction *getTimerAction() const;
+
+private:
+  friend class TimerAction;
+
+  TimerAction *_timerAction;
+
+  const TimerSequenceStep *_steps = nullptr;
+  uint16_t _count = 0;
+  bool _progmem = false;
+  bool _loop = false;
+
+  volatile uint16_t _stepIndex = 0;
+  volatile uint16_t _loopCount = 0;
+  volatile bool _playing = false;
+  volatile bool _missed = false;
+
+  SequenceCallback _cb = nullptr;
+  void *_cbData = nullptr;
+
+  bool startSteps(ticksExtraRange_t startTicks, const TimerSequenceStep *steps, uint16_t count,
+    bool progmem, bool loop, SequenceCallback cb, void *cbData);
+
+  void readStep(uint16_t index, ticksExtraRange_t &deltaTicks, CompareAction &action) const;
+
+  // Called by the TimerAction from the compare ISR after each step. Returns
+  // false when there are no more steps
+  bool nextStep(ticksExtraRange_t &deltaTicks, CompareAction &action);
+
+  static void timerActionCallback(TimerAction *timerAction, void *data);
+};
+
+#endif // TIMER_EXT_TIMER_SEQUENCE_H_
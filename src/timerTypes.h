@@ -61,5 +61,6 @@
 typedef uint8_t  ticks8_t;
 typedef uint16_t ticks16_t;
 typedef uint32_t ticksExtraRange_t;
+typedef uint64_t ticksExtraRange64_t;
 
 #endif // TIMER_EXT_TIMER_TYPES_H_
\ No newline at end of file
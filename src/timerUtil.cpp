@@ -255,6 +255,11 @@ bool setTimerClock(uint8_t timer, TimerClock clock)
   return true;
 }
 
+bool isTimerClockSupported(uint8_t timer, TimerClock clock)
+{
+  return getTimerTCCRB(timer) && InvalidClockSelect != getClockSelectBits(timer, clock);
+}
+
 TimerClock getTimerClock(uint8_t timer)
 {
   volatile uint8_t *TCCRB = getTimerTCCRB(timer);
@@ -507,6 +512,95 @@ bool setTimerMode(uint8_t timer, TimerMode mode, TimerResolution resolution)
   }
 }
 
+bool isTimerModePwm(uint8_t timer)
+{
+  volatile uint8_t *ptccra = getTimerTCCRA(timer);
+  volatile uint8_t *ptccrb = getTimerTCCRB(timer);
+
+  if (!ptccra || !ptccrb)
+  {
+    return false;
+  }
+
+  switch (getTimerType(timer))
+  {
+    case TimerType::_8Bit:
+      // Normal and CTC are the only modes without WGM0
+      return *ptccra & _BV(WGM0_TCCRA_8BIT);
+    case TimerType::_16Bit:
+      if (*ptccra & (_BV(WGM1_TCCRA_16BIT) | _BV(WGM0_TCCRA_16BIT)))
+      {
+        return true;
+      }
+
+      // Of the rest, only PWM_PFC with ICR has WGM3 without WGM2
+      return (*ptccrb & (_BV(WGM3_TCCRB_16BIT) | _BV(WGM2_TCCRB_16BIT))) == _BV(WGM3_TCCRB_16BIT);
+    default:
+      return false;
+  }
+}
+
+ticks16_t getTimerTop(uint8_t timer, TimerResolution resolution)
+{
+  switch (resolution)
+  {
+    case TimerResolution::_8Bit:
+      return 0x00FF;
+    case TimerResolution::_9Bit:
+      return 0x01FF;
+    case TimerResolution::_10Bit:
+      return 0x03FF;
+    case TimerResolution::OCRA:
+      switch (timer)
+      {
+        case TIMER0:
+          return OCR0A;
+        case TIMER1:
+          return OCR1A;
+#ifdef OCR2A
+        case TIMER2:
+          return OCR2A;
+#endif
+#ifdef OCR3A
+        case TIMER3:
+          return OCR3A;
+#endif
+#ifdef OCR4A
+        case TIMER4:
+          return OCR4A;
+#endif
+#ifdef OCR5A
+        case TIMER5:
+          return OCR5A;
+#endif
+        default:
+          return 0;
+      }
+    case TimerResolution::ICR:
+      switch (timer)
+      {
+        case TIMER1:
+          return ICR1;
+#ifdef ICR3
+        case TIMER3:
+          return ICR3;
+#endif
+#ifdef ICR4
+        case TIMER4:
+          return ICR4;
+#endif
+#ifdef ICR5
+        case TIMER5:
+          return ICR5;
+#endif
+        default:
+          return 0;
+      }
+    default:
+      return TimerType::_16Bit == getTimerType(timer) ? UINT16_MAX : UINT8_MAX;
+  }
+}
+
 void setOutputCompareAction(int timer, CompareAction action)
 {
   volatile uint8_t *tccra = getTimerTCCRA(timer);
@@ -702,6 +796,219 @@ void setOutputCompareTicks(int timer, ticks16_t val)
   }
 }
 
+volatile uint8_t *getOutputCompareRegister(int timer)
+{
+  switch(timer)
+  {
+  	#if defined(TCCR0) && defined(COM00) && !defined(__AVR_ATmega8__)
+    case TIMER0A:
+      return reinterpret_cast<volatile uint8_t *>(&OCR0);
+    #endif
+
+    #if defined(TCCR0A) && defined(COM0A1)
+    case TIMER0A:
+      return reinterpret_cast<volatile uint8_t *>(&OCR0A);
+    #endif
+
+    #if defined(TCCR0A) && defined(COM0B1)
+    case TIMER0B:
+      return reinterpret_cast<volatile uint8_t *>(&OCR0B);
+    #endif
+
+    #if defined(TCCR1A) && defined(COM1A1)
+    case TIMER1A:
+      return reinterpret_cast<volatile uint8_t *>(&OCR1A);
+    #endif
+
+    #if defined(TCCR1A) && defined(COM1B1)
+    case TIMER1B:
+      return reinterpret_cast<volatile uint8_t *>(&OCR1B);
+    #endif
+
+    #if defined(TCCR1A) && defined(COM1C1)
+    case TIMER1C:
+      return reinterpret_cast<volatile uint8_t *>(&OCR1C);
+    #endif
+
+    #if defined(TCCR2) && defined(COM21)
+    case TIMER2:
+      return reinterpret_cast<volatile uint8_t *>(&OCR2);
+    #endif
+
+    #if defined(TCCR2A) && defined(COM2A1)
+    case TIMER2A:
+      return reinterpret_cast<volatile uint8_t *>(&OCR2A);
+    #endif
+
+    #if defined(TCCR2A) && defined(COM2B1)
+    case TIMER2B:
+      return reinterpret_cast<volatile uint8_t *>(&OCR2B);
+    #endif
+
+    #if defined(TCCR3A) && defined(COM3A1)
+    case TIMER3A:
+      return reinterpret_cast<volatile uint8_t *>(&OCR3A);
+    #endif
+
+    #if defined(TCCR3A) && defined(COM3B1)
+    case TIMER3B:
+      return reinterpret_cast<volatile uint8_t *>(&OCR3B);
+    #endif
+
+    #if defined(TCCR3A) && defined(COM3C1)
+    case TIMER3C:
+      return reinterpret_cast<volatile uint8_t *>(&OCR3C);
+    #endif
+
+    #if defined(TCCR4A)
+    case TIMER4A:
+      return reinterpret_cast<volatile uint8_t *>(&OCR4A);
+    #endif
+    
+    #if defined(TCCR4A) && defined(COM4B1)
+    case TIMER4B:
+      return reinterpret_cast<volatile uint8_t *>(&OCR4B);
+    #endif
+
+    #if defined(TCCR4A) && defined(COM4C1)
+    case TIMER4C:
+      return reinterpret_cast<volatile uint8_t *>(&OCR4C);
+    #endif
+      
+    #if defined(TCCR4C) && defined(COM4D1)
+    case TIMER4D:
+      return reinterpret_cast<volatile uint8_t *>(&OCR4D);
+    #endif
+
+            
+    #if defined(TCCR5A) && defined(COM5A1)
+    case TIMER5A:
+      return reinterpret_cast<volatile uint8_t *>(&OCR5A);
+    #endif
+
+    #if defined(TCCR5A) && defined(COM5B1)
+    case TIMER5B:
+      return reinterpret_cast<volatile uint8_t *>(&OCR5B);
+    #endif
+
+    #if defined(TCCR5A) && defined(COM5C1)
+    case TIMER5C:
+      return reinterpret_cast<volatile uint8_t *>(&OCR5C);
+    #endif
+
+    case NOT_ON_TIMER:
+    default:
+      return nullptr;
+  }
+}
+
+void forceOutputCompare(int timer)
+{
+  // Only works in non-PWM modes
+  switch(timer)
+  {
+    #if defined(TCCR0B) && defined(FOC0A)
+    case TIMER0A:
+      TCCR0B |= _BV(FOC0A);
+      break;
+    #endif
+
+    #if defined(TCCR0B) && defined(FOC0B)
+    case TIMER0B:
+      TCCR0B |= _BV(FOC0B);
+      break;
+    #endif
+
+    #if defined(TCCR1C) && defined(FOC1A)
+    case TIMER1A:
+      TCCR1C |= _BV(FOC1A);
+      break;
+    #endif
+
+    #if defined(TCCR1C) && defined(FOC1B)
+    case TIMER1B:
+      TCCR1C |= _BV(FOC1B);
+      break;
+    #endif
+
+    #if defined(TCCR1C) && defined(FOC1C)
+    case TIMER1C:
+      TCCR1C |= _BV(FOC1C);
+      break;
+    #endif
+
+    #if defined(TCCR2B) && defined(FOC2A)
+    case TIMER2A:
+      TCCR2B |= _BV(FOC2A);
+      break;
+    #endif
+
+    #if defined(TCCR2B) && defined(FOC2B)
+    case TIMER2B:
+      TCCR2B |= _BV(FOC2B);
+      break;
+    #endif
+
+    #if defined(TCCR3C) && defined(FOC3A)
+    case TIMER3A:
+      TCCR3C |= _BV(FOC3A);
+      break;
+    #endif
+
+    #if defined(TCCR3C) && defined(FOC3B)
+    case TIMER3B:
+      TCCR3C |= _BV(FOC3B);
+      break;
+    #endif
+
+    #if defined(TCCR3C) && defined(FOC3C)
+    case TIMER3C:
+      TCCR3C |= _BV(FOC3C);
+      break;
+    #endif
+
+    #if defined(TCCR4C) && defined(FOC4A)
+    case TIMER4A:
+      TCCR4C |= _BV(FOC4A);
+      break;
+    #endif
+
+    #if defined(TCCR4C) && defined(FOC4B)
+    case TIMER4B:
+      TCCR4C |= _BV(FOC4B);
+      break;
+    #endif
+
+    #if defined(TCCR4C) && defined(FOC4C)
+    case TIMER4C:
+      TCCR4C |= _BV(FOC4C);
+      break;
+    #endif
+
+    #if defined(TCCR5C) && defined(FOC5A)
+    case TIMER5A:
+      TCCR5C |= _BV(FOC5A);
+      break;
+    #endif
+
+    #if defined(TCCR5C) && defined(FOC5B)
+    case TIMER5B:
+      TCCR5C |= _BV(FOC5B);
+      break;
+    #endif
+
+    #if defined(TCCR5C) && defined(FOC5C)
+    case TIMER5C:
+      TCCR5C |= _BV(FOC5C);
+      break;
+    #endif
+
+    case NOT_ON_TIMER:
+    default:
+      break;
+  }
+}
+
 uint8_t inputCapturePinToTimer(uint8_t pin)
 {
   switch (pin)
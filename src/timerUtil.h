@@ -35,13 +35,30 @@ TimerType getTimerType(uint8_t timer);
 bool setTimerClock(uint8_t timer, TimerClock clock);
 TimerClock getTimerClock(uint8_t timer);
 
+// Whether setTimerClock() would accept the clock for the timer
+bool isTimerClockSupported(uint8_t timer, TimerClock clock);
+
 bool setTimerMode(uint8_t timer, TimerMode mode, TimerResolution resolution = TimerResolution::NA);
 
+// Whether the timer is in one of the PWM modes, where forceOutputCompare()
+// does nothing
+bool isTimerModePwm(uint8_t timer);
+
+// TOP for the given resolution, which is MAX for TimerResolution::NA
+ticks16_t getTimerTop(uint8_t timer, TimerResolution resolution);
+
 enum CompareAction : uint8_t {Nothing = 0b0, Toggle = 0b01, Clear = 0b10, Set = 0b11};
 void setOutputCompareAction(int timer, CompareAction action);
 CompareAction getOutputCompareAction(int timer);
 void setOutputCompareTicks(int timer, ticks16_t val);
 
+// Address of the low byte of the channel's OCR, for writing it directly
+// when every cycle counts. Write the high byte of 16-bit OCRs first
+volatile uint8_t *getOutputCompareRegister(int timer);
+
+// Perform the compare action now, as if the compare had matched
+void forceOutputCompare(int timer);
+
 uint8_t inputCapturePinToTimer(uint8_t pin);
 
 void setInputCaptureNoiseCancellerEnabled(uint8_t timer, bool enabled);
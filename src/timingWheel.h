@@ -0,0 +1,328 @@
+// Timing Wheel
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TIMER_EXT_TIMING_WHEEL_H_
+#define TIMER_EXT_TIMING_WHEEL_H_
+
+#include <util/atomic.h>
+
+#include "timerTypes.h"
+#include "timerAction.h"
+
+template <uint16_t slotCount, uint8_t slotTicksLog2>
+class TimingWheel;
+
+// A timeout for TimingWheel. Allocated by the caller, and must stay alive
+// while it's armed
+class TimerTimeout
+{
+public:
+  typedef void (*TimeoutCallback)(TimerTimeout *timeout, void *data);
+
+  TimerTimeout() = default;
+
+  TimerTimeout(const TimerTimeout&) = delete;
+  TimerTimeout(TimerTimeout&&) = delete;
+  TimerTimeout& operator=(const TimerTimeout &) = delete;
+  TimerTimeout& operator=(TimerTimeout &&) = delete;
+
+  bool isArmed() const
+  {
+    return _link;
+  }
+
+  ticksExtraRange_t getTicks() const
+  {
+    return _ticks;
+  }
+
+private:
+  template <uint16_t slotCount, uint8_t slotTicksLog2>
+  friend class TimingWheel;
+
+  ticksExtraRange_t _ticks = 0;
+
+  TimeoutCallback _cb = nullptr;
+  void *_cbData = nullptr;
+
+  // Doubly linked through the slot's list. _link points at whatever points
+  // to this timeout, so it can be unlinked without searching. nullptr when
+  // not armed
+  TimerTimeout *_next = nullptr;
+  TimerTimeout **_link = nullptr;
+};
+
+// Hashed timing wheel for large numbers of coarse timeouts. Arming and
+// cancelling take constant time, however many timeouts are armed.
+//
+// Time is divided into slots of 2^slotTicksLog2 ticks, and timeouts are
+// hashed into slotCount lists by the slot they fall in. A timeout fires at
+// the first slot boundary at or after its time, so it can be up to one slot
+// late. Timeouts more than slotCount slots away stay in their list for more
+// than one turn of the wheel.
+//
+// Runs on a TimerAction, which is scheduled for each slot boundary while any
+// timeout is armed. Timeout callbacks run with interrupts disabled, and may
+// arm or cancel timeouts.
+template <uint16_t slotCount, uint8_t slotTicksLog2>
+class TimingWheel
+{
+public:
+  static_assert(slotCount && !(slotCount & (slotCount - 1)), "slotCount must be a power of two");
+  static_assert(slotTicksLog2 < 31, "slots must be shorter than 2^31 ticks");
+
+  static constexpr ticksExtraRange_t slotTicks = 1UL << slotTicksLog2;
+
+  explicit TimingWheel(TimerAction &timerAction)
+    : _timerAction{&timerAction}
+  {}
+
+  TimingWheel(const TimingWheel&) = delete;
+  TimingWheel(TimingWheel&&) = delete;
+  TimingWheel& operator=(const TimingWheel &) = delete;
+  TimingWheel& operator=(TimingWheel &&) = delete;
+
+  // Call cb at the first slot boundary at or after ticks. Moves the timeout
+  // if it's already armed
+  void arm(TimerTimeout &timeout, ticksExtraRange_t ticks,
+    TimerTimeout::TimeoutCallback cb, void *cbData = nullptr)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      unlink(timeout);
+
+      // Slots are in ticks, so the clock mustn't change under them
+      _timerAction->setFixedClock(true);
+
+      // Inside a callback the wheel is still turning, even if it's empty
+      bool wasIdle = 0 == _armedCount && !_processing;
+
+      if (wasIdle)
+      {
+        // All slots are empty, so the wheel can jump ahead to now
+        ticksExtraRange_t now = _timerAction->getExtTimer()->getFromIsr();
+        _nextBoundary = ((now >> slotTicksLog2) + 1) << slotTicksLog2;
+      }
+
+      timeout._ticks = ticks;
+      timeout._cb = cb;
+      timeout._cbData = cbData;
+
+      link(timeout);
+
+      if (wasIdle)
+      {
+        processSlots();
+      }
+    }
+  }
+
+  // Returns false if the timeout wasn't armed
+  bool cancel(TimerTimeout &timeout)
+  {
+    bool cancelled;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      // The TimerAction stops itself at the next boundary if nothing is left
+      cancelled = unlink(timeout);
+    }
+
+    return cancelled;
+  }
+
+  uint16_t getArmedCount() const
+  {
+    return _armedCount;
+  }
+
+  TimerAction *getTimerAction() const
+  {
+    return _timerAction;
+  }
+
+  // Run the slots whose boundaries have passed, and schedule the TimerAction
+  // for the next boundary. Called from the TimerAction callback
+  void processSlots()
+  {
+    if (_processing)
+    {
+      // The outer call picks up any changes
+      return;
+    }
+
+    _processing = true;
+
+    ExtTimer *extTimer = _timerAction->getExtTimer();
+
+    while (_armedCount)
+    {
+      ticksExtraRange_t now = extTimer->getFromIsr();
+
+      if (!isBefore(now, _nextBoundary))
+      {
+        runSlot();
+        _nextBoundary += slotTicks;
+        continue;
+      }
+
+      _timerAction->schedule(_nextBoundary, now, timerActionCallback, this);
+
+      TimerAction::State state = _timerAction->getState();
+
+      if (TimerAction::Scheduled == state || TimerAction::WaitingToSchedule == state)
+      {
+        _processing = false;
+        return;
+      }
+
+      // The boundary passed while scheduling. Whatever the late policy did,
+      // the slot hasn't run, so go around again
+    }
+
+    // Nothing left to wait for
+    if (TimerAction::Idle != _timerAction->getState()
+      && TimerAction::MissedAction != _timerAction->getState())
+    {
+      _timerAction->cancel();
+    }
+
+    _timerAction->setFixedClock(false);
+
+    _processing = false;
+  }
+
+private:
+  TimerAction *_timerAction;
+
+  TimerTimeout *_slots[slotCount] = {};
+
+  uint16_t _armedCount = 0;
+
+  // Slot boundary that the TimerAction is waiting for. Timeouts before it
+  // run when it passes
+  ticksExtraRange_t _nextBoundary = 0;
+
+  // Keeps processSlots() from running inside itself
+  bool _processing = false;
+
+  static void timerActionCallback(TimerAction *timerAction, void *data)
+  {
+    static_cast<TimingWheel *>(data)->processSlots();
+  }
+
+  // Is a before b? Assumes they're within 2^31 ticks of each other
+  static bool isBefore(ticksExtraRange_t a, ticksExtraRange_t b)
+  {
+    return static_cast<int32_t>(a - b) < 0;
+  }
+
+  static uint16_t getSlotIndex(ticksExtraRange_t ticks)
+  {
+    return (ticks >> slotTicksLog2) & (slotCount - 1);
+  }
+
+  void link(TimerTimeout &timeout)
+  {
+    // Timeouts that should already have run go in the next slot to run. While
+    // a slot is running that's the one after it, so a callback that keeps
+    // arming its timeout in the past can't hold up the wheel
+    ticksExtraRange_t slotTime = timeout._ticks;
+    ticksExtraRange_t firstSlotTime = _processing ? _nextBoundary : _nextBoundary - slotTicks;
+
+    if (isBefore(slotTime, firstSlotTime))
+    {
+      slotTime = firstSlotTime;
+    }
+
+    TimerTimeout **head = &_slots[getSlotIndex(slotTime)];
+
+    timeout._next = *head;
+    timeout._link = head;
+
+    if (*head)
+    {
+      (*head)->_link = &timeout._next;
+    }
+
+    *head = &timeout;
+
+    _armedCount++;
+  }
+
+  bool unlink(TimerTimeout &timeout)
+  {
+    if (!timeout._link)
+    {
+      return false;
+    }
+
+    *timeout._link = timeout._next;
+
+    if (timeout._next)
+    {
+      timeout._next->_link = timeout._link;
+    }
+
+    timeout._next = nullptr;
+    timeout._link = nullptr;
+
+    _armedCount--;
+
+    return true;
+  }
+
+  void runSlot()
+  {
+    // Runs the slot ending at _nextBoundary. Takes the whole list first, so
+    // callbacks can arm and cancel anything while it runs
+    TimerTimeout **head = &_slots[getSlotIndex(_nextBoundary - slotTicks)];
+    TimerTimeout *remaining = *head;
+
+    if (!remaining)
+    {
+      return;
+    }
+
+    *head = nullptr;
+    remaining->_link = &remaining;
+
+    while (remaining)
+    {
+      TimerTimeout *timeout = remaining;
+
+      unlink(*timeout);
+
+      if (isBefore(timeout->_ticks, _nextBoundary))
+      {
+        if (timeout->_cb)
+        {
+          timeout->_cb(timeout, timeout->_cbData);
+        }
+      }
+      else
+      {
+        // Not due until a later turn of the wheel
+        link(*timeout);
+      }
+    }
+  }
+};
+
+template <uint16_t slotCount, uint8_t slotTicksLog2>
+constexpr ticksExtraRange_t TimingWheel<slotCount, slotTicksLog2>::slotTicks;
+
+#endif // TIMER_EXT_TIMING_WHEEL_H_
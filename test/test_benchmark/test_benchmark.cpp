@@ -0,0 +1,550 @@
+// Cycle-count benchmarks
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Run on a board, or under simavr with the simavr_uno environment:
+//   pio test -e simavr_uno -f test_benchmark
+// Use the simavr_uno_lock_free environment to benchmark lock-free reads
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <extTimer.h>
+#include <extTimerT.h>
+#include <tickService.h>
+#include <timerAction.h>
+#include <timerScheduler.h>
+#include <timerUtil.h>
+#include <timingWheel.h>
+
+#define MAX_MESSAGE_LEN 255
+
+char message[MAX_MESSAGE_LEN];
+
+volatile ticksExtraRange_t sink32;
+volatile ticksExtraRange64_t sink64;
+
+volatile uint16_t overflowCallbackCount;
+
+void overflowCallback()
+{
+  overflowCallbackCount++;
+}
+
+// Count the clock cycles it takes to run func, with interrupts off.
+// TIMER1 is used as the stopwatch, so it must be running at TimerClock::Clk
+template <typename Func>
+uint16_t measureCycles(Func func)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+
+  uint16_t start = TCNT1;
+  func();
+  uint16_t end = TCNT1;
+
+  SREG = oldSREG;
+
+  return end - start;
+}
+
+uint16_t measureOverhead()
+{
+  return measureCycles([](){});
+}
+
+void report(const char *name, uint16_t cycles)
+{
+  snprintf(message, MAX_MESSAGE_LEN, "%s: %u cycles", name, cycles);
+  TEST_MESSAGE(message);
+}
+
+void setUp(void) {
+  ExtTimer1.configure(TimerClock::Clk);
+  ExtTimer2.configure(TimerClock::Clk);
+}
+
+void tearDown(void) {
+}
+
+void test_get()
+{
+  uint16_t overhead = measureOverhead();
+
+  uint16_t get16Bit = measureCycles([](){ sink32 = ExtTimer1.get(); }) - overhead;
+  uint16_t get64_16Bit = measureCycles([](){ sink64 = ExtTimer1.get64(); }) - overhead;
+  uint16_t get8Bit = measureCycles([](){ sink32 = ExtTimer2.get(); }) - overhead;
+  uint16_t get64_8Bit = measureCycles([](){ sink64 = ExtTimer2.get64(); }) - overhead;
+
+  report("ExtTimer1.get()", get16Bit);
+  report("ExtTimer1.get64()", get64_16Bit);
+  report("ExtTimer2.get()", get8Bit);
+  report("ExtTimer2.get64()", get64_8Bit);
+
+  // Reading the 64-bit time shouldn't cost much more than the 32-bit time
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(2 * get16Bit, get64_16Bit);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(2 * get8Bit, get64_8Bit);
+}
+
+void test_getTemplate()
+{
+  uint16_t overhead = measureOverhead();
+
+  uint16_t getRuntime = measureCycles([](){ sink32 = ExtTimer1.get(); }) - overhead;
+  uint16_t getTemplate = measureCycles([](){ sink32 = ExtTimerT<TIMER1>::get(); }) - overhead;
+
+  report("ExtTimer1.get()", getRuntime);
+  report("ExtTimerT<TIMER1>::get()", getTemplate);
+
+  TEST_ASSERT_LESS_THAN_UINT32(getRuntime, getTemplate);
+}
+
+void test_processOverflow()
+{
+  uint16_t overhead = measureOverhead();
+
+  uint16_t runtime1 = measureCycles([](){ ExtTimer1.processOverflow(); }) - overhead;
+  uint16_t template1 = measureCycles([](){ ExtTimerT<TIMER1>::processOverflow(); }) - overhead;
+  uint16_t runtime2 = measureCycles([](){ ExtTimer2.processOverflow(); }) - overhead;
+  uint16_t template2 = measureCycles([](){ ExtTimerT<TIMER2>::processOverflow(); }) - overhead;
+
+  report("ExtTimer1.processOverflow()", runtime1);
+  report("ExtTimerT<TIMER1>::processOverflow()", template1);
+  report("ExtTimer2.processOverflow()", runtime2);
+  report("ExtTimerT<TIMER2>::processOverflow()", template2);
+
+  TEST_ASSERT_LESS_THAN_UINT32(runtime1, template1);
+  TEST_ASSERT_LESS_THAN_UINT32(runtime2, template2);
+}
+
+void test_processInterrupt()
+{
+  // Schedule an action far in the future, so processInterrupt() takes the
+  // common path of reading the time and leaving the action waiting
+  TEST_ASSERT_TRUE(TimerAction1A.schedule(ExtTimer1.get() + 1000000ul, CompareAction::Nothing));
+
+  uint16_t overhead = measureOverhead();
+
+  uint16_t withGet = measureCycles([](){
+    TimerAction1A.processInterrupt(ExtTimer1.get()); }) - overhead;
+  uint16_t withGetFromIsr = measureCycles([](){
+    TimerAction1A.processInterrupt(); }) - overhead;
+  uint16_t withTemplate = measureCycles([](){
+    TimerAction1A.processInterrupt(ExtTimerT<TIMER1>::getFromIsr()); }) - overhead;
+
+  TimerAction1A.cancel();
+
+  report("processInterrupt() with get()", withGet);
+  report("processInterrupt() with getFromIsr()", withGetFromIsr);
+  report("processInterrupt() with ExtTimerT::getFromIsr()", withTemplate);
+
+  TEST_ASSERT_LESS_THAN_UINT32(withGet, withGetFromIsr);
+  TEST_ASSERT_LESS_THAN_UINT32(withGetFromIsr, withTemplate);
+}
+
+// Count the clock cycles taken by the ISR for the given flag, from the
+// interrupt firing to returning. start() is called with interrupts off, and
+// must arrange for the flag to be set soon
+template <typename Func>
+uint16_t measureIsr(volatile uint8_t *tifr, uint8_t flag, Func start)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+
+  // Keep the Arduino millis() interrupt out of the measurement
+  uint8_t oldTimsk0 = TIMSK0;
+  TIMSK0 &= ~_BV(TOIE0);
+
+  // Measure enabling and disabling interrupts with nothing pending
+  uint16_t startTicks = TCNT1;
+  sei();
+  asm volatile("nop");
+  cli();
+  uint16_t baseline = TCNT1 - startTicks;
+
+  // Wait for the flag, with interrupts off
+  start();
+  while (!(*tifr & _BV(flag))) {}
+
+  // Now let the ISR run
+  startTicks = TCNT1;
+  sei();
+  asm volatile("nop");
+  cli();
+  uint16_t withIsr = TCNT1 - startTicks;
+
+  TIMSK0 = oldTimsk0;
+  SREG = oldSREG;
+
+  return withIsr - baseline;
+}
+
+const TimerActionLink benchmarkLink = {&TimerAction1A, 20000, CompareAction::Nothing, nullptr, nullptr, nullptr};
+
+void scheduleNextCallback(TimerAction *timerAction, void *data)
+{
+  TimerAction1A.schedule(timerAction->getActionTicks() + 20000, CompareAction::Nothing,
+    timerAction->getActionTicks());
+}
+
+void test_chain()
+{
+  // Arming the next action from a link, against scheduling it from the
+  // callback the way PulseGen does
+  uint16_t chained = measureIsr(&TIFR1, OCF1B, [](){
+    TimerAction1B.scheduleChain(ExtTimer1.getFromIsr() + 200, CompareAction::Nothing, &benchmarkLink); });
+
+  TimerAction1A.cancel();
+
+  uint16_t callback = measureIsr(&TIFR1, OCF1B, [](){
+    TimerAction1B.schedule(ExtTimer1.getFromIsr() + 200, CompareAction::Nothing, scheduleNextCallback); });
+
+  TimerAction1A.cancel();
+
+  report("chained action ISR", chained);
+  report("callback scheduled action ISR", callback);
+
+  TEST_ASSERT_LESS_THAN_UINT16(callback, chained);
+}
+
+uint16_t measureOverflowIsr(ExtTimer &extTimer, uint8_t tov)
+{
+  return measureIsr(extTimer.getTIFR(), tov, [&extTimer](){
+    extTimer.set(extTimer.getMaxSysTicks() - 32); });
+}
+
+void reportOverflowLoad(const char *name, ExtTimer &extTimer, uint8_t tov)
+{
+  static const TimerClock clocks[] = {TimerClock::Clk, TimerClock::ClkDiv8,
+    TimerClock::ClkDiv64, TimerClock::ClkDiv1024};
+
+  uint16_t isrCycles = measureOverflowIsr(extTimer, tov);
+
+  extTimer.setOverflowCallback(overflowCallback);
+  uint16_t isrCyclesWithCallback = measureOverflowIsr(extTimer, tov);
+  extTimer.setOverflowCallback(nullptr);
+
+  snprintf(message, MAX_MESSAGE_LEN, "%s overflow ISR: %u cycles, %u with callback",
+    name, isrCycles, isrCyclesWithCallback);
+  TEST_MESSAGE(message);
+
+  for (TimerClock clock : clocks)
+  {
+    uint32_t cyclesPerOverflow = (static_cast<uint32_t>(extTimer.getMaxSysTicks()) + 1)
+      * clockCyclesPerTick(clock);
+
+    // Hundredths of a percent
+    uint32_t load = static_cast<uint32_t>(isrCycles) * 10000ul / cyclesPerOverflow;
+
+    snprintf(message, MAX_MESSAGE_LEN, "%s at clock/%u: %lu.%02lu%% CPU load",
+      name, static_cast<unsigned>(clockCyclesPerTick(clock)), load / 100, load % 100);
+    TEST_MESSAGE(message);
+  }
+
+  extTimer.configure(TimerClock::Clk);
+}
+
+void test_overflowLoad()
+{
+  reportOverflowLoad("TIMER1", ExtTimer1, TOV1);
+  reportOverflowLoad("TIMER2", ExtTimer2, TOV2);
+#ifdef HAVE_TCNT3
+  reportOverflowLoad("TIMER3", ExtTimer3, TOV3);
+#endif
+#ifdef HAVE_TCNT4
+  reportOverflowLoad("TIMER4", ExtTimer4, TOV4);
+#endif
+#ifdef HAVE_TCNT5
+  reportOverflowLoad("TIMER5", ExtTimer5, TOV5);
+#endif
+}
+
+// Enough RAM for 100 alarms
+#if RAMEND > 0x900
+#define MAX_BENCHMARK_ALARMS 100
+#else
+#define MAX_BENCHMARK_ALARMS 10
+#endif
+
+TimerScheduler scheduler(TimerAction1B);
+TimerAlarm alarms[MAX_BENCHMARK_ALARMS + 1];
+
+void test_reschedule()
+{
+  uint16_t overhead = measureOverhead();
+
+  TimerAction1B.schedule(ExtTimer1.get() + 20000, CompareAction::Nothing);
+
+  // Move the deadline, as a watchdog kick would
+  uint16_t rescheduleCycles = measureCycles([](){
+    TimerAction1B.reschedule(ExtTimer1.get() + 20000);
+  }) - overhead;
+
+  uint16_t cancelScheduleCycles = measureCycles([](){
+    TimerAction1B.cancel();
+    TimerAction1B.schedule(ExtTimer1.get() + 20000, CompareAction::Nothing);
+  }) - overhead;
+
+  TimerAction1B.cancel();
+
+  report("reschedule", rescheduleCycles);
+  report("cancel and schedule", cancelScheduleCycles);
+
+  TEST_ASSERT_LESS_THAN_UINT16(cancelScheduleCycles, rescheduleCycles);
+}
+
+void emptyAlarmCallback(TimerAlarm *alarm, void *data)
+{
+}
+
+void benchmarkScheduler(uint16_t count)
+{
+  uint16_t overhead = measureOverhead();
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  // Fill the scheduler with alarms far in the future
+  for (uint16_t i = 0; i < count; i++)
+  {
+    scheduler.schedule(alarms[i], now + 1000000ul + i * 10, emptyAlarmCallback);
+  }
+
+  TimerAlarm &extra = alarms[count];
+
+  // Worst case, which walks the whole list
+  uint16_t insertLast = measureCycles([&](){
+    scheduler.schedule(extra, now + 2000000ul, emptyAlarmCallback); }) - overhead;
+  scheduler.cancel(extra);
+
+  // New earliest alarm, which reschedules the TimerAction
+  uint16_t insertFirst = measureCycles([&](){
+    scheduler.schedule(extra, now + 500000ul, emptyAlarmCallback); }) - overhead;
+
+  uint16_t cancelFirst = measureCycles([&](){ scheduler.cancel(extra); }) - overhead;
+
+  TimerAlarm &middle = alarms[count / 2];
+  uint16_t cancelMiddle = measureCycles([&](){ scheduler.cancel(middle); }) - overhead;
+
+  // Make every alarm due at the same time, then time the one ISR that runs them all
+  ticksExtraRange_t due = ExtTimer1.get() + 20000;
+
+  for (uint16_t i = 0; i < count; i++)
+  {
+    scheduler.schedule(alarms[i], due, emptyAlarmCallback);
+  }
+
+  uint16_t fire = measureIsr(ExtTimer1.getTIFR(), OCF1B, [](){});
+
+  TEST_ASSERT_EQUAL(0, scheduler.getPendingCount());
+
+  snprintf(message, MAX_MESSAGE_LEN,
+    "%u alarms: insert last %u, insert first %u, cancel first %u, cancel middle %u, fire all %u cycles",
+    count, insertLast, insertFirst, cancelFirst, cancelMiddle, fire);
+  TEST_MESSAGE(message);
+}
+
+void test_scheduler()
+{
+  benchmarkScheduler(10);
+#if MAX_BENCHMARK_ALARMS >= 100
+  benchmarkScheduler(100);
+#endif
+}
+
+// 64 slots of 1024 ticks
+TimingWheel<64, 10> wheel(TimerAction1A);
+TimerTimeout timeouts[MAX_BENCHMARK_ALARMS + 1];
+
+void emptyTimeoutCallback(TimerTimeout *timeout, void *data)
+{
+}
+
+void benchmarkWheel(uint16_t count)
+{
+  uint16_t overhead = measureOverhead();
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  // Spread the timeouts over several turns of the wheel
+  for (uint16_t i = 0; i < count; i++)
+  {
+    wheel.arm(timeouts[i], now + 1000000ul + i * 5000ul, emptyTimeoutCallback);
+  }
+
+  TimerTimeout &extra = timeouts[count];
+
+  uint16_t arm = measureCycles([&](){
+    wheel.arm(extra, now + 2000000ul, emptyTimeoutCallback); }) - overhead;
+
+  uint16_t cancel = measureCycles([&](){ wheel.cancel(extra); }) - overhead;
+
+  TimerTimeout &middle = timeouts[count / 2];
+  uint16_t cancelMiddle = measureCycles([&](){ wheel.cancel(middle); }) - overhead;
+
+  // One slot boundary, with nothing due. Timeouts for later turns of the
+  // wheel that hash to the slot are still checked
+  uint16_t slot = measureIsr(ExtTimer1.getTIFR(), OCF1A, [](){});
+
+  for (TimerTimeout &timeout : timeouts)
+  {
+    wheel.cancel(timeout);
+  }
+
+  TEST_ASSERT_EQUAL(0, wheel.getArmedCount());
+
+  snprintf(message, MAX_MESSAGE_LEN,
+    "%u timeouts: arm %u, cancel %u, cancel middle %u, slot boundary %u cycles",
+    count, arm, cancel, cancelMiddle, slot);
+  TEST_MESSAGE(message);
+}
+
+void test_timingWheel()
+{
+  // Arm and cancel shouldn't depend on the number of timeouts
+  benchmarkWheel(10);
+#if MAX_BENCHMARK_ALARMS >= 100
+  benchmarkWheel(100);
+#endif
+}
+
+// The TIMER2 compare A vector is only free when TimerAction2A's ISR is
+// left out, as in env:simavr_uno_tick_service
+#ifdef TIMER_EXT_NO_TIMER_ACTION2A_ISR
+
+volatile uint8_t tickSink;
+
+void tickHandler()
+{
+  tickSink++;
+}
+
+TICK_SERVICE_ISR(2, tickHandler)
+
+void test_tickService()
+{
+  typedef TickService<TIMER2> Service;
+
+  // One tick, with a handler that increments a byte
+  Service::begin(TimerClock::Clk, 256);
+  uint16_t perTick = measureIsr(&TIFR2, OCF2A, [](){});
+
+  // Find the shortest period that doesn't lose ticks. The main loop still
+  // gets an instruction between interrupts, so this is the limit with
+  // nothing else to do
+  uint8_t oldTimsk0 = TIMSK0;
+  TIMSK0 &= ~_BV(TOIE0);
+
+  static constexpr uint16_t runCycles = 50000;
+  uint16_t minPeriod = 0;
+
+  for (uint16_t period = 128; period >= 8; period -= 2)
+  {
+    Service::begin(TimerClock::Clk, period);
+
+    uint16_t start = TCNT1;
+    while (static_cast<uint16_t>(TCNT1 - start) < runCycles) {}
+
+    uint32_t tickCount = Service::getTickCount();
+
+    if (tickCount + 2 < runCycles / period)
+    {
+      break;
+    }
+
+    minPeriod = period;
+  }
+
+  Service::end();
+  TIMSK0 = oldTimsk0;
+
+  report("Tick service ISR", perTick);
+
+  snprintf(message, MAX_MESSAGE_LEN, "Tick service max rate: %lu Hz (every %u cycles)",
+    F_CPU / minPeriod, minPeriod);
+  TEST_MESSAGE(message);
+}
+
+#endif
+
+volatile uint8_t minLatency;
+volatile uint8_t maxLatency;
+
+void latencyCallback()
+{
+  // TIMER2 runs at the speed of the clock, so TCNT2 is the number of cycles
+  // since the overflow
+  uint8_t latency = TCNT2;
+
+  if (latency < minLatency)
+  {
+    minLatency = latency;
+  }
+
+  if (latency > maxLatency)
+  {
+    maxLatency = latency;
+  }
+}
+
+void test_isrLatency()
+{
+  // Poll the time in a tight loop and see how late the TIMER2 overflow ISR runs
+  minLatency = UINT8_MAX;
+  maxLatency = 0;
+
+  ExtTimer2.setOverflowCallback(latencyCallback);
+
+  for (uint16_t i = 0; i < 10000; i++)
+  {
+    sink32 = ExtTimer1.get();
+  }
+
+  ExtTimer2.setOverflowCallback(nullptr);
+
+#if EXT_TIMER_LOCK_FREE_READS
+  TEST_MESSAGE("Lock-free reads");
+#else
+  TEST_MESSAGE("Atomic reads");
+#endif
+
+  report("Min overflow ISR latency", minLatency);
+  report("Max overflow ISR latency", maxLatency);
+  report("Overflow ISR jitter", maxLatency - minLatency);
+}
+
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  UNITY_BEGIN();    // IMPORTANT LINE!
+
+  RUN_TEST(test_get);
+  RUN_TEST(test_getTemplate);
+  RUN_TEST(test_processOverflow);
+  RUN_TEST(test_processInterrupt);
+  RUN_TEST(test_overflowLoad);
+  RUN_TEST(test_reschedule);
+  RUN_TEST(test_chain);
+  RUN_TEST(test_scheduler);
+  RUN_TEST(test_timingWheel);
+#ifdef TIMER_EXT_NO_TIMER_ACTION2A_ISR
+  RUN_TEST(test_tickService);
+#endif
+  RUN_TEST(test_isrLatency);
+
+  UNITY_END(); // stop unit testing
+}
+
+void loop() {
+}
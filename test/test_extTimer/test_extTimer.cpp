@@ -18,6 +18,8 @@
 #include <unity.h>
 
 #include <extTimer.h>
+#include <extTimerT.h>
+#include <extTimerSnapshot.h>
 #include <timerUtil.h>
 
 #define MAX_MESSAGE_LEN 255
@@ -124,6 +126,33 @@ void test_set8Bit()
   TEST_ASSERT_FALSE(tov);
 }
 
+void test_extendPendingOverflow()
+{
+  ticksExtraRange_t overflowTicks;
+  ticksExtraRange_t overflowTicksT;
+  ticksExtraRange_t extended;
+
+  setTimerClock(TIMER2, TimerClock::ClkDiv8);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    ExtTimer2.set(0x10fa);
+
+    // Keep the overflow pending until TCNT is well into the next period
+    while (!(TIFR2 & (1 << TOV2))) {}
+    while (TCNT2 < 200) {}
+
+    overflowTicks = ExtTimer2.getOverflowTicks();
+    overflowTicksT = ExtTimerT<TIMER2>::getOverflowTicks();
+    extended = ExtTimer2.extend(250);
+  }
+
+  // TOV is read before TCNT, so a flagged overflow always counts
+  TEST_ASSERT_EQUAL_UINT32(0x1100, overflowTicks);
+  TEST_ASSERT_EQUAL_UINT32(0x1100, overflowTicksT);
+  TEST_ASSERT_EQUAL_UINT32(0x1100 + 250, extended);
+}
+
 void test_uniformIncreasing0()
 {
   test_uniformIncreasing(ExtTimer0);
@@ -231,6 +260,278 @@ void test_extTimer16()
   TEST_ASSERT_EQUAL_HEX32(0x00030000, extTimer.getOverflowTicks());
   TEST_ASSERT_EQUAL_HEX32(0x000400FF, extTimer.extend(0x00FF));
   TEST_ASSERT_EQUAL_HEX32(0x000300FF, extTimer.extendTimeInPast(0x00FF));
+
+  // ISR versions should match
+  TEST_ASSERT_EQUAL_HEX32(0x00030100, extTimer.getFromIsr());
+  TEST_ASSERT_EQUAL_HEX16(0x0100, extTimer.getSysRangeFromIsr());
+  TEST_ASSERT_EQUAL_HEX32(0x000400FF, extTimer.extendFromIsr(0x00FF));
+  TEST_ASSERT_EQUAL_HEX32(0x000300FF, extTimer.extendTimeInPastFromIsr(0x00FF));
+
+  // Test unprocessed overflow flag with the ISR versions
+  tcntl = 0x00;
+  tcnth = 0x00;
+  tifr |= 1 << tov;
+
+  TEST_ASSERT_EQUAL_HEX32(0x00040000, extTimer.getFromIsr());
+  TEST_ASSERT_EQUAL_HEX32(0x000400FF, extTimer.extendFromIsr(0x00FF));
+  TEST_ASSERT_EQUAL_HEX32(0x000300FF, extTimer.extendTimeInPastFromIsr(0x00FF));
+}
+
+void test_extTimer64()
+{
+  uint8_t tcntl = 0;
+  uint8_t tcnth = 0;
+  uint8_t timsk = 0;
+  uint8_t toie = 0;
+  uint8_t tifr = 0;
+  uint8_t tov = 0;
+  uint8_t timer = 0;
+
+  ExtTimer extTimer(&tcntl, &tcnth, &timsk, toie, &tifr, tov, timer);
+
+  // Initial state: all zeroes
+  TEST_ASSERT_EQUAL_HEX64(0, extTimer.get64());
+  TEST_ASSERT_EQUAL_HEX64(0x00000000000000FF, extTimer.extend64(0x00FF));
+  TEST_ASSERT_EQUAL_HEX64(0xFFFFFFFFFFFF00FF, extTimer.extendTimeInPast64(0x00FF));
+
+  // Start just before the 32-bit overflow ticks wrap
+  extTimer.set(0xFFFF0000);
+
+  tcntl = 0x00;
+  tcnth = 0x01;
+  tifr = 0;
+
+  TEST_ASSERT_EQUAL_HEX64(0x00000000FFFF0100, extTimer.get64());
+  TEST_ASSERT_EQUAL_HEX64(0x00000000FFFF0000, extTimer.getOverflowTicks64());
+  TEST_ASSERT_EQUAL_HEX64(0x00000001000000FF, extTimer.extend64(0x00FF));
+  TEST_ASSERT_EQUAL_HEX64(0x00000000FFFF00FF, extTimer.extendTimeInPast64(0x00FF));
+
+  // Test unprocessed overflow flag across the 32-bit boundary
+  tcntl = 0x00;
+  tcnth = 0x00;
+  tifr |= 1 << tov;
+
+  TEST_ASSERT_EQUAL_HEX64(0x0000000100000000, extTimer.get64());
+  TEST_ASSERT_EQUAL_HEX64(0x0000000100000000, extTimer.getOverflowTicks64());
+  TEST_ASSERT_EQUAL_HEX64(0x00000001000000FF, extTimer.extend64(0x00FF));
+  TEST_ASSERT_EQUAL_HEX64(0x00000000FFFF00FF, extTimer.extendTimeInPast64(0x00FF));
+
+  // Process overflow. The 32-bit time wraps, but the 64-bit time doesn't
+  tifr = 0;
+  extTimer.processOverflow();
+
+  TEST_ASSERT_EQUAL_HEX32(0x00000000, extTimer.get());
+  TEST_ASSERT_EQUAL_HEX64(0x0000000100000000, extTimer.get64());
+  TEST_ASSERT_EQUAL_HEX64(0x0000000100000000, extTimer.getOverflowTicks64());
+  TEST_ASSERT_EQUAL_HEX64(0x00000001000000FF, extTimer.extend64(0x00FF));
+  TEST_ASSERT_EQUAL_HEX64(0x00000000FFFF00FF, extTimer.extendTimeInPast64(0x00FF));
+
+  // Reset clears the upper bits too
+  extTimer.resetOverflowCount();
+
+  TEST_ASSERT_EQUAL_HEX64(0, extTimer.get64());
+}
+
+template <uint8_t timer>
+void test_template(ticksExtraRange_t expected)
+{
+  ExtTimer &extTimer = ExtTimerT<timer>::getExtTimer();
+
+  setTimerClock(timer, TimerClock::None);
+
+  extTimer.set(expected);
+
+  TEST_ASSERT_EQUAL_HEX32(expected, ExtTimerT<timer>::get());
+  TEST_ASSERT_EQUAL_HEX32(extTimer.getSysRange(), ExtTimerT<timer>::getSysRange());
+  TEST_ASSERT_EQUAL_HEX32(extTimer.getOverflowTicks(), ExtTimerT<timer>::getOverflowTicks());
+  TEST_ASSERT_EQUAL_HEX32(extTimer.extend(0x10), ExtTimerT<timer>::extend(0x10));
+  TEST_ASSERT_EQUAL_HEX32(extTimer.extendTimeInPast(0x10), ExtTimerT<timer>::extendTimeInPast(0x10));
+  TEST_ASSERT_EQUAL_HEX32(expected, ExtTimerT<timer>::getFromIsr());
+  TEST_ASSERT_EQUAL_HEX32(extTimer.extend(0x10), ExtTimerT<timer>::extendFromIsr(0x10));
+  TEST_ASSERT_EQUAL_HEX32(extTimer.extendTimeInPast(0x10), ExtTimerT<timer>::extendTimeInPastFromIsr(0x10));
+  TEST_ASSERT_EQUAL(extTimer.getMaxSysTicks(), ExtTimerT<timer>::maxSysTicks);
+
+  ExtTimerT<timer>::processOverflow();
+
+  TEST_ASSERT_EQUAL_HEX32(expected + ExtTimerT<timer>::ticksPerOverflow, extTimer.get());
+  TEST_ASSERT_EQUAL_HEX32(extTimer.get(), ExtTimerT<timer>::get());
+  TEST_ASSERT_TRUE(overflowCallbackCalled);
+
+  extTimer.configure(TimerClock::Clk);
+}
+
+void test_template1()
+{
+  test_template<TIMER1>(0xabcdef01);
+}
+
+void test_template2()
+{
+  test_template<TIMER2>(0xabcdef01);
+}
+
+void test_snapshot()
+{
+  // Start TIMER1 and TIMER2 from zero at the same time
+  stopAllTimersAndSynchronize();
+  ExtTimer1.set(0);
+  ExtTimer2.set(0);
+  startAllTimers();
+
+  delayMicroseconds(100);
+
+  ExtTimerSnapshot snapshot = takeExtTimerSnapshot();
+
+  TEST_ASSERT_EQUAL_HEX32(snapshot.timer1, snapshot.get(TIMER1));
+  TEST_ASSERT_EQUAL_HEX32(snapshot.timer2, snapshot.get(TIMER2));
+
+  // Both run at the same speed, so they agree on the low byte once
+  // corrected for read order
+  TEST_ASSERT_UINT8_WITHIN(1, static_cast<uint8_t>(snapshot.timer1),
+    static_cast<uint8_t>(snapshot.timer2));
+
+  // Overflows are counted
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(1000, snapshot.timer1);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(1000, snapshot.timer2);
+  TEST_ASSERT_UINT32_WITHIN(256, snapshot.timer1, snapshot.timer2);
+}
+
+void test_reconfigure()
+{
+  ExtTimer1.set(80000);
+
+  ticksExtraRange64_t cyclesBefore = ExtTimer1.getClockCycles64();
+
+  TEST_ASSERT_TRUE(ExtTimer1.reconfigure(TimerClock::ClkDiv8));
+
+  TEST_ASSERT_EQUAL(TimerClock::ClkDiv8, getTimerClock(TIMER1));
+
+  // Ticks are now in units of 8 clock cycles
+  TEST_ASSERT_UINT32_WITHIN(20, 10000 + 10, ExtTimer1.get());
+
+  // The clock cycles carry on without jumping
+  ticksExtraRange64_t cyclesAfter = ExtTimer1.getClockCycles64();
+  TEST_ASSERT_TRUE(cyclesAfter >= cyclesBefore);
+  TEST_ASSERT_TRUE(cyclesAfter - cyclesBefore < 500);
+
+  TEST_ASSERT_TRUE(ExtTimer1.reconfigure(TimerClock::Clk));
+
+  TEST_ASSERT_UINT32_WITHIN(500, 80000 + 250, ExtTimer1.get());
+  TEST_ASSERT_TRUE(ExtTimer1.getClockCycles64() >= cyclesAfter);
+}
+
+void test_lazyOverflow()
+{
+  TEST_ASSERT_TRUE(ExtTimer2.setLazyOverflowEnabled(true));
+  TEST_ASSERT_TRUE(ExtTimer2.getLazyOverflowEnabled());
+  TEST_ASSERT_BIT_LOW(TOIE2, TIMSK2);
+
+  ticksExtraRange_t start1 = ExtTimer1.get();
+  ticksExtraRange_t start2 = ExtTimer2.get();
+  ticksExtraRange_t prev = start2;
+
+  // TIMER2 wraps every 256 cycles, so read it much faster than that
+  for (uint16_t i = 0; i < 1000; i++)
+  {
+    ticksExtraRange_t cur = ExtTimer2.get();
+    TEST_ASSERT_TRUE(cur >= prev);
+    prev = cur;
+  }
+
+  ticksExtraRange_t elapsed2 = ExtTimer2.get() - start2;
+  ticksExtraRange_t elapsed1 = ExtTimer1.get() - start1;
+
+  // Both timers run at the clock speed, so they should agree
+  TEST_ASSERT_GREATER_THAN_UINT32(1000, elapsed2);
+  TEST_ASSERT_UINT32_WITHIN(100, elapsed1, elapsed2);
+
+  // The overflow interrupt didn't run
+  TEST_ASSERT_FALSE(overflowCallbackCalled);
+
+  TEST_ASSERT_TRUE(ExtTimer2.setLazyOverflowEnabled(false));
+  TEST_ASSERT_BIT_HIGH(TOIE2, TIMSK2);
+
+  // Switching back doesn't lose time
+  TEST_ASSERT_UINT32_WITHIN(100, ExtTimer1.get() - start1, ExtTimer2.get() - start2);
+
+#if USE_ARDUINO_TIMER0_OVERFLOW
+  TEST_ASSERT_FALSE(ExtTimer0.setLazyOverflowEnabled(true));
+#endif
+}
+
+// Check that extTimer keeps up with a timer in Normal mode at the same clock
+void test_matchesReference(ExtTimer &extTimer, ExtTimer &reference)
+{
+  ticksExtraRange_t startRef = reference.get();
+  ticksExtraRange_t start = extTimer.get();
+  ticksExtraRange_t prev = start;
+
+  for (uint16_t i = 0; i < 2000; i++)
+  {
+    ticksExtraRange_t cur = extTimer.get();
+    TEST_ASSERT_TRUE(cur >= prev);
+    prev = cur;
+  }
+
+  ticksExtraRange_t elapsed = extTimer.get() - start;
+  ticksExtraRange_t elapsedRef = reference.get() - startRef;
+
+  TEST_ASSERT_GREATER_THAN_UINT32(20000, elapsed);
+  TEST_ASSERT_UINT32_WITHIN(100, elapsedRef, elapsed);
+}
+
+void test_fastPwm()
+{
+  ICR1 = 9999;
+  TEST_ASSERT_TRUE(ExtTimer1.configure(TimerClock::Clk, TimerMode::FastPWM, TimerResolution::ICR));
+
+  test_matchesReference(ExtTimer1, ExtTimer2);
+
+  ExtTimer1.configure(TimerClock::Clk);
+
+  // A full 8-bit period isn't a custom one, so TIMER0 keeps counting
+  // overflows where millis() does
+  TEST_ASSERT_TRUE(ExtTimer0.configure(TimerClock::Clk, TimerMode::FastPWM, TimerResolution::_8Bit));
+
+  setTimerClock(TIMER0, TimerClock::None);
+  ExtTimer0.set(0xabcdef01);
+
+  TEST_ASSERT_EQUAL_UINT32(0xabcdef01, ExtTimer0.get());
+  TEST_ASSERT_EQUAL_UINT32(0xabcdef, ExtTimer0.getOverflowCount());
+#if USE_ARDUINO_TIMER0_OVERFLOW
+  TEST_ASSERT_EQUAL_UINT32(0xabcdef, timer0_overflow_count);
+#endif
+
+  ExtTimer0.configure(TimerClock::Clk);
+}
+
+void test_phaseCorrectPwm()
+{
+  ICR1 = 5000;
+  TEST_ASSERT_TRUE(ExtTimer1.configure(TimerClock::Clk, TimerMode::PWM_PC, TimerResolution::ICR));
+
+  test_matchesReference(ExtTimer1, ExtTimer2);
+
+  // Fixed TOP has no flag to tell which way the counter is going
+  TEST_ASSERT_FALSE(ExtTimer1.configure(TimerClock::Clk, TimerMode::PWM_PC, TimerResolution::_8Bit));
+
+  ExtTimer1.configure(TimerClock::Clk);
+}
+
+void test_ctc()
+{
+  OCR2A = 99;
+
+  // CTC needs lazy overflow mode
+  TEST_ASSERT_FALSE(ExtTimer2.configure(TimerClock::Clk, TimerMode::CTC, TimerResolution::OCRA));
+
+  TEST_ASSERT_TRUE(ExtTimer2.setLazyOverflowEnabled(true));
+  TEST_ASSERT_TRUE(ExtTimer2.configure(TimerClock::Clk, TimerMode::CTC, TimerResolution::OCRA));
+
+  test_matchesReference(ExtTimer2, ExtTimer1);
+
+  ExtTimer2.configure(TimerClock::Clk);
+  TEST_ASSERT_TRUE(ExtTimer2.setLazyOverflowEnabled(false));
 }
 
 void setup() {
@@ -244,9 +545,19 @@ void setup() {
   RUN_TEST(test_set);
   RUN_TEST(test_uniformIncreasing1);
   RUN_TEST(test_set8Bit);
+  RUN_TEST(test_extendPendingOverflow);
   RUN_TEST(test_uniformIncreasing0);
   RUN_TEST(test_uniformIncreasing2);
   RUN_TEST(test_extTimer16);
+  RUN_TEST(test_extTimer64);
+  RUN_TEST(test_template1);
+  RUN_TEST(test_template2);
+  RUN_TEST(test_snapshot);
+  RUN_TEST(test_reconfigure);
+  RUN_TEST(test_lazyOverflow);
+  RUN_TEST(test_fastPwm);
+  RUN_TEST(test_phaseCorrectPwm);
+  RUN_TEST(test_ctc);
 
   UNITY_END(); // stop unit testing
 }
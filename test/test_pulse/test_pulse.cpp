@@ -25,8 +25,15 @@
 
 char message[MAX_MESSAGE_LEN];
 
+#if defined(ARDUINO_AVR_MEGA2560)
+const int pin1A = 11;
+#else
+const int pin1A = 9;
+#endif
+
 void setUp(void) {
   pinMode(11, OUTPUT);
+  pinMode(pin1A, OUTPUT);
 
   setTimerClock(TIMER1, TimerClock::Clk);
   setTimerMode(TIMER1, TimerMode::Normal);
@@ -181,6 +188,210 @@ void test_pulse_missEnd()
   TEST_ASSERT_EQUAL(PulseGen::MissedEnd, pulseGen.getState());
 }
 
+void test_pulse_train()
+{
+  PulseGen pulseGen(TimerAction1A);
+
+  ticksExtraRange_t start = ExtTimer1.get() + 2000;
+
+  TEST_ASSERT_FALSE(pulseGen.scheduleTrain(start, 2000, 2000, 3));
+  TEST_ASSERT_TRUE(pulseGen.scheduleTrain(start, 500, 2000, 3));
+  TEST_ASSERT_TRUE(pulseGen.isTrainRunning());
+
+  // High during each pulse, low between them
+  for (int i = 0; i < 3; ++i)
+  {
+    ticksExtraRange_t pulseStart = start + i * 2000ul;
+
+    while (ExtTimer1.get() < pulseStart + 250) {}
+    TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(11));
+
+    while (ExtTimer1.get() < pulseStart + 1000) {}
+    TEST_ASSERT_EQUAL(LOW, digitalReadPWM(11));
+  }
+
+  while (pulseGen.getState() != PulseGen::Idle) {}
+
+  // The last pulse started exactly where the period puts it
+  TEST_ASSERT_EQUAL(3, pulseGen.getPulseCount());
+  TEST_ASSERT_EQUAL(start + 4000ul, pulseGen.getStart());
+  TEST_ASSERT_FALSE(pulseGen.isTrainRunning());
+}
+
+void test_pulse_trainStop()
+{
+  PulseGen pulseGen(TimerAction1A);
+
+  ticksExtraRange_t start = ExtTimer1.get() + 2000;
+
+  TEST_ASSERT_TRUE(pulseGen.scheduleTrain(start, 500, 2000));
+
+  while (pulseGen.getPulseCount() < 5) {}
+
+  TEST_ASSERT_TRUE(pulseGen.isTrainRunning());
+
+  // At most the pulse already scheduled runs
+  pulseGen.stopTrain();
+
+  while (pulseGen.getState() != PulseGen::Idle) {}
+
+  uint16_t pulseCount = pulseGen.getPulseCount();
+
+  TEST_ASSERT_TRUE(pulseCount == 5 || pulseCount == 6);
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(11));
+}
+
+void test_pulse_trainTiming()
+{
+  PulseGen pulseGen(TimerAction1A);
+
+  ticksExtraRange_t start = ExtTimer1.get() + 2000;
+
+  TEST_ASSERT_TRUE(pulseGen.scheduleTrain(start, 500, 2000, 3));
+
+  // During the first pulse
+  while (ExtTimer1.get() < start + 250) {}
+  TEST_ASSERT_FALSE(pulseGen.setTrainTiming(3000, 3000));
+
+  // The next pulse would start before this one ends
+  TEST_ASSERT_FALSE(pulseGen.setTrainTiming(200, 500));
+
+  TEST_ASSERT_TRUE(pulseGen.setTrainTiming(1000, 4000));
+
+  // The first pulse keeps the old width
+  while (ExtTimer1.get() < start + 750) {}
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(11));
+
+  while (pulseGen.getState() != PulseGen::Idle) {}
+
+  TEST_ASSERT_EQUAL(start + 8000ul, pulseGen.getStart());
+  TEST_ASSERT_EQUAL(start + 9000ul, pulseGen.getEnd());
+}
+
+void test_pulse_queue()
+{
+  PulseGen pulseGen(TimerAction1A);
+  PulseGenPulse queue[4];
+
+  // A queue needs room for a pulse and the gap between head and tail
+  TEST_ASSERT_FALSE(pulseGen.setQueue(queue, 1));
+  TEST_ASSERT_TRUE(pulseGen.setQueue(queue, 4));
+
+  ticksExtraRange_t start = ExtTimer1.get() + 2000;
+
+  // The first starts now, and the queue holds three more
+  for (int i = 0; i < 4; ++i)
+  {
+    ticksExtraRange_t pulseStart = start + i * 2000ul;
+
+    TEST_ASSERT_EQUAL(PulseGen::Queued, pulseGen.enqueue(pulseStart, pulseStart + 500));
+  }
+
+  TEST_ASSERT_EQUAL(3, pulseGen.getQueuedCount());
+  TEST_ASSERT_EQUAL(PulseGen::Full, pulseGen.enqueue(start + 8000, start + 8500));
+
+  // Room frees up as the pulses start
+  while (pulseGen.getQueuedCount() == 3) {}
+  TEST_ASSERT_EQUAL(PulseGen::Queued, pulseGen.enqueue(start + 8000, start + 8500));
+
+  while (pulseGen.getState() != PulseGen::Idle) {}
+
+  TEST_ASSERT_EQUAL(5, pulseGen.getPulseCount());
+  TEST_ASSERT_EQUAL(start + 8000, pulseGen.getStart());
+  TEST_ASSERT_EQUAL(0, pulseGen.getQueuedCount());
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(pin1A));
+}
+
+void test_pulse_queueMiss()
+{
+  PulseGen pulseGen(TimerAction1A);
+  PulseGenPulse queue[4];
+
+  pulseGen.setQueue(queue, 4);
+
+  ticksExtraRange_t start = ExtTimer1.get() + 2000;
+
+  // The second is long past by the time the first ends, so the third runs
+  TEST_ASSERT_EQUAL(PulseGen::Queued, pulseGen.enqueue(start, start + 500));
+  TEST_ASSERT_EQUAL(PulseGen::Queued, pulseGen.enqueue(start + 100, start + 200));
+  TEST_ASSERT_EQUAL(PulseGen::Queued, pulseGen.enqueue(start + 2000, start + 2500));
+
+  while (pulseGen.getQueuedCount() || pulseGen.getState() != PulseGen::Idle) {}
+
+  TEST_ASSERT_EQUAL(start + 2000, pulseGen.getStart());
+
+  // Nothing's running, so a missed pulse is reported straight away
+  TEST_ASSERT_EQUAL(PulseGen::Missed, pulseGen.enqueue(ExtTimer1.get() - 100, ExtTimer1.get()));
+}
+
+void test_pulse_reconfigure()
+{
+  PulseGen pulseGen(TimerAction1A);
+
+  ticksExtraRange_t start = ExtTimer1.get() + 100000;
+
+  TEST_ASSERT_TRUE(pulseGen.schedule(start, start + 2000));
+
+  // The pulse is timed in ticks of the current clock
+  TEST_ASSERT_FALSE(ExtTimer1.reconfigure(TimerClock::ClkDiv8));
+  TEST_ASSERT_EQUAL(TimerClock::Clk, getTimerClock(TIMER1));
+
+  TEST_ASSERT_TRUE(pulseGen.cancel());
+
+  TEST_ASSERT_TRUE(ExtTimer1.reconfigure(TimerClock::ClkDiv8));
+  TEST_ASSERT_TRUE(ExtTimer1.reconfigure(TimerClock::Clk));
+}
+
+void testShortPulse(TimerClock clock)
+{
+  setTimerClock(TIMER1, clock);
+
+  PulseGen pulseGen(TimerAction1A);
+
+  setOutputCompareAction(TIMER1A, CompareAction::Clear);
+  forceOutputCompare(TIMER1A);
+
+  // Watch for the edges with the pin change flag, since they're too close
+  // together to see by reading the pin
+  *digitalPinToPCMSK(pin1A) |= _BV(digitalPinToPCMSKbit(pin1A));
+  PCIFR = _BV(digitalPinToPCICRbit(pin1A));
+
+  ticksExtraRange_t width = PulseGen::getMinShortWidthTicks(clock);
+  ticksExtraRange_t start = ExtTimer1.get() + clockCyclesToTicks(4000, clock);
+
+  TEST_ASSERT_FALSE(pulseGen.scheduleShort(start, start + width - 1));
+  TEST_ASSERT_TRUE(pulseGen.scheduleShort(start, start + width));
+
+  while (pulseGen.getState() == PulseGen::ScheduledStart ||
+    pulseGen.getState() == PulseGen::ScheduledEnd) {}
+
+  uint8_t edgeTicks = pulseGen.getShortEdgeTicks();
+
+  snprintf(message, MAX_MESSAGE_LEN, "%u tick pulse at clock / %d, end set %u ticks after the start",
+    static_cast<unsigned>(width), clockCyclesPerTick(clock), edgeTicks);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_EQUAL(PulseGen::Idle, pulseGen.getState());
+  TEST_ASSERT_TRUE(PCIFR & _BV(digitalPinToPCICRbit(pin1A)));
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(pin1A));
+
+  // The end compare was set before the end, so the hardware made the pulse
+  // exactly getMinShortWidthTicks() wide. At the full clock this checks
+  // PULSE_GEN_SHORT_EDGE_CYCLES
+  TEST_ASSERT_LESS_THAN(width, edgeTicks);
+
+  *digitalPinToPCMSK(pin1A) &= ~_BV(digitalPinToPCMSKbit(pin1A));
+}
+
+void test_pulse_short()
+{
+  testShortPulse(TimerClock::Clk);
+  testShortPulse(TimerClock::ClkDiv8);
+  testShortPulse(TimerClock::ClkDiv64);
+  testShortPulse(TimerClock::ClkDiv256);
+  testShortPulse(TimerClock::ClkDiv1024);
+}
+
 void setup() {
   // NOTE!!! Wait for >2 secs
   // if board doesn't support software reset via Serial.DTR/RTS
@@ -194,6 +405,13 @@ void setup() {
   RUN_TEST(test_pulse_long);
   RUN_TEST(test_pulse_missStart);
   RUN_TEST(test_pulse_missEnd);
+  RUN_TEST(test_pulse_train);
+  RUN_TEST(test_pulse_trainStop);
+  RUN_TEST(test_pulse_trainTiming);
+  RUN_TEST(test_pulse_queue);
+  RUN_TEST(test_pulse_queueMiss);
+  RUN_TEST(test_pulse_reconfigure);
+  RUN_TEST(test_pulse_short);
 
   UNITY_END(); // stop unit testing
 }
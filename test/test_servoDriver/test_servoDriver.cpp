@@ -0,0 +1,231 @@
+// Test for ServoDriver
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <servoDriver.h>
+#include <timerUtil.h>
+
+#if defined(ARDUINO_AVR_MEGA2560)
+const int pin1A = 11;
+#else
+const int pin1A = 9;
+#endif
+
+#define MAX_MESSAGE_LEN 255
+
+char message[MAX_MESSAGE_LEN];
+
+const uint8_t servoCount = 9;
+
+// The last one is on the compare pin, and ends with the one before
+const uint8_t servoPins[servoCount] = {2, 3, 4, 5, 6, 7, 8, 12, pin1A};
+const uint16_t servoMicroseconds[servoCount] = {1800, 1000, 2200, 1400, 1200, 2000, 2400, 1600, 1600};
+
+ServoDriver *servoDriver;
+
+int digitalReadPWM(uint8_t pin)
+{
+	uint8_t bit = digitalPinToBitMask(pin);
+	uint8_t port = digitalPinToPort(pin);
+
+	if (*portInputRegister(port) & bit) return HIGH;
+	return LOW;
+}
+
+int8_t attachPin(uint8_t pin, uint16_t microseconds = 1500)
+{
+  return servoDriver->attach(portOutputRegister(digitalPinToPort(pin)),
+    digitalPinToBitMask(pin), microseconds);
+}
+
+void setUp(void) {
+  ExtTimer1.configure(TimerClock::Clk);
+
+  servoDriver = new ServoDriver(TimerAction1A);
+
+  for (uint8_t i = 0; i < servoCount - 1; ++i)
+  {
+    pinMode(servoPins[i], OUTPUT);
+    attachPin(servoPins[i], servoMicroseconds[i]);
+  }
+
+  pinMode(pin1A, OUTPUT);
+  servoDriver->attachCompareOutput(servoMicroseconds[servoCount - 1]);
+}
+
+void tearDown(void) {
+  servoDriver->end();
+  delete servoDriver;
+
+  setOutputCompareAction(TIMER1A, CompareAction::Nothing);
+}
+
+void test_edges()
+{
+  TEST_ASSERT_TRUE(servoDriver->begin());
+
+  ticksExtraRange_t frameStart = servoDriver->getFrameStart();
+
+  // Between the edges, the servos with longer pulses are still high
+  for (uint16_t checkMicroseconds = 900; checkMicroseconds < 2500; checkMicroseconds += 200)
+  {
+    ticksExtraRange_t checkTicks = frameStart + TimerAction1A.microsecondsToTicks(checkMicroseconds);
+
+    while (ExtTimer1.get() < checkTicks) {}
+
+    for (uint8_t i = 0; i < servoCount; ++i)
+    {
+      int expected = checkMicroseconds < servoMicroseconds[i] ? HIGH : LOW;
+
+      snprintf(message, MAX_MESSAGE_LEN, "servo %u at %u us", i, checkMicroseconds);
+      TEST_ASSERT_EQUAL_MESSAGE(expected, digitalReadPWM(servoPins[i]), message);
+    }
+  }
+}
+
+void test_nextFrame()
+{
+  TEST_ASSERT_TRUE(servoDriver->begin());
+
+  ticksExtraRange_t frameStart = servoDriver->getFrameStart();
+  ticksExtraRange_t frameTicks = TimerAction1A.microsecondsToTicks(SERVO_DRIVER_FRAME_MICROSECONDS);
+
+  // A new width waits for the next frame
+  while (ExtTimer1.get() < frameStart + TimerAction1A.microsecondsToTicks(100)) {}
+
+  servoDriver->writeMicroseconds(1, 2000);
+
+  while (ExtTimer1.get() < frameStart + TimerAction1A.microsecondsToTicks(1100)) {}
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(servoPins[1]));
+
+  while (ExtTimer1.get() < frameStart + frameTicks + TimerAction1A.microsecondsToTicks(1900)) {}
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(servoPins[1]));
+
+  while (ExtTimer1.get() < frameStart + frameTicks + TimerAction1A.microsecondsToTicks(2100)) {}
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(servoPins[1]));
+}
+
+void test_jitter()
+{
+  TEST_ASSERT_TRUE(servoDriver->begin());
+
+  // 10 frames
+  delay(SERVO_DRIVER_FRAME_MICROSECONDS / 100);
+
+  for (uint8_t i = 0; i < servoCount; ++i)
+  {
+    ticksExtraRange_t minRiseLateTicks = servoDriver->getMinRiseLateTicks(i);
+    ticksExtraRange_t maxRiseLateTicks = servoDriver->getMaxRiseLateTicks(i);
+    ticksExtraRange_t minLateTicks = servoDriver->getMinLateTicks(i);
+    ticksExtraRange_t maxLateTicks = servoDriver->getMaxLateTicks(i);
+
+    snprintf(message, MAX_MESSAGE_LEN,
+      "servo %u on pin %u: rise %lu to %lu ticks late, fall %lu to %lu ticks late, jitter %lu/%lu ticks",
+      i, servoPins[i], minRiseLateTicks, maxRiseLateTicks, minLateTicks, maxLateTicks,
+      maxRiseLateTicks - minRiseLateTicks, maxLateTicks - minLateTicks);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_LESS_THAN(TimerAction1A.microsecondsToTicks(100), maxRiseLateTicks);
+    TEST_ASSERT_LESS_THAN(TimerAction1A.microsecondsToTicks(100), maxLateTicks);
+  }
+
+  // The hardware edges are exact
+  TEST_ASSERT_EQUAL(0, servoDriver->getMaxRiseLateTicks(servoCount - 1));
+  TEST_ASSERT_EQUAL(0, servoDriver->getMaxLateTicks(servoCount - 1));
+}
+
+void test_attachRunning()
+{
+  TEST_ASSERT_TRUE(servoDriver->begin());
+
+  while (ExtTimer1.get() < servoDriver->getFrameStart() + TimerAction1A.microsecondsToTicks(500)) {}
+
+  // Published with its width, so the next frame comes out right
+  pinMode(13, OUTPUT);
+  int8_t index = attachPin(13, 1000);
+  TEST_ASSERT_EQUAL(servoCount, index);
+
+  ticksExtraRange_t frameStart = servoDriver->getFrameStart();
+  ticksExtraRange_t frameTicks = TimerAction1A.microsecondsToTicks(SERVO_DRIVER_FRAME_MICROSECONDS);
+
+  while (ExtTimer1.get() < frameStart + frameTicks + TimerAction1A.microsecondsToTicks(900)) {}
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(13));
+
+  while (ExtTimer1.get() < frameStart + frameTicks + TimerAction1A.microsecondsToTicks(1100)) {}
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(13));
+
+  // And the frames keep coming
+  while (ExtTimer1.get() < frameStart + 2 * frameTicks + TimerAction1A.microsecondsToTicks(100)) {}
+  TEST_ASSERT_EQUAL(frameStart + 2 * frameTicks, servoDriver->getFrameStart());
+}
+
+void test_end()
+{
+  TEST_ASSERT_TRUE(servoDriver->begin());
+  TEST_ASSERT_TRUE(servoDriver->isRunning());
+
+  while (ExtTimer1.get() < servoDriver->getFrameStart() + TimerAction1A.microsecondsToTicks(500)) {}
+
+  servoDriver->end();
+
+  TEST_ASSERT_FALSE(servoDriver->isRunning());
+  TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction1A.getState());
+
+  for (uint8_t i = 0; i < servoCount; ++i)
+  {
+    TEST_ASSERT_EQUAL(LOW, digitalReadPWM(servoPins[i]));
+  }
+}
+
+void test_limits()
+{
+  servoDriver->writeMicroseconds(0, 100);
+  TEST_ASSERT_EQUAL(SERVO_DRIVER_MIN_MICROSECONDS, servoDriver->readMicroseconds(0));
+
+  servoDriver->writeMicroseconds(0, 5000);
+  TEST_ASSERT_EQUAL(SERVO_DRIVER_MAX_MICROSECONDS, servoDriver->readMicroseconds(0));
+
+  TEST_ASSERT_EQUAL(-1, servoDriver->attachCompareOutput());
+
+  for (uint8_t i = servoCount; i < SERVO_DRIVER_MAX_SERVOS; ++i)
+  {
+    TEST_ASSERT_EQUAL(i, attachPin(13));
+  }
+
+  TEST_ASSERT_EQUAL(-1, attachPin(13));
+}
+
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  UNITY_BEGIN();    // IMPORTANT LINE!
+
+  RUN_TEST(test_edges);
+  RUN_TEST(test_nextFrame);
+  RUN_TEST(test_jitter);
+  RUN_TEST(test_attachRunning);
+  RUN_TEST(test_end);
+  RUN_TEST(test_limits);
+
+  UNITY_END(); // stop unit testing
+}
+
+void loop() {
+}
@@ -0,0 +1,120 @@
+// Tick Service tests
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <tickService.h>
+
+// Runs in env:simavr_uno_tick_service, which leaves out TimerAction2A's ISR
+typedef TickService<TIMER2> Service;
+
+volatile uint32_t handlerCount;
+volatile uint32_t lastTickCount;
+
+void handler()
+{
+  handlerCount++;
+  lastTickCount = Service::getTickCountFromIsr();
+}
+
+TICK_SERVICE_ISR(2, handler)
+
+void setUp(void) {
+  handlerCount = 0;
+}
+
+void tearDown(void) {
+  Service::end();
+}
+
+void test_rate()
+{
+  // 16 MHz / 8 / 100 = 20 kHz
+  TEST_ASSERT_TRUE(Service::begin(TimerClock::ClkDiv8, F_CPU / 8 / 20000));
+  TEST_ASSERT_EQUAL(F_CPU / 8 / 20000, Service::getPeriodTicks());
+
+  delay(10);
+
+  // 200 ticks in 10 ms, give or take the delay() slop
+  uint32_t tickCount = Service::getTickCount();
+  TEST_ASSERT_UINT32_WITHIN(25, 200, tickCount);
+
+  // The handler ran once per tick, after the count was updated
+  TEST_ASSERT_UINT32_WITHIN(1, tickCount, handlerCount);
+  TEST_ASSERT_UINT32_WITHIN(1, tickCount, lastTickCount);
+  TEST_ASSERT_TRUE(lastTickCount >= 1);
+}
+
+void test_end()
+{
+  TEST_ASSERT_TRUE(Service::begin(TimerClock::Clk, 250));
+
+  delay(2);
+
+  Service::end();
+
+  uint32_t tickCount = Service::getTickCount();
+
+  delay(2);
+
+  // Stopped, but the count is kept
+  TEST_ASSERT_EQUAL(tickCount, Service::getTickCount());
+  TEST_ASSERT_TRUE(tickCount > 0);
+  TEST_ASSERT_BIT_LOW(OCIE2A, TIMSK2);
+
+  // Back in Normal mode
+  TEST_ASSERT_EQUAL_HEX8(0, TCCR2A & (_BV(WGM21) | _BV(WGM20)));
+  TEST_ASSERT_BIT_LOW(WGM22, TCCR2B);
+}
+
+void test_restart()
+{
+  TEST_ASSERT_TRUE(Service::begin(TimerClock::Clk, 250));
+
+  delay(2);
+
+  // begin() again restarts the count
+  TEST_ASSERT_TRUE(Service::begin(TimerClock::ClkDiv8, 250));
+  TEST_ASSERT_TRUE(Service::getTickCount() <= 1);
+}
+
+void test_invalid()
+{
+  TEST_ASSERT_FALSE(Service::begin(TimerClock::Clk, 0));
+  TEST_ASSERT_FALSE(Service::begin(TimerClock::None, 250));
+
+  // TIMER2 only counts to 255
+  TEST_ASSERT_FALSE(Service::begin(TimerClock::Clk, 257));
+}
+
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  UNITY_BEGIN();    // IMPORTANT LINE!
+
+  RUN_TEST(test_rate);
+  RUN_TEST(test_end);
+  RUN_TEST(test_restart);
+  RUN_TEST(test_invalid);
+
+  UNITY_END(); // stop unit testing
+}
+
+void loop() {
+}
@@ -324,6 +324,248 @@ void test_cbMiss()
   TEST_ASSERT_EQUAL(1, cbCallCount);
 }
 
+void test_lateFire()
+{
+  timerAction->setLatePolicy(TimerAction::FireLate);
+
+  // Force the pin low
+  setOutputCompareAction(timerAction->getTimer(), CompareAction::Clear);
+  forceOutputCompare(timerAction->getTimer());
+
+  ticksExtraRange_t actionTicks = extTimer->get();
+
+  TEST_ASSERT_TRUE(timerAction->schedule(actionTicks, CompareAction::Set, cb));
+
+  TEST_ASSERT_EQUAL(TimerAction::Idle, timerAction->getState());
+  TEST_ASSERT_TRUE(timerAction->wasLate());
+  TEST_ASSERT_EQUAL(1, cbCallCount);
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin));
+
+  timerAction->setLatePolicy(TimerAction::MissLate);
+}
+
+void test_lateFirePwm()
+{
+  timerAction->setLatePolicy(TimerAction::FireLate);
+
+  // FOCnx doesn't work in PWM modes, so the action can't be performed late
+  setTimerMode(extTimer->getTimer(), TimerMode::FastPWM, TimerResolution::_8Bit);
+
+  ticksExtraRange_t actionTicks = extTimer->get();
+  bool scheduled = timerAction->schedule(actionTicks, CompareAction::Set, cb);
+
+  setTimerMode(extTimer->getTimer(), TimerMode::Normal);
+
+  TEST_ASSERT_FALSE(scheduled);
+  TEST_ASSERT_EQUAL(TimerAction::MissedAction, timerAction->getState());
+  TEST_ASSERT_TRUE(timerAction->wasLate());
+  TEST_ASSERT_EQUAL(1, cbCallCount);
+
+  timerAction->setLatePolicy(TimerAction::MissLate);
+}
+
+void test_lateDrop()
+{
+  timerAction->setLatePolicy(TimerAction::DropLate);
+
+  setOutputCompareAction(timerAction->getTimer(), CompareAction::Clear);
+  forceOutputCompare(timerAction->getTimer());
+
+  ticksExtraRange_t actionTicks = extTimer->get();
+
+  TEST_ASSERT_FALSE(timerAction->schedule(actionTicks, CompareAction::Set, cb));
+
+  TEST_ASSERT_EQUAL(TimerAction::MissedAction, timerAction->getState());
+  TEST_ASSERT_TRUE(timerAction->wasLate());
+  TEST_ASSERT_EQUAL(0, cbCallCount);
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(pin));
+
+  timerAction->setLatePolicy(TimerAction::MissLate);
+}
+
+void test_lateFireAndReport()
+{
+  timerAction->setLatePolicy(TimerAction::FireLateAndReport);
+
+  setOutputCompareAction(timerAction->getTimer(), CompareAction::Clear);
+  forceOutputCompare(timerAction->getTimer());
+
+  ticksExtraRange_t actionTicks = extTimer->get();
+
+  TEST_ASSERT_FALSE(timerAction->schedule(actionTicks, CompareAction::Set, cb));
+
+  TEST_ASSERT_EQUAL(TimerAction::MissedAction, timerAction->getState());
+  TEST_ASSERT_EQUAL(1, cbCallCount);
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin));
+
+  // An action on time clears the late flag
+  TEST_ASSERT_TRUE(timerAction->schedule(extTimer->get() + 1000ul, CompareAction::Clear));
+  TEST_ASSERT_FALSE(timerAction->wasLate());
+
+  while (TimerAction::Scheduled == timerAction->getState()) {}
+
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(pin));
+
+  timerAction->setLatePolicy(TimerAction::MissLate);
+}
+
+void test_missHorizon()
+{
+  // With the default horizon this is a miss
+  ticksExtraRange_t actionTicks = extTimer->get() - 1000ul;
+
+  timerAction->setMissHorizonCycles(500);
+
+  // Now it's far in the future
+  TEST_ASSERT_TRUE(timerAction->schedule(actionTicks, CompareAction::Set));
+  TEST_ASSERT_EQUAL(TimerAction::WaitingToSchedule, timerAction->getState());
+  TEST_ASSERT_TRUE(timerAction->cancel());
+
+  timerAction->setMissHorizonCycles(TIMER_ACTION_MISS_HORIZON_CYCLES);
+
+  actionTicks = extTimer->get() - 1000ul;
+
+  TEST_ASSERT_FALSE(timerAction->schedule(actionTicks, CompareAction::Set));
+  TEST_ASSERT_EQUAL(TimerAction::MissedAction, timerAction->getState());
+}
+
+void test_reschedule()
+{
+  setOutputCompareAction(timerAction->getTimer(), CompareAction::Clear);
+  forceOutputCompare(timerAction->getTimer());
+
+  ticksExtraRange_t startTicks = extTimer->get();
+
+  TEST_ASSERT_TRUE(timerAction->schedule(startTicks + 1000ul, CompareAction::Set, cb));
+  TEST_ASSERT_TRUE(timerAction->reschedule(startTicks + 3000ul));
+  TEST_ASSERT_EQUAL(startTicks + 3000ul, timerAction->getActionTicks());
+
+  // Not at the old time
+  while (extTimer->get() < startTicks + 2000ul) {}
+
+  TEST_ASSERT_EQUAL(TimerAction::Scheduled, timerAction->getState());
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(pin));
+
+  // At the new time, with the same action and callback
+  while (extTimer->get() < startTicks + 4000ul) {}
+
+  TEST_ASSERT_EQUAL(TimerAction::Idle, timerAction->getState());
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin));
+  TEST_ASSERT_EQUAL(1, cbCallCount);
+
+  // Nothing pending
+  TEST_ASSERT_FALSE(timerAction->reschedule(extTimer->get() + 1000ul));
+}
+
+void test_rescheduleRange()
+{
+  setOutputCompareAction(timerAction->getTimer(), CompareAction::Clear);
+  forceOutputCompare(timerAction->getTimer());
+
+  // Out of range and back
+  TEST_ASSERT_TRUE(timerAction->schedule(extTimer->get() + 1000ul, CompareAction::Set));
+  TEST_ASSERT_TRUE(timerAction->reschedule(extTimer->get() + 1000000ul));
+  TEST_ASSERT_EQUAL(TimerAction::WaitingToSchedule, timerAction->getState());
+
+  ticksExtraRange_t actionTicks = extTimer->get() + 1000ul;
+
+  TEST_ASSERT_TRUE(timerAction->reschedule(actionTicks));
+  TEST_ASSERT_EQUAL(TimerAction::Scheduled, timerAction->getState());
+
+  while (extTimer->get() < actionTicks + 1000ul) {}
+
+  TEST_ASSERT_EQUAL(TimerAction::Idle, timerAction->getState());
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin));
+}
+
+void test_rescheduleMiss()
+{
+  TEST_ASSERT_TRUE(timerAction->schedule(extTimer->get() + 1000ul, CompareAction::Set, cb));
+  TEST_ASSERT_FALSE(timerAction->reschedule(extTimer->get()));
+
+  TEST_ASSERT_EQUAL(TimerAction::MissedAction, timerAction->getState());
+  TEST_ASSERT_EQUAL(1, cbCallCount);
+}
+
+void test_rescheduleAfterMatch()
+{
+  setOutputCompareAction(timerAction->getTimer(), CompareAction::Clear);
+  forceOutputCompare(timerAction->getTimer());
+
+  noInterrupts();
+
+  ticksExtraRange_t actionTicks = extTimer->get() + 100ul;
+
+  TEST_ASSERT_TRUE(timerAction->schedule(actionTicks, CompareAction::Set, cb));
+
+  // The old time matches before the interrupt can run
+  while (extTimer->get() < actionTicks + 100ul) {}
+
+  bool successful = timerAction->reschedule(extTimer->get() + 1000ul);
+
+  interrupts();
+
+  // Too late to move, so only the old action happened
+  TEST_ASSERT_FALSE(successful);
+  TEST_ASSERT_EQUAL(TimerAction::Idle, timerAction->getState());
+  TEST_ASSERT_EQUAL(actionTicks, timerAction->getActionTicks());
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin));
+  TEST_ASSERT_EQUAL(1, cbCallCount);
+}
+
+void test_chain()
+{
+  setOutputCompareAction(timerAction->getTimer(), CompareAction::Clear);
+  forceOutputCompare(timerAction->getTimer());
+
+  // A 500 tick pulse, with the end armed straight from the ISR
+  TimerActionLink end = {timerAction, 500, CompareAction::Clear, nullptr, cb, nullptr};
+
+  ticksExtraRange_t startTicks = extTimer->get() + 1000ul;
+
+  TEST_ASSERT_TRUE(timerAction->scheduleChain(startTicks, CompareAction::Set, &end, cb));
+
+  while (extTimer->get() < startTicks + 250ul) {}
+
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin));
+  TEST_ASSERT_EQUAL(TimerAction::Scheduled, timerAction->getState());
+  TEST_ASSERT_EQUAL(startTicks + 500ul, timerAction->getActionTicks());
+
+  while (extTimer->get() < startTicks + 1000ul) {}
+
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(pin));
+  TEST_ASSERT_EQUAL(TimerAction::Idle, timerAction->getState());
+
+  // Both callbacks, though the first rearmed the same action
+  TEST_ASSERT_EQUAL(2, cbCallCount);
+}
+
+void test_chainOtherTimer()
+{
+  // Link times are in this timer's ticks, so they can't go to another
+  TimerActionLink other = {&TimerAction2B, 500, CompareAction::Nothing, nullptr, nullptr, nullptr};
+  TimerActionLink end = {timerAction, 500, CompareAction::Nothing, &other, nullptr, nullptr};
+
+  TEST_ASSERT_FALSE(timerAction->scheduleChain(extTimer->get() + 1000ul, CompareAction::Nothing, &end));
+  TEST_ASSERT_NOT_EQUAL(TimerAction::Scheduled, timerAction->getState());
+  TEST_ASSERT_NOT_EQUAL(TimerAction::WaitingToSchedule, timerAction->getState());
+}
+
+void test_chainMiss()
+{
+  // Too short to arm in time
+  TimerActionLink end = {timerAction, 1, CompareAction::Clear, nullptr, cb, nullptr};
+
+  ticksExtraRange_t startTicks = extTimer->get() + 1000ul;
+
+  TEST_ASSERT_TRUE(timerAction->scheduleChain(startTicks, CompareAction::Set, &end));
+
+  while (extTimer->get() < startTicks + 1000ul) {}
+
+  TEST_ASSERT_EQUAL(TimerAction::MissedAction, timerAction->getState());
+  TEST_ASSERT_EQUAL(1, cbCallCount);
+}
+
 void cbChained(TimerAction *timerAction, void *data)
 {
   ticksExtraRange_t actionTicks = extTimer->get() + 1000;
@@ -349,6 +591,181 @@ void test_cbChained()
   TEST_ASSERT_EQUAL(1, cbCallCount);
 }
 
+void test_reconfigure()
+{
+  TimerClock clock = getTimerClock(extTimer->getTimer());
+
+  ticksExtraRange_t originTicks = extTimer->get();
+
+  TEST_ASSERT_TRUE(timerAction->schedule(originTicks + 80000, CompareAction::Set, originTicks, cb));
+
+  // Slow the clock down by 8 times. The action should still happen at the
+  // same point in time
+  TEST_ASSERT_EQUAL(TimerAction::WaitingToSchedule, timerAction->getState());
+
+  TEST_ASSERT_TRUE(extTimer->reconfigure(TimerClock::ClkDiv8));
+
+  ticksExtraRange_t newNow = extTimer->get();
+
+  // Now close enough to be in the timer's range
+  TEST_ASSERT_EQUAL(TimerAction::Scheduled, timerAction->getState());
+  TEST_ASSERT_UINT32_WITHIN(50, newNow + 10000, timerAction->getActionTicks());
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(pin));
+
+  while (extTimer->get() - newNow < timerAction->getActionTicks() - newNow) {}
+  while (extTimer->get() - newNow <= timerAction->getActionTicks() - newNow) {}
+
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin));
+  TEST_ASSERT_EQUAL(TimerAction::Idle, timerAction->getState());
+  TEST_ASSERT_EQUAL(1, cbCallCount);
+
+  TEST_ASSERT_TRUE(extTimer->reconfigure(clock));
+}
+
+#define PERIODIC_COUNT 5
+
+volatile ticksExtraRange_t periodicTicks[PERIODIC_COUNT];
+volatile ticksExtraRange_t periodicStallTicks;
+
+void periodicCb(TimerAction *timerAction, void *data)
+{
+  if (cbCallCount < PERIODIC_COUNT)
+  {
+    periodicTicks[cbCallCount] = timerAction->getActionTicks();
+  }
+
+  cbCallCount++;
+
+  if (cbCallCount >= PERIODIC_COUNT)
+  {
+    timerAction->cancel();
+  }
+}
+
+void test_periodic()
+{
+  ticksExtraRange_t period = 2000;
+  ticksExtraRange_t firstTicks = extTimer->get() + 1000;
+
+  TEST_ASSERT_TRUE(timerAction->schedulePeriodic(firstTicks, period, periodicCb));
+  TEST_ASSERT_EQUAL(period, timerAction->getPeriodTicks());
+
+  while (extTimer->get() - firstTicks < period * PERIODIC_COUNT) {}
+
+  TEST_ASSERT_EQUAL(PERIODIC_COUNT, cbCallCount);
+  TEST_ASSERT_EQUAL(0, timerAction->getMissedPeriods());
+  TEST_ASSERT_EQUAL(0, timerAction->getPeriodTicks());
+
+  // Each period is exactly one period after the last, whatever the latency
+  for (uint8_t i = 0; i < PERIODIC_COUNT; i++)
+  {
+    TEST_ASSERT_EQUAL(firstTicks + period * (i + 1), periodicTicks[i]);
+  }
+}
+
+void stallCb(TimerAction *timerAction, void *data)
+{
+  periodicCb(timerAction, data);
+
+  // Hold up the first interrupt for a bit over two periods
+  if (1 == cbCallCount)
+  {
+    while (extTimer->getFromIsr() - periodicStallTicks < 2500) {}
+  }
+}
+
+void scheduleStalled(TimerAction::MissedPeriodPolicy policy)
+{
+  periodicStallTicks = extTimer->get() + 1000;
+
+  TEST_ASSERT_TRUE(timerAction->schedulePeriodic(periodicStallTicks, 1000, stallCb, nullptr, policy));
+
+  while (extTimer->get() - periodicStallTicks < 1000ul * (PERIODIC_COUNT + 3)) {}
+}
+
+void test_periodicSkip()
+{
+  scheduleStalled(TimerAction::SkipMissed);
+
+  // The compare for the second period happened during the stall, but the
+  // third was set too late and is skipped
+  TEST_ASSERT_EQUAL(PERIODIC_COUNT, cbCallCount);
+  TEST_ASSERT_EQUAL(1, timerAction->getMissedPeriods());
+  TEST_ASSERT_EQUAL(periodicStallTicks + 3000, periodicTicks[1]);
+}
+
+void test_periodicCatchUp()
+{
+  scheduleStalled(TimerAction::CatchUpMissed);
+
+  // The missed period gets its callback late, but none are lost
+  TEST_ASSERT_EQUAL(PERIODIC_COUNT, cbCallCount);
+  TEST_ASSERT_EQUAL(1, timerAction->getMissedPeriods());
+
+  for (uint8_t i = 0; i < PERIODIC_COUNT; i++)
+  {
+    TEST_ASSERT_EQUAL(periodicStallTicks + 1000ul * (i + 1), periodicTicks[i]);
+  }
+}
+
+void test_periodicReport()
+{
+  scheduleStalled(TimerAction::ReportMissed);
+
+  // Stops at the first missed period, with one more callback to report it
+  TEST_ASSERT_EQUAL(3, cbCallCount);
+  TEST_ASSERT_EQUAL(1, timerAction->getMissedPeriods());
+  TEST_ASSERT_EQUAL(TimerAction::MissedAction, timerAction->getState());
+}
+
+#if TIMER_ACTION_STATS
+void test_stats()
+{
+  timerAction->resetStats();
+
+  // Fired, with the interrupt a little late
+  ticksExtraRange_t actionTicks = extTimer->get() + 1000;
+  TEST_ASSERT_TRUE(timerAction->schedule(actionTicks, CompareAction::Nothing, cb));
+  while (static_cast<int32_t>(extTimer->get() - (actionTicks + 500)) < 0) {}
+
+  // Missed
+  TEST_ASSERT_FALSE(timerAction->schedule(extTimer->get(), CompareAction::Nothing, cb));
+
+  // Cancel won
+  TEST_ASSERT_TRUE(timerAction->schedule(extTimer->get() + 1000, CompareAction::Nothing));
+  TEST_ASSERT_TRUE(timerAction->cancel());
+
+  // Cancel lost: the compare matches with interrupts off
+  noInterrupts();
+  TEST_ASSERT_TRUE(timerAction->schedule(extTimer->get() + 100, CompareAction::Nothing));
+  ticksExtraRange_t lostTicks = extTimer->getFromIsr() + 200;
+  while (static_cast<int32_t>(extTimer->getFromIsr() - lostTicks) < 0) {}
+  TEST_ASSERT_FALSE(timerAction->cancel());
+  interrupts();
+
+  TimerActionStats stats = timerAction->getStats();
+
+  TEST_ASSERT_EQUAL(1, stats.fired);
+  TEST_ASSERT_EQUAL(1, stats.missed);
+  TEST_ASSERT_EQUAL(1, stats.cancelsWon);
+  TEST_ASSERT_EQUAL(1, stats.cancelsLost);
+
+  // The one fired action landed in one bucket, no later than the max
+  uint16_t total = 0;
+
+  for (uint16_t count : stats.lateness)
+  {
+    total += count;
+  }
+
+  TEST_ASSERT_EQUAL(1, total);
+  TEST_ASSERT_TRUE(stats.maxLateness < 500);
+
+  timerAction->resetStats();
+  TEST_ASSERT_EQUAL(0, timerAction->getStats().fired);
+}
+#endif // TIMER_ACTION_STATS
+
 void setup() {
   // NOTE!!! Wait for >2 secs
   // if board doesn't support software reset via Serial.DTR/RTS
@@ -381,6 +798,26 @@ void setup() {
   RUN_TEST(test_cb);
   RUN_TEST(test_cbMiss);
   RUN_TEST(test_cbChained);
+  RUN_TEST(test_reconfigure);
+  RUN_TEST(test_periodic);
+  RUN_TEST(test_periodicSkip);
+  RUN_TEST(test_periodicCatchUp);
+  RUN_TEST(test_periodicReport);
+  RUN_TEST(test_lateFire);
+  RUN_TEST(test_lateFirePwm);
+  RUN_TEST(test_lateDrop);
+  RUN_TEST(test_lateFireAndReport);
+  RUN_TEST(test_missHorizon);
+  RUN_TEST(test_reschedule);
+  RUN_TEST(test_rescheduleRange);
+  RUN_TEST(test_rescheduleMiss);
+  RUN_TEST(test_rescheduleAfterMatch);
+  RUN_TEST(test_chain);
+  RUN_TEST(test_chainMiss);
+  RUN_TEST(test_chainOtherTimer);
+#if TIMER_ACTION_STATS
+  RUN_TEST(test_stats);
+#endif
 
 #if defined(ARDUINO_AVR_MEGA2560)
   pin = 13;
@@ -0,0 +1,204 @@
+// Test for TimerActionBatch
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <timerAction.h>
+#include <timerActionBatch.h>
+#include <timerUtil.h>
+
+#if defined(ARDUINO_AVR_MEGA2560)
+const int pin1A = 11;
+const int pin1B = 12;
+const int pin2B = 9;
+#else
+const int pin1A = 9;
+const int pin1B = 10;
+const int pin2B = 3;
+#endif
+
+TimerActionBatch batch;
+
+int digitalReadPWM(uint8_t pin)
+{
+	uint8_t bit = digitalPinToBitMask(pin);
+	uint8_t port = digitalPinToPort(pin);
+
+	if (*portInputRegister(port) & bit) return HIGH;
+	return LOW;
+}
+
+void waitForActions()
+{
+  while (TimerAction::Scheduled == TimerAction1A.getState() ||
+    TimerAction::Scheduled == TimerAction1B.getState() ||
+    TimerAction::Scheduled == TimerAction2B.getState()) {}
+}
+
+void setUp(void) {
+  ExtTimer1.configure(TimerClock::Clk);
+  ExtTimer2.configure(TimerClock::Clk);
+
+  pinMode(pin1A, OUTPUT);
+  pinMode(pin1B, OUTPUT);
+  pinMode(pin2B, OUTPUT);
+
+  // Start with the pins low
+  setOutputCompareAction(TIMER1A, CompareAction::Clear);
+  setOutputCompareAction(TIMER1B, CompareAction::Clear);
+  setOutputCompareAction(TIMER2B, CompareAction::Clear);
+  forceOutputCompare(TIMER1A);
+  forceOutputCompare(TIMER1B);
+  forceOutputCompare(TIMER2B);
+
+  batch.clear();
+}
+
+void tearDown(void) {
+  setOutputCompareAction(TIMER1A, CompareAction::Nothing);
+  setOutputCompareAction(TIMER1B, CompareAction::Nothing);
+  setOutputCompareAction(TIMER2B, CompareAction::Nothing);
+}
+
+void test_sameTimer()
+{
+  ticksExtraRange_t actionTicks = ExtTimer1.get() + 1000;
+
+  TEST_ASSERT_TRUE(batch.add(TimerAction1A, actionTicks, CompareAction::Set));
+  TEST_ASSERT_TRUE(batch.add(TimerAction1B, actionTicks, CompareAction::Set));
+  TEST_ASSERT_EQUAL(2, batch.getCount());
+
+  TEST_ASSERT_TRUE(batch.commit());
+  TEST_ASSERT_EQUAL(0, batch.getCount());
+
+  TEST_ASSERT_EQUAL(TimerAction::Scheduled, TimerAction1A.getState());
+  TEST_ASSERT_EQUAL(TimerAction::Scheduled, TimerAction1B.getState());
+
+  // Both edges on the same compare match
+  while (!(TIFR1 & (_BV(OCF1A) | _BV(OCF1B))) && TimerAction::Scheduled == TimerAction1A.getState()) {}
+
+  TEST_ASSERT_EQUAL(digitalReadPWM(pin1A), digitalReadPWM(pin1B));
+
+  waitForActions();
+
+  TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction1A.getState());
+  TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction1B.getState());
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin1A));
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin1B));
+}
+
+void test_crossTimers()
+{
+  // Both timers run on the CPU clock, so holding them still gives times
+  // for the same moment on each
+  noInterrupts();
+  stopAllTimersAndSynchronize();
+
+  ticksExtraRange_t ticks1 = ExtTimer1.getFromIsr() + 200;
+  ticksExtraRange_t ticks2 = ExtTimer2.getFromIsr() + 200;
+
+  bool added = batch.add(TimerAction1A, ticks1, CompareAction::Set)
+    && batch.add(TimerAction2B, ticks2, CompareAction::Set);
+
+  // Starts the timers again
+  bool committed = batch.commit();
+
+  // Both edges on the same clock
+  while (!(TIFR1 & _BV(OCF1A)) && !(TIFR2 & _BV(OCF2B))) {}
+
+  uint8_t tifr1 = TIFR1;
+  uint8_t tifr2 = TIFR2;
+
+  interrupts();
+
+  TEST_ASSERT_TRUE(added);
+  TEST_ASSERT_TRUE(committed);
+  TEST_ASSERT_BIT_HIGH(OCF1A, tifr1);
+  TEST_ASSERT_BIT_HIGH(OCF2B, tifr2);
+
+  waitForActions();
+
+  TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction1A.getState());
+  TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction2B.getState());
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin1A));
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(pin2B));
+}
+
+void test_late()
+{
+  TEST_ASSERT_TRUE(batch.add(TimerAction1A, ExtTimer1.get() - 10, CompareAction::Set));
+  TEST_ASSERT_TRUE(batch.add(TimerAction1B, ExtTimer1.get() + 1000, CompareAction::Set));
+
+  TEST_ASSERT_FALSE(batch.commit());
+
+  // One late action means none are scheduled
+  TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction1A.getState());
+  TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction1B.getState());
+  TEST_ASSERT_EQUAL(0, batch.getCount());
+
+  delayMicroseconds(100);
+
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(pin1A));
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(pin1B));
+}
+
+void test_duplicate()
+{
+  TEST_ASSERT_TRUE(batch.add(TimerAction1A, 0, CompareAction::Set));
+  TEST_ASSERT_FALSE(batch.add(TimerAction1A, 0, CompareAction::Clear));
+  TEST_ASSERT_EQUAL(1, batch.getCount());
+
+  batch.clear();
+}
+
+void test_full()
+{
+  TimerAction *timerActions[] = {&TimerAction0A, &TimerAction0B, &TimerAction1A,
+    &TimerAction1B, &TimerAction2A, &TimerAction2B};
+
+  static_assert(TIMER_ACTION_BATCH_SIZE <= sizeof(timerActions) / sizeof(timerActions[0]),
+    "Not enough TimerActions to fill the batch");
+
+  for (uint8_t i = 0; i < TIMER_ACTION_BATCH_SIZE; ++i)
+  {
+    TEST_ASSERT_TRUE(batch.add(*timerActions[i], 0, CompareAction::Set));
+  }
+
+  TEST_ASSERT_FALSE(batch.add(TimerAction1A, 0, CompareAction::Set));
+
+  batch.clear();
+  TEST_ASSERT_EQUAL(0, batch.getCount());
+}
+
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  UNITY_BEGIN();    // IMPORTANT LINE!
+
+  RUN_TEST(test_sameTimer);
+  RUN_TEST(test_crossTimers);
+  RUN_TEST(test_late);
+  RUN_TEST(test_duplicate);
+  RUN_TEST(test_full);
+
+  UNITY_END(); // stop unit testing
+}
+
+void loop() {
+}
@@ -0,0 +1,135 @@
+// Test for TimerCalibration
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <pulseGen.h>
+#include <timerAction.h>
+#include <timerCalibration.h>
+
+TimerCalibration calibration;
+
+void setUp(void) {
+  ExtTimer1.configure(TimerClock::Clk);
+}
+
+void tearDown(void) {
+}
+
+void test_calibrate()
+{
+  TEST_ASSERT_TRUE(TimerExtensions::calibrate(TimerAction1B, calibration));
+
+  TEST_ASSERT_GREATER_THAN(0, calibration.minLeadCycles);
+  TEST_ASSERT_LESS_THAN(TIMER_CALIBRATION_MAX_LEAD_CYCLES, calibration.minLeadCycles);
+  TEST_ASSERT_LESS_THAN(TIMER_CALIBRATION_MAX_LEAD_CYCLES, calibration.maxLatencyCycles);
+
+  // Calibrating leaves the settings as they were
+  TEST_ASSERT_EQUAL(TimerAction::MissLate, TimerAction1B.getLatePolicy());
+}
+
+void test_minLead()
+{
+  uint32_t leadTicks = TimerExtensions::getMinLeadTicks(calibration, TimerClock::Clk);
+
+  // The measured lead time hits every time
+  for (int i = 0; i < 100; ++i)
+  {
+    TEST_ASSERT_TRUE(TimerAction1B.schedule(ExtTimer1.get() + leadTicks, CompareAction::Nothing));
+
+    while (TimerAction::Scheduled == TimerAction1B.getState()) {}
+
+    TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction1B.getState());
+  }
+
+  // Slower clocks need fewer ticks
+  TEST_ASSERT_LESS_OR_EQUAL(leadTicks, TimerExtensions::getMinLeadTicks(calibration, TimerClock::ClkDiv8));
+  TEST_ASSERT_EQUAL(0, TimerExtensions::getMinLeadTicks(calibration, TimerClock::None));
+}
+
+void test_apply()
+{
+  TimerExtensions::applyCalibration(calibration, TimerAction1B);
+
+  TEST_ASSERT_EQUAL(TimerExtensions::getMissHorizonCycles(calibration), TimerAction1B.getMissHorizonCycles());
+  TEST_ASSERT_GREATER_THAN(calibration.maxLatencyCycles, TimerAction1B.getMissHorizonCycles());
+
+  // Never narrower than the default
+  TimerCalibration fast = {10, 10};
+  TEST_ASSERT_EQUAL(TIMER_ACTION_MISS_HORIZON_CYCLES, TimerExtensions::getMissHorizonCycles(fast));
+
+  TimerAction1B.setMissHorizonCycles(TIMER_ACTION_MISS_HORIZON_CYCLES);
+}
+
+void test_applyPulseGen()
+{
+  PulseGen pulseGen(TimerAction1B);
+
+  TimerExtensions::applyCalibration(calibration, pulseGen);
+
+  TEST_ASSERT_EQUAL(TimerExtensions::getShortLeadCycles(calibration), pulseGen.getShortLeadCycles());
+  TEST_ASSERT_EQUAL(TimerExtensions::getMissHorizonCycles(calibration), TimerAction1B.getMissHorizonCycles());
+
+  // The calibrated lead is enough to wake up for a short pulse
+  ticksExtraRange_t start = ExtTimer1.get() + 2000;
+
+  TEST_ASSERT_TRUE(pulseGen.scheduleShort(start, start + 20));
+
+  while (static_cast<int32_t>(ExtTimer1.get() - (start + 100)) < 0) {}
+
+  TEST_ASSERT_EQUAL(PulseGen::Idle, pulseGen.getState());
+
+  TimerAction1B.setMissHorizonCycles(TIMER_ACTION_MISS_HORIZON_CYCLES);
+}
+
+void test_eeprom()
+{
+  TimerCalibration loaded = {0, 0};
+
+  TimerExtensions::saveCalibration(calibration, 0);
+
+  TEST_ASSERT_TRUE(TimerExtensions::loadCalibration(loaded, 0));
+  TEST_ASSERT_EQUAL(calibration.minLeadCycles, loaded.minLeadCycles);
+  TEST_ASSERT_EQUAL(calibration.maxLatencyCycles, loaded.maxLatencyCycles);
+
+  // Loading instead of calibrating
+  loaded = {0, 0};
+  TEST_ASSERT_TRUE(TimerExtensions::loadOrCalibrate(TimerAction1B, loaded, 0));
+  TEST_ASSERT_EQUAL(calibration.minLeadCycles, loaded.minLeadCycles);
+
+  // Nothing saved here
+  TEST_ASSERT_FALSE(TimerExtensions::loadCalibration(loaded, 1));
+}
+
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  UNITY_BEGIN();    // IMPORTANT LINE!
+
+  RUN_TEST(test_calibrate);
+  RUN_TEST(test_minLead);
+  RUN_TEST(test_apply);
+  RUN_TEST(test_applyPulseGen);
+  RUN_TEST(test_eeprom);
+
+  UNITY_END(); // stop unit testing
+}
+
+void loop() {
+}
@@ -0,0 +1,207 @@
+// Timer Events tests
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <timerAction.h>
+#include <timerEvents.h>
+#include <pulseGen.h>
+
+volatile uint8_t cbCount;
+volatile bool cbInIsr;
+uint8_t polledState;
+ticksExtraRange_t polledTicks;
+
+void actionCallback(TimerAction *timerAction, void *data)
+{
+  cbCount++;
+
+  // Interrupts are on in the main context
+  cbInIsr = !(SREG & _BV(SREG_I));
+
+  const TimerEvent *event = TimerExtensions::getPolledEvent();
+
+  if (event)
+  {
+    polledState = event->state;
+    polledTicks = event->ticks;
+  }
+}
+
+void waitUntil(ticksExtraRange_t ticks)
+{
+  while (static_cast<int32_t>(ExtTimer1.get() - ticks) < 0) {}
+}
+
+void setUp(void) {
+  ExtTimer1.configure(TimerClock::Clk);
+
+  cbCount = 0;
+  cbInIsr = false;
+
+  // Throw away anything left over
+  TimerAction1A.setDeferredCallbacks(false);
+  TimerExtensions::poll();
+}
+
+void tearDown(void) {
+  TimerAction1A.cancel();
+  TimerAction1A.setDeferredCallbacks(false);
+}
+
+void test_deferred()
+{
+  TimerAction1A.setDeferredCallbacks(true);
+  TEST_ASSERT_TRUE(TimerAction1A.getDeferredCallbacks());
+
+  ticksExtraRange_t actionTicks = ExtTimer1.get() + 1000;
+  TEST_ASSERT_TRUE(TimerAction1A.schedule(actionTicks, actionCallback));
+
+  waitUntil(actionTicks + 500);
+
+  // Queued, but not run yet
+  TEST_ASSERT_EQUAL(0, cbCount);
+  TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction1A.getState());
+
+  TEST_ASSERT_EQUAL(1, TimerExtensions::poll());
+
+  TEST_ASSERT_EQUAL(1, cbCount);
+  TEST_ASSERT_FALSE(cbInIsr);
+  TEST_ASSERT_EQUAL(TimerAction::Idle, polledState);
+  TEST_ASSERT_UINT32_WITHIN(200, actionTicks + 100, polledTicks);
+  TEST_ASSERT_NULL(TimerExtensions::getPolledEvent());
+
+  // Nothing left
+  TEST_ASSERT_EQUAL(0, TimerExtensions::poll());
+}
+
+void test_notDeferred()
+{
+  ticksExtraRange_t actionTicks = ExtTimer1.get() + 1000;
+  TEST_ASSERT_TRUE(TimerAction1A.schedule(actionTicks, actionCallback));
+
+  waitUntil(actionTicks + 500);
+
+  TEST_ASSERT_EQUAL(1, cbCount);
+  TEST_ASSERT_TRUE(cbInIsr);
+  TEST_ASSERT_EQUAL(0, TimerExtensions::poll());
+}
+
+void test_missDeferred()
+{
+  TimerAction1A.setDeferredCallbacks(true);
+
+  TEST_ASSERT_FALSE(TimerAction1A.schedule(ExtTimer1.get(), actionCallback));
+  TEST_ASSERT_EQUAL(0, cbCount);
+
+  TEST_ASSERT_EQUAL(1, TimerExtensions::poll());
+  TEST_ASSERT_EQUAL(TimerAction::MissedAction, polledState);
+}
+
+volatile uint8_t otherCbCount;
+
+void otherCallback(TimerAction *timerAction, void *data)
+{
+  otherCbCount++;
+}
+
+void test_callbackChanged()
+{
+  TimerAction1A.setDeferredCallbacks(true);
+  otherCbCount = 0;
+
+  ticksExtraRange_t actionTicks = ExtTimer1.get() + 1000;
+  TEST_ASSERT_TRUE(TimerAction1A.schedule(actionTicks, actionCallback));
+
+  waitUntil(actionTicks + 500);
+
+  // Schedule again with another callback before polling
+  TEST_ASSERT_TRUE(TimerAction1A.schedule(ExtTimer1.get() + 10000, otherCallback));
+
+  // The event runs the callback it was raised for
+  TEST_ASSERT_EQUAL(1, TimerExtensions::poll());
+  TEST_ASSERT_EQUAL(1, cbCount);
+  TEST_ASSERT_EQUAL(0, otherCbCount);
+}
+
+void test_full()
+{
+  TimerAction1A.setDeferredCallbacks(true);
+
+  uint16_t dropped = TimerExtensions::getDroppedEventCount();
+
+  // Periodic, so one event per period
+  ticksExtraRange_t firstTicks = ExtTimer1.get() + 1000;
+  TEST_ASSERT_TRUE(TimerAction1A.schedulePeriodic(firstTicks, 1000, actionCallback));
+
+  waitUntil(firstTicks + 1000ul * (TIMER_EVENT_QUEUE_SIZE + 2) + 500);
+
+  TimerAction1A.cancel();
+
+  // The queue holds one less than its size
+  TEST_ASSERT_EQUAL(TIMER_EVENT_QUEUE_SIZE - 1, TimerExtensions::poll());
+  TEST_ASSERT_EQUAL(4, TimerExtensions::getDroppedEventCount() - dropped);
+}
+
+volatile uint8_t pulseCbCount;
+uint8_t pulseStates[4];
+
+void pulseCallback(PulseGen *pulse, const void *data)
+{
+  pulseStates[pulseCbCount++] = TimerExtensions::getPolledEvent()->state;
+}
+
+void test_pulseGen()
+{
+  PulseGen pulse(TimerAction1A, pulseCallback);
+  pulse.setDeferredCallbacks(true);
+
+  pulseCbCount = 0;
+
+  ticksExtraRange_t start = ExtTimer1.get() + 1000;
+  TEST_ASSERT_TRUE(pulse.schedule(start, start + 1000));
+
+  waitUntil(start + 1500);
+
+  TEST_ASSERT_EQUAL(0, pulseCbCount);
+  TEST_ASSERT_EQUAL(2, TimerExtensions::poll());
+
+  // Both state changes arrive, in order, with the state at the time
+  TEST_ASSERT_EQUAL(2, pulseCbCount);
+  TEST_ASSERT_EQUAL(PulseGen::ScheduledEnd, pulseStates[0]);
+  TEST_ASSERT_EQUAL(PulseGen::Idle, pulseStates[1]);
+}
+
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  UNITY_BEGIN();    // IMPORTANT LINE!
+
+  RUN_TEST(test_deferred);
+  RUN_TEST(test_notDeferred);
+  RUN_TEST(test_missDeferred);
+  RUN_TEST(test_callbackChanged);
+  RUN_TEST(test_full);
+  RUN_TEST(test_pulseGen);
+
+  UNITY_END(); // stop unit testing
+}
+
+void loop() {
+}
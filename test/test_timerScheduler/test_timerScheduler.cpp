@@ -0,0 +1,262 @@
+// Timer Scheduler tests
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <timerScheduler.h>
+
+#define ALARM_COUNT 5
+
+TimerScheduler scheduler(TimerAction1A);
+
+TimerAlarm alarms[ALARM_COUNT];
+
+volatile uint8_t firedOrder[ALARM_COUNT];
+volatile uint8_t firedCount;
+volatile ticksExtraRange_t firedTicks[ALARM_COUNT];
+
+void recordCallback(TimerAlarm *alarm, void *data)
+{
+  uint8_t index = alarm - alarms;
+
+  firedTicks[firedCount] = ExtTimer1.getFromIsr();
+  firedOrder[firedCount] = index;
+  firedCount++;
+}
+
+void waitUntil(ticksExtraRange_t ticks)
+{
+  while (static_cast<int32_t>(ExtTimer1.get() - ticks) < 0) {}
+}
+
+void setUp(void) {
+  ExtTimer1.configure(TimerClock::Clk);
+
+  firedCount = 0;
+}
+
+void tearDown(void) {
+  for (TimerAlarm &alarm : alarms)
+  {
+    scheduler.cancel(alarm);
+  }
+}
+
+void test_order()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  scheduler.schedule(alarms[0], now + 3000, recordCallback);
+  scheduler.schedule(alarms[1], now + 1000, recordCallback);
+  scheduler.schedule(alarms[2], now + 2000, recordCallback);
+
+  TEST_ASSERT_EQUAL(3, scheduler.getPendingCount());
+  TEST_ASSERT_EQUAL_PTR(&alarms[1], scheduler.getNextAlarm());
+
+  waitUntil(now + 3500);
+
+  TEST_ASSERT_EQUAL(3, firedCount);
+  TEST_ASSERT_EQUAL(1, firedOrder[0]);
+  TEST_ASSERT_EQUAL(2, firedOrder[1]);
+  TEST_ASSERT_EQUAL(0, firedOrder[2]);
+
+  // Each alarm ran at its own time
+  TEST_ASSERT_UINT32_WITHIN(200, now + 1000 + 100, firedTicks[0]);
+  TEST_ASSERT_UINT32_WITHIN(200, now + 2000 + 100, firedTicks[1]);
+  TEST_ASSERT_UINT32_WITHIN(200, now + 3000 + 100, firedTicks[2]);
+
+  TEST_ASSERT_EQUAL(0, scheduler.getPendingCount());
+  TEST_ASSERT_NULL(scheduler.getNextAlarm());
+}
+
+void test_sameTime()
+{
+  ticksExtraRange_t ticks = ExtTimer1.get() + 2000;
+
+  for (TimerAlarm &alarm : alarms)
+  {
+    scheduler.schedule(alarm, ticks, recordCallback);
+  }
+
+  waitUntil(ticks + 1000);
+
+  // All run in one pass, in the order they were scheduled
+  TEST_ASSERT_EQUAL(ALARM_COUNT, firedCount);
+
+  for (uint8_t i = 0; i < ALARM_COUNT; i++)
+  {
+    TEST_ASSERT_EQUAL(i, firedOrder[i]);
+  }
+}
+
+void test_farFuture()
+{
+  // Further away than one timer overflow
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  scheduler.schedule(alarms[0], now + 150000, recordCallback);
+
+  waitUntil(now + 160000);
+
+  TEST_ASSERT_EQUAL(1, firedCount);
+  TEST_ASSERT_UINT32_WITHIN(200, now + 150000 + 100, firedTicks[0]);
+}
+
+void test_cancel()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  scheduler.schedule(alarms[0], now + 1000, recordCallback);
+  scheduler.schedule(alarms[1], now + 2000, recordCallback);
+  scheduler.schedule(alarms[2], now + 3000, recordCallback);
+
+  // Cancel the earliest and a middle one
+  TEST_ASSERT_TRUE(scheduler.cancel(alarms[0]));
+  TEST_ASSERT_TRUE(scheduler.cancel(alarms[1]));
+  TEST_ASSERT_FALSE(scheduler.cancel(alarms[1]));
+  TEST_ASSERT_FALSE(alarms[1].isPending());
+  TEST_ASSERT_TRUE(alarms[2].isPending());
+
+  TEST_ASSERT_EQUAL(1, scheduler.getPendingCount());
+
+  waitUntil(now + 3500);
+
+  TEST_ASSERT_EQUAL(1, firedCount);
+  TEST_ASSERT_EQUAL(2, firedOrder[0]);
+}
+
+void test_cancelAfterRun()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  scheduler.schedule(alarms[0], now + 1000, recordCallback);
+  scheduler.schedule(alarms[1], now + 2000, recordCallback);
+  scheduler.schedule(alarms[2], now + 3000, recordCallback);
+
+  waitUntil(now + 1500);
+
+  // Running the first alarm moved the second to the head of the list
+  TEST_ASSERT_EQUAL_PTR(&alarms[1], scheduler.getNextAlarm());
+  TEST_ASSERT_TRUE(scheduler.cancel(alarms[1]));
+  TEST_ASSERT_EQUAL_PTR(&alarms[2], scheduler.getNextAlarm());
+  TEST_ASSERT_TRUE(scheduler.cancel(alarms[2]));
+  TEST_ASSERT_NULL(scheduler.getNextAlarm());
+
+  waitUntil(now + 3500);
+
+  TEST_ASSERT_EQUAL(1, firedCount);
+}
+
+void test_move()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  scheduler.schedule(alarms[0], now + 1000, recordCallback);
+  scheduler.schedule(alarms[1], now + 2000, recordCallback);
+
+  // Scheduling a pending alarm moves it
+  scheduler.schedule(alarms[0], now + 3000, recordCallback);
+
+  TEST_ASSERT_EQUAL(2, scheduler.getPendingCount());
+
+  waitUntil(now + 3500);
+
+  TEST_ASSERT_EQUAL(2, firedCount);
+  TEST_ASSERT_EQUAL(1, firedOrder[0]);
+  TEST_ASSERT_EQUAL(0, firedOrder[1]);
+}
+
+void test_past()
+{
+  scheduler.schedule(alarms[0], ExtTimer1.get() - 100, recordCallback);
+
+  // Already ran
+  TEST_ASSERT_EQUAL(1, firedCount);
+  TEST_ASSERT_FALSE(alarms[0].isPending());
+}
+
+void repeatCallback(TimerAlarm *alarm, void *data)
+{
+  recordCallback(alarm, data);
+
+  if (firedCount < ALARM_COUNT)
+  {
+    scheduler.schedule(*alarm, alarm->getTicks() + 500, repeatCallback);
+  }
+}
+
+void test_scheduleFromCallback()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  scheduler.schedule(alarms[0], now + 1000, repeatCallback);
+
+  waitUntil(now + 1000 + 500 * ALARM_COUNT + 500);
+
+  TEST_ASSERT_EQUAL(ALARM_COUNT, firedCount);
+
+  for (uint8_t i = 1; i < ALARM_COUNT; i++)
+  {
+    TEST_ASSERT_UINT32_WITHIN(100, 500, firedTicks[i] - firedTicks[i - 1]);
+  }
+}
+
+void test_fireLate()
+{
+  TimerAction::LatePolicy latePolicy = TimerAction1A.getLatePolicy();
+  TimerAction1A.setLatePolicy(TimerAction::FireLate);
+
+  // Alarms close enough to come due while the TimerAction is being
+  // scheduled, so the late policy fires it. The alarm still has to run
+  for (ticksExtraRange_t delta = 0; delta < 64; ++delta)
+  {
+    firedCount = 0;
+
+    ticksExtraRange_t ticks = ExtTimer1.get() + delta;
+    scheduler.schedule(alarms[0], ticks, recordCallback);
+
+    waitUntil(ticks + 500);
+
+    TEST_ASSERT_EQUAL(1, firedCount);
+    TEST_ASSERT_EQUAL(0, scheduler.getPendingCount());
+  }
+
+  TimerAction1A.setLatePolicy(latePolicy);
+}
+
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  UNITY_BEGIN();    // IMPORTANT LINE!
+
+  RUN_TEST(test_order);
+  RUN_TEST(test_sameTime);
+  RUN_TEST(test_farFuture);
+  RUN_TEST(test_cancel);
+  RUN_TEST(test_cancelAfterRun);
+  RUN_TEST(test_move);
+  RUN_TEST(test_past);
+  RUN_TEST(test_scheduleFromCallback);
+  RUN_TEST(test_fireLate);
+
+  UNITY_END(); // stop unit testing
+}
+
+void loop() {
+}
@@ -0,0 +1,237 @@
+// Timer Sequence tests
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <timerSequence.h>
+
+#if defined(ARDUINO_AVR_MEGA2560)
+#define SEQUENCE_PIN 11
+#else
+#define SEQUENCE_PIN 9
+#endif
+
+TimerSequence sequence(TimerAction1A);
+
+volatile uint8_t doneCount;
+
+const TimerSequenceStep pulses[] = {
+  {1000, CompareAction::Set},
+  {500, CompareAction::Clear},
+  {500, CompareAction::Set},
+  {500, CompareAction::Clear},
+};
+
+const TimerSequenceStep pulsesP[] PROGMEM = {
+  {1000, CompareAction::Set},
+  {500, CompareAction::Clear},
+  {500, CompareAction::Set},
+};
+
+const TimerSequenceStep square[] = {
+  {500, CompareAction::Set},
+  {500, CompareAction::Clear},
+};
+
+void doneCallback(TimerSequence *sequence, void *data)
+{
+  doneCount++;
+}
+
+int digitalReadPWM(uint8_t pin)
+{
+  uint8_t bit = digitalPinToBitMask(pin);
+  uint8_t port = digitalPinToPort(pin);
+
+  if (*portInputRegister(port) & bit) return HIGH;
+  return LOW;
+}
+
+void waitUntil(ticksExtraRange_t ticks)
+{
+  while (static_cast<int32_t>(ExtTimer1.get() - ticks) < 0) {}
+}
+
+void setUp(void) {
+  ExtTimer1.configure(TimerClock::Clk);
+
+  pinMode(SEQUENCE_PIN, OUTPUT);
+  digitalWrite(SEQUENCE_PIN, LOW);
+
+  doneCount = 0;
+}
+
+void tearDown(void) {
+  sequence.stop();
+  setOutputCompareAction(TIMER1A, CompareAction::Nothing);
+}
+
+void test_play()
+{
+  ticksExtraRange_t start = ExtTimer1.get();
+
+  TEST_ASSERT_TRUE(sequence.start(start, pulses, 4, false, doneCallback));
+  TEST_ASSERT_TRUE(sequence.isPlaying());
+
+  waitUntil(start + 1250);
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(SEQUENCE_PIN));
+  TEST_ASSERT_EQUAL(1, sequence.getStepIndex());
+
+  waitUntil(start + 1750);
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(SEQUENCE_PIN));
+
+  waitUntil(start + 2250);
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(SEQUENCE_PIN));
+
+  waitUntil(start + 2750);
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(SEQUENCE_PIN));
+
+  TEST_ASSERT_EQUAL(1, doneCount);
+  TEST_ASSERT_FALSE(sequence.isPlaying());
+  TEST_ASSERT_FALSE(sequence.wasMissed());
+  TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction1A.getState());
+
+  // Every edge was set up ahead of time
+  TEST_ASSERT_EQUAL(start + 2500, TimerAction1A.getActionTicks());
+}
+
+void test_progmem()
+{
+  ticksExtraRange_t start = ExtTimer1.get();
+
+  TEST_ASSERT_TRUE(sequence.start_P(start, pulsesP, 3, false, doneCallback));
+
+  waitUntil(start + 1750);
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(SEQUENCE_PIN));
+
+  waitUntil(start + 2250);
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(SEQUENCE_PIN));
+  TEST_ASSERT_EQUAL(1, doneCount);
+}
+
+void test_loop()
+{
+  ticksExtraRange_t start = ExtTimer1.get();
+
+  TEST_ASSERT_TRUE(sequence.start(start, square, 2, true, doneCallback));
+
+  // 1000 ticks per loop, going back to the first step at each clear
+  waitUntil(start + 5750);
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(SEQUENCE_PIN));
+  TEST_ASSERT_EQUAL(5, sequence.getLoopCount());
+  TEST_ASSERT_TRUE(sequence.isPlaying());
+  TEST_ASSERT_EQUAL(0, doneCount);
+
+  // The edges don't drift
+  TEST_ASSERT_EQUAL(start + 6000, TimerAction1A.getActionTicks());
+
+  // Finish the loop at the clear, rather than stopping with the pin high
+  sequence.stopAfterStep();
+
+  waitUntil(start + 6250);
+  TEST_ASSERT_EQUAL(LOW, digitalReadPWM(SEQUENCE_PIN));
+  TEST_ASSERT_EQUAL(1, doneCount);
+  TEST_ASSERT_FALSE(sequence.isPlaying());
+}
+
+void test_stop()
+{
+  ticksExtraRange_t start = ExtTimer1.get();
+
+  TEST_ASSERT_TRUE(sequence.start(start, square, 2, true, doneCallback));
+
+  waitUntil(start + 2750);
+
+  TEST_ASSERT_TRUE(sequence.stop());
+  TEST_ASSERT_FALSE(sequence.isPlaying());
+
+  waitUntil(start + 3750);
+
+  // Left where it was, with no callback
+  TEST_ASSERT_EQUAL(HIGH, digitalReadPWM(SEQUENCE_PIN));
+  TEST_ASSERT_EQUAL(0, doneCount);
+}
+
+void test_missed()
+{
+  // Far too short for the ISR to set up the second edge
+  static const TimerSequenceStep tooShort[] = {
+    {1000, CompareAction::Set},
+    {2, CompareAction::Clear},
+  };
+
+  ticksExtraRange_t start = ExtTimer1.get();
+
+  TEST_ASSERT_TRUE(sequence.start(start, tooShort, 2, false, doneCallback));
+
+  waitUntil(start + 1500);
+
+  TEST_ASSERT_EQUAL(1, doneCount);
+  TEST_ASSERT_TRUE(sequence.wasMissed());
+  TEST_ASSERT_EQUAL(TimerAction::MissedAction, TimerAction1A.getState());
+}
+
+void test_closeEdges()
+{
+  // Each edge is set up only a little before it's due, so the compare
+  // action has to be in place before the compare time is
+  static const TimerSequenceStep closeEdges[] = {
+    {1000, CompareAction::Set},
+    {64, CompareAction::Clear},
+    {64, CompareAction::Set},
+    {64, CompareAction::Clear},
+    {64, CompareAction::Set},
+    {64, CompareAction::Clear},
+  };
+
+  ExtTimer1.configure(TimerClock::ClkDiv8);
+
+  ticksExtraRange_t start = ExtTimer1.get();
+
+  TEST_ASSERT_TRUE(sequence.start(start, closeEdges, 6, false, doneCallback));
+
+  for (uint8_t i = 0; i < 6; i++)
+  {
+    waitUntil(start + 1000 + 64 * i + 32);
+    TEST_ASSERT_EQUAL(i % 2 ? LOW : HIGH, digitalReadPWM(SEQUENCE_PIN));
+  }
+
+  TEST_ASSERT_EQUAL(1, doneCount);
+  TEST_ASSERT_FALSE(sequence.wasMissed());
+  TEST_ASSERT_EQUAL(TimerAction::Idle, TimerAction1A.getState());
+  TEST_ASSERT_EQUAL(start + 1320, TimerAction1A.getActionTicks());
+}
+
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  UNITY_BEGIN();    // IMPORTANT LINE!
+
+  RUN_TEST(test_play);
+  RUN_TEST(test_progmem);
+  RUN_TEST(test_loop);
+  RUN_TEST(test_stop);
+  RUN_TEST(test_missed);
+  RUN_TEST(test_closeEdges);
+
+  UNITY_END(); // stop unit testing
+}
+
+void loop() {
+}
@@ -0,0 +1,225 @@
+// Timing Wheel tests
+// Copyright (C) 2022  Joshua Booth
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser Public License for more details.
+
+// You should have received a copy of the GNU Lesser Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <timingWheel.h>
+
+#define TIMEOUT_COUNT 5
+
+// 8 slots of 1024 ticks, so one turn is 8192 ticks
+#define SLOT_TICKS 1024
+#define TURN_TICKS (8 * SLOT_TICKS)
+
+TimingWheel<8, 10> wheel(TimerAction1A);
+
+TimerTimeout timeouts[TIMEOUT_COUNT];
+
+volatile uint8_t firedOrder[TIMEOUT_COUNT];
+volatile uint8_t firedCount;
+volatile ticksExtraRange_t firedTicks[TIMEOUT_COUNT];
+
+void recordCallback(TimerTimeout *timeout, void *data)
+{
+  uint8_t index = timeout - timeouts;
+
+  firedTicks[firedCount] = ExtTimer1.getFromIsr();
+  firedOrder[firedCount] = index;
+  firedCount++;
+}
+
+void waitUntil(ticksExtraRange_t ticks)
+{
+  while (static_cast<int32_t>(ExtTimer1.get() - ticks) < 0) {}
+}
+
+// Runs at or after ticks, and no later than the slot boundary after it
+void assertFiredInSlot(ticksExtraRange_t ticks, ticksExtraRange_t firedAt)
+{
+  TEST_ASSERT_UINT32_WITHIN(SLOT_TICKS / 2 + 200, ticks + SLOT_TICKS / 2 + 100, firedAt);
+}
+
+void setUp(void) {
+  ExtTimer1.configure(TimerClock::Clk);
+
+  firedCount = 0;
+}
+
+void tearDown(void) {
+  for (TimerTimeout &timeout : timeouts)
+  {
+    wheel.cancel(timeout);
+  }
+}
+
+void test_order()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  wheel.arm(timeouts[0], now + 5000, recordCallback);
+  wheel.arm(timeouts[1], now + 2000, recordCallback);
+  wheel.arm(timeouts[2], now + 3500, recordCallback);
+
+  TEST_ASSERT_EQUAL(3, wheel.getArmedCount());
+  TEST_ASSERT_TRUE(timeouts[0].isArmed());
+
+  waitUntil(now + 5000 + 2 * SLOT_TICKS);
+
+  TEST_ASSERT_EQUAL(3, firedCount);
+  TEST_ASSERT_EQUAL(1, firedOrder[0]);
+  TEST_ASSERT_EQUAL(2, firedOrder[1]);
+  TEST_ASSERT_EQUAL(0, firedOrder[2]);
+
+  assertFiredInSlot(now + 2000, firedTicks[0]);
+  assertFiredInSlot(now + 3500, firedTicks[1]);
+  assertFiredInSlot(now + 5000, firedTicks[2]);
+
+  TEST_ASSERT_EQUAL(0, wheel.getArmedCount());
+  TEST_ASSERT_FALSE(timeouts[0].isArmed());
+}
+
+void test_laterTurn()
+{
+  // Hashes to the same slot as a timeout one turn earlier
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  wheel.arm(timeouts[0], now + 3 * TURN_TICKS + 2000, recordCallback);
+  wheel.arm(timeouts[1], now + 2000, recordCallback);
+
+  waitUntil(now + 2000 + 2 * SLOT_TICKS);
+
+  TEST_ASSERT_EQUAL(1, firedCount);
+  TEST_ASSERT_EQUAL(1, firedOrder[0]);
+  TEST_ASSERT_TRUE(timeouts[0].isArmed());
+
+  waitUntil(now + 3 * TURN_TICKS + 2000 + 2 * SLOT_TICKS);
+
+  TEST_ASSERT_EQUAL(2, firedCount);
+  TEST_ASSERT_EQUAL(0, firedOrder[1]);
+  assertFiredInSlot(now + 3 * TURN_TICKS + 2000, firedTicks[1]);
+}
+
+void test_cancel()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  wheel.arm(timeouts[0], now + 2000, recordCallback);
+  wheel.arm(timeouts[1], now + 2000, recordCallback);
+  wheel.arm(timeouts[2], now + 2000, recordCallback);
+
+  // Cancel from the middle of a slot's list
+  TEST_ASSERT_TRUE(wheel.cancel(timeouts[1]));
+  TEST_ASSERT_FALSE(wheel.cancel(timeouts[1]));
+  TEST_ASSERT_FALSE(timeouts[1].isArmed());
+
+  TEST_ASSERT_EQUAL(2, wheel.getArmedCount());
+
+  waitUntil(now + 2000 + 2 * SLOT_TICKS);
+
+  TEST_ASSERT_EQUAL(2, firedCount);
+  TEST_ASSERT_EQUAL(0, wheel.getArmedCount());
+}
+
+void test_move()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  wheel.arm(timeouts[0], now + 2000, recordCallback);
+
+  // Arming an armed timeout moves it
+  wheel.arm(timeouts[0], now + 6000, recordCallback);
+
+  TEST_ASSERT_EQUAL(1, wheel.getArmedCount());
+
+  waitUntil(now + 6000 + 2 * SLOT_TICKS);
+
+  TEST_ASSERT_EQUAL(1, firedCount);
+  assertFiredInSlot(now + 6000, firedTicks[0]);
+}
+
+void test_past()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  wheel.arm(timeouts[0], now - 100, recordCallback);
+
+  // Runs at the next slot boundary
+  waitUntil(now + 2 * SLOT_TICKS);
+
+  TEST_ASSERT_EQUAL(1, firedCount);
+  TEST_ASSERT_FALSE(timeouts[0].isArmed());
+}
+
+void repeatCallback(TimerTimeout *timeout, void *data)
+{
+  recordCallback(timeout, data);
+
+  if (firedCount < TIMEOUT_COUNT)
+  {
+    wheel.arm(*timeout, timeout->getTicks() + 3 * SLOT_TICKS, repeatCallback);
+  }
+}
+
+void test_armFromCallback()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  wheel.arm(timeouts[0], now + 2000, repeatCallback);
+
+  waitUntil(now + 2000 + 3 * SLOT_TICKS * TIMEOUT_COUNT + 2 * SLOT_TICKS);
+
+  TEST_ASSERT_EQUAL(TIMEOUT_COUNT, firedCount);
+
+  for (uint8_t i = 1; i < TIMEOUT_COUNT; i++)
+  {
+    TEST_ASSERT_UINT32_WITHIN(100, 3 * SLOT_TICKS, firedTicks[i] - firedTicks[i - 1]);
+  }
+}
+
+void test_idle()
+{
+  ticksExtraRange_t now = ExtTimer1.get();
+
+  wheel.arm(timeouts[0], now + 2000, recordCallback);
+
+  waitUntil(now + 2000 + 2 * SLOT_TICKS);
+
+  // Nothing armed, so the TimerAction isn't waking up for every slot
+  TEST_ASSERT_EQUAL(1, firedCount);
+  TEST_ASSERT_BIT_LOW(OCIE1A, TIMSK1);
+}
+
+void setup() {
+  // NOTE!!! Wait for >2 secs
+  // if board doesn't support software reset via Serial.DTR/RTS
+  delay(2000);
+
+  UNITY_BEGIN();    // IMPORTANT LINE!
+
+  RUN_TEST(test_order);
+  RUN_TEST(test_laterTurn);
+  RUN_TEST(test_cancel);
+  RUN_TEST(test_move);
+  RUN_TEST(test_past);
+  RUN_TEST(test_armFromCallback);
+  RUN_TEST(test_idle);
+
+  UNITY_END(); // stop unit testing
+}
+
+void loop() {
+}